@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+#include "Math/Vector.h"
+#include "Math/Matrix.h"
+
+namespace Math
+{
+    // @brief Positions stored as structure of arrays, so that batched kernels can load the same
+    // component of 4 (SSE) or 8 (AVX) vertices into one register.
+    struct SoAPositions
+    {
+        std::vector<float> x, y, z, w;
+
+        void Resize(size_t count);
+        size_t Size() const { return x.size(); }
+        Vec4f Get(size_t i) const { return Vec4f{x[i], y[i], z[i], w[i]}; }
+    };
+
+    // @brief Convert AoS positions to SoA, w is set to 1
+    void ToSoA(const std::vector<Vec3f>& verts, SoAPositions& out);
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Batch kernels. They process 8 vertices at a time with AVX, 4 with SSE, and the leftovers one
+    // at a time, so they give the same result as calling the scalar functions per vertex.
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+
+    // @brief out = in * m. in.w is treated as 1 (positions are points), out gets all 4 components
+    void TransformPositions(const SoAPositions& in, const Mat44f& m, SoAPositions& out);
+
+    // @brief out = in * m for directions (e.g. normals with the inverse transpose). in.w is treated
+    // as 0, so the translation row is ignored and out.w is 0.
+    void TransformDirections(const SoAPositions& in, const Mat44f& m, SoAPositions& out);
+
+    // @brief Clip space to NDC space: x, y, z are divided by w.
+    // @note w is replaced by 1/w, which is what perspective correct interpolation needs.
+    void PerspectiveDivide(SoAPositions& p);
+
+    // @brief NDC space to raster space, x in [0, w], y in [0, h]. z and w are untouched
+    void ViewportTransform(SoAPositions& p, int w, int h);
+}
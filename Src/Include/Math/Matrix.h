@@ -4,6 +4,7 @@
 #include <iomanip>
 #include <iostream>
 
+#include "Math/SIMD.h"
 #include "Math/Vector.h"
 #include "Utils/Helper.h"
 
@@ -14,8 +15,9 @@ namespace Math
     // Matrix is default-initialized to an identity matrix.
     // If you use list-initialization and don't provide enough arguments, the leftover elements are
     // 0-initialized.
+    // 4x4 matrices are aligned to their row size, so each row can be loaded into a SSE register.
     template<typename T, size_t Dim>
-    struct Matrix
+    struct alignas((Dim == 4) ? 4 * sizeof(T) : alignof(T)) Matrix
     {
         static constexpr size_t Count = Dim * Dim;
         T e[Count];
@@ -177,7 +179,9 @@ namespace Math
                 }
             }
 
-            // Zeroes rows below pivot, so that after the loop, we have a triangular matrix
+            // Zeroes rows below pivot, so that after the loop, we have a triangular matrix.
+            // @note pivotVal is the abs value, the elimination has to use the signed one.
+            pivotVal = src(p, p);
             for (int k = p + 1; k < Dim; ++k)
             {
                 T f = src(k, p) / pivotVal;
@@ -239,6 +243,55 @@ namespace Math
         return result;
 	}
 
+#if defined(QR_SIMD_SSE)
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // SSE overloads for Matrix<float, 4>. Since they aren't templates, overload resolution prefers
+    // them over the generic versions above.
+    // @note These can't be constexpr because of the intrinsics.
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    inline Matrix<float, 4> operator*(const Matrix<float, 4>& m1, const Matrix<float, 4>& m2)
+    {
+        __m128 rows[4] = {_mm_load_ps(&m2.e[0]), _mm_load_ps(&m2.e[4]), _mm_load_ps(&m2.e[8]), _mm_load_ps(&m2.e[12])};
+        Matrix<float, 4> result;
+        for (int i = 0; i < 4; ++i)
+        {
+            // Row i of the result is row i of m1 combining the rows of m2
+            __m128 r = _mm_mul_ps(_mm_set1_ps(m1(i, 0)), rows[0]);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m1(i, 1)), rows[1]));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m1(i, 2)), rows[2]));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m1(i, 3)), rows[3]));
+            _mm_store_ps(&result.e[i * 4], r);
+        }
+        return result;
+    }
+
+    inline Matrix<float, 4> Transpose(const Matrix<float, 4>& m)
+    {
+        __m128 r0 = _mm_load_ps(&m.e[0]);
+        __m128 r1 = _mm_load_ps(&m.e[4]);
+        __m128 r2 = _mm_load_ps(&m.e[8]);
+        __m128 r3 = _mm_load_ps(&m.e[12]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        Matrix<float, 4> result;
+        _mm_store_ps(&result.e[0], r0);
+        _mm_store_ps(&result.e[4], r1);
+        _mm_store_ps(&result.e[8], r2);
+        _mm_store_ps(&result.e[12], r3);
+        return result;
+    }
+
+    inline Vector<float, 4> MultiplyVecMat(const Vector<float, 4>& src, const Matrix<float, 4>& m)
+    {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(src.x), _mm_load_ps(&m.e[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(src.y), _mm_load_ps(&m.e[4])));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(src.z), _mm_load_ps(&m.e[8])));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(src.w), _mm_load_ps(&m.e[12])));
+        Vector<float, 4> result;
+        _mm_store_ps(result.e, r);
+        return result;
+    }
+#endif
+
     // @todo Do I need this?
 #if 0
     template<typename T>
@@ -328,7 +381,8 @@ namespace Math
         return result;
     }
 
-    // @note z is in range [0,1]
+    // @note z is in range [0,1]. Clip space w is -z of cam space, so (3, 3) has to be 0 rather
+    // than the 1 of the default identity matrix.
     inline Matrix<float, 4> InitPersp(float fovY, float aspectRatio, float n, float f)
     {
         Matrix<float, 4> result{};
@@ -338,9 +392,34 @@ namespace Math
         result(2, 2) = f / (n - f);
         result(2, 3) = -1.0f;
         result(3, 2) = f * n / (n - f);
+        result(3, 3) = 0.0f;
         return result;
     }
 
+    // @brief View matrix of a camera at eye looking at at, it looks down its -z
+    inline Matrix<float, 4> InitLookAt(const Vector<float, 3>& eye, const Vector<float, 3>& at, const Vector<float, 3>& up)
+    {
+        Vector<float, 3> camForward = Normal(eye - at);
+        Vector<float, 3> camRight = Normal(Cross(up, camForward));
+        Vector<float, 3> camUp = Cross(camForward, camRight);
+
+        Matrix<float, 4> viewMat{};
+        for (int i = 0; i < 3; ++i)
+        {
+            // Inverse of orthonormal is transpose
+            viewMat(i, 0) = camRight[i];
+            viewMat(i, 1) = camUp[i];
+            viewMat(i, 2) = camForward[i];
+        }
+
+        // Cam matrix is translation from origin to eye, so inverse is negation, coupled with (RT)^-1 =
+        // T^-1 R^-1, we must also dot by R parts
+        viewMat(3, 0) = -Dot(camRight, eye);
+        viewMat(3, 1) = -Dot(camUp, eye);
+        viewMat(3, 2) = -Dot(camForward, eye);
+
+        return viewMat;
+    }
 
 }
 
@@ -0,0 +1,19 @@
+#pragma once
+
+// @brief Detects which SIMD instruction sets the math code may use.
+// QR_SIMD_SSE is defined when SSE2 is available, which is always the case on x64. QR_SIMD_AVX is
+// defined when the compiler targets AVX (/arch:AVX2 or -mavx2, see the QR_ENABLE_AVX CMake option).
+// When neither is defined, every kernel falls back to its scalar loop.
+#if defined(__AVX__)
+#define QR_SIMD_AVX 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QR_SIMD_SSE 1
+#endif
+
+#if defined(QR_SIMD_AVX)
+#include <immintrin.h>
+#elif defined(QR_SIMD_SSE)
+#include <emmintrin.h>
+#endif
@@ -1,8 +1,10 @@
 #pragma once
 #include <cmath>        // sqrt, tan, sin, cos
 #include <initializer_list>
+#include <ostream>
 #include <type_traits>
 
+#include "Math/SIMD.h"
 #include "Utils/Helper.h"
 
 namespace Math
@@ -90,6 +92,35 @@ namespace Math
         constexpr T& operator[](size_t i) { return e[i]; }
     };
 
+    // @note Aligned to its own size, so Vec4f can be loaded into a SSE register in one go
+    template<typename T>
+    struct alignas(4 * sizeof(T)) Vector<T, 4>
+    {
+        union
+        {
+            T e[4];
+            struct { T x, y, z, w; };
+            struct { T r, g, b, a; };
+        };
+        constexpr Vector() : e{} {}
+        constexpr explicit Vector(T val) : e{}
+        {
+            for (int i = 0; i < 4; ++i)
+                e[i] = val;
+        }
+        constexpr Vector(std::initializer_list<T> li)
+            : e{}
+        {
+            int i = 0;
+            for (const auto& element : li)
+                e[i++] = element;
+        }
+
+		// Accessors, also case for passing by const ref
+        constexpr const T& operator[](size_t i) const { return e[i]; }
+        constexpr T& operator[](size_t i) { return e[i]; }
+    };
+
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////
     // List of available operations: 
@@ -149,6 +180,16 @@ namespace Math
         return (v * k);
     }
 
+    // @brief Component-wise product, e.g. to modulate a color by a light. Use Dot() for the dot
+    // product.
+    template<typename T, size_t Size>
+    constexpr Vector<T, Size> operator*(const Vector<T, Size>& v1, const Vector<T, Size>& v2)
+    {
+        Vector<T, Size> result;
+        for (int i = 0; i < Size; ++i) { result[i] = v1[i] * v2[i]; }
+        return result;
+    }
+
     template<typename T, size_t Size>
     constexpr Vector<T, Size> operator/(const Vector<T, Size>& v, T k)
     {
@@ -176,6 +217,13 @@ namespace Math
         return v;
     }
 
+    template<typename T, size_t Size>
+    constexpr Vector<T, Size>& operator*=(Vector<T, Size>& v1, const Vector<T, Size>& v2)
+    {
+        v1 = v1 * v2;
+        return v1;
+    }
+
     template<typename T, size_t Size>
     constexpr Vector<T, Size>& operator/=(Vector<T, Size>& v, T k)
     {
@@ -238,6 +286,55 @@ namespace Math
         return result;
     }
 
+#if defined(QR_SIMD_SSE)
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    // SSE overloads for Vector<float, 4>. Since they aren't templates, overload resolution prefers them
+    // over the generic versions above.
+    // @note These can't be constexpr because of the intrinsics.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    inline Vector<float, 4> operator-(const Vector<float, 4>& v)
+    {
+        Vector<float, 4> result;
+        _mm_store_ps(result.e, _mm_sub_ps(_mm_setzero_ps(), _mm_load_ps(v.e)));
+        return result;
+    }
+
+    inline Vector<float, 4> operator+(const Vector<float, 4>& v1, const Vector<float, 4>& v2)
+    {
+        Vector<float, 4> result;
+        _mm_store_ps(result.e, _mm_add_ps(_mm_load_ps(v1.e), _mm_load_ps(v2.e)));
+        return result;
+    }
+
+    inline Vector<float, 4> operator-(const Vector<float, 4>& v1, const Vector<float, 4>& v2)
+    {
+        Vector<float, 4> result;
+        _mm_store_ps(result.e, _mm_sub_ps(_mm_load_ps(v1.e), _mm_load_ps(v2.e)));
+        return result;
+    }
+
+    inline Vector<float, 4> operator*(const Vector<float, 4>& v, float k)
+    {
+        Vector<float, 4> result;
+        _mm_store_ps(result.e, _mm_mul_ps(_mm_load_ps(v.e), _mm_set1_ps(k)));
+        return result;
+    }
+
+    inline Vector<float, 4> operator*(float k, const Vector<float, 4>& v)
+    {
+        return (v * k);
+    }
+
+    inline float Dot(const Vector<float, 4>& v1, const Vector<float, 4>& v2)
+    {
+        __m128 m = _mm_mul_ps(_mm_load_ps(v1.e), _mm_load_ps(v2.e));
+        // Horizontal add: (x+z, y+w, ...) then (x+z + y+w)
+        m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(m);
+    }
+#endif
+
 }
 
 using Vec2f = Math::Vector<float, 2>;
@@ -246,3 +343,6 @@ using Vec2i = Math::Vector<int, 2>;
 using Vec3f = Math::Vector<float, 3>;
 using Vec3i = Math::Vector<int, 3>;
 
+using Vec4f = Math::Vector<float, 4>;
+using Vec4i = Math::Vector<int, 4>;
+
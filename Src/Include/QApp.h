@@ -1,14 +1,14 @@
 #pragma once
-#include <map>
 #include <memory>
 #include <vector>
 
+#include "Renderer/CommandBuffer.h"
+#include "Renderer/Texture.h"
 #include "SDL_Deleter.h"
 
 // Forward declarations
 enum class QRendererMode;
 class QRenderer;
-class QTexture;
 struct Model;
 
 class QApp
@@ -24,6 +24,8 @@ public:
     void Shutdown();
 
     void LoadModel(Model model);
+    // @brief The texture is loaded in the background, the model is drawn with a placeholder until
+    // then
     void LoadTexture(const std::string& textureFilePath);
     void SetDrawMode(QRendererMode drawMode);
 
@@ -40,8 +42,8 @@ private:
     // Renderer stuffs
     QRendererMode m_drawMode;
     std::vector<Model> m_models;
-    std::vector<std::shared_ptr<QTexture>> m_textures;
-    std::map<int, int> m_modelToTextureIndex;
+    std::vector<TextureHandle> m_modelTextures;     // Per model, not valid if untextured
+    CommandBuffer m_commands;
 
     // @note Differentiate with SDL_Renderer
     std::unique_ptr<QRenderer> m_qrenderer;
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// @brief How the texels of a QTexture are stored in memory
+enum class TextureFormat
+{
+    kRGBA32,
+    kBC1,           // 4x4 blocks of 8 bytes: 2 RGB565 endpoints and 2-bit indices, alpha is dropped
+    kBC3,           // 4x4 blocks of 16 bytes: 8-bit alpha endpoints and 3-bit indices, then a BC1 block
+};
+
+// @brief BC1/BC3 (DXT1/DXT5) encoding and decoding of 4x4 texel blocks, in the standard layout.
+// Blocks are in RGBA32 like the rest of the renderer, texel (x, y) of a block is at [x + y * 4].
+// @note The encoder fits the endpoints to the principal axis of the block's colors, it's meant to
+// run once at load time and favors simplicity over the last bit of quality.
+namespace BlockCompression
+{
+    // @return 8 for BC1, 16 for BC3, 0 for uncompressed formats
+    size_t GetBlockSize(TextureFormat format);
+
+    // @brief Bytes needed for a w x h image, the blocks on the right and top edges are padded. 4 per
+    // texel for kRGBA32.
+    size_t GetImageSize(TextureFormat format, int w, int h);
+
+    void EncodeBlock(TextureFormat format, const uint32_t (&texels)[16], uint8_t *outBlock);
+    void DecodeBlock(TextureFormat format, const uint8_t *block, uint32_t (&outTexels)[16]);
+
+    // @brief Encode a whole RGBA32 image, blocks in rows of (w + 3) / 4. The edge texels are
+    // repeated to pad the partial blocks.
+    void EncodeImage(TextureFormat format, const uint32_t *texels, int w, int h, uint8_t *outBlocks);
+}
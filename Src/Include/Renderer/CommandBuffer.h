@@ -0,0 +1,43 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "Math/Matrix.h"
+
+// Forward declarations
+struct Model;
+class QTexture;
+enum class QRendererMode;
+
+// @brief A recorded draw, see CommandBuffer
+struct DrawCommand
+{
+    const Model *model;
+    std::shared_ptr<QTexture> texture;      // nullptr when the draw isn't textured
+    Mat44f modelMat;
+    QRendererMode mode;
+    bool isTransparent = false;     // See QRenderer::RenderTransparent()
+    float opacity = 1.0f;
+};
+
+// @brief Draws recorded ahead of time, and only executed by QRenderer::Execute(). The renderer is
+// then free to reorder them (by state, then front to back), and the game logic can record the next
+// frame into another buffer while this one executes.
+// @note Recording isn't thread safe, a buffer is recorded by one thread at a time. The models and
+// textures must outlive the execution.
+class CommandBuffer
+{
+public:
+    void Draw(const Model& model, const Mat44f& modelMat, QRendererMode mode);
+    void Draw(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, QRendererMode mode);
+    void DrawTransparent(const Model& model, const Mat44f& modelMat, float opacity, QRendererMode mode);
+    void DrawTransparent(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, float opacity, QRendererMode mode);
+
+    // @brief Forget every draw, the memory is kept for the next recording
+    void Clear();
+
+    const std::vector<DrawCommand>& GetCommands() const;
+
+private:
+    std::vector<DrawCommand> m_commands;
+};
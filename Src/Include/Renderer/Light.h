@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+
+#include "Math/Vector.h"
+#include "Math/Matrix.h"
+
+enum class LightType
+{
+    kDirectional,
+    kPoint,
+};
+
+// @brief A light in world space.
+// @param vec For a directional light, the direction the light travels. For a point light, its
+// position.
+// @param range Point lights fade out to 0 at range, directional lights ignore it.
+// @param castsShadows Only the first directional light that casts shadows has them, see
+// QRenderer::SetShadows()
+struct Light
+{
+    LightType type = LightType::kDirectional;
+    Vec3f vec{0.0f, -1.0f, -1.0f};
+    Vec3f color{1.0f, 1.0f, 1.0f};
+    float intensity = 1.0f;
+    float range = 10.0f;
+    bool castsShadows = false;
+};
+
+// @brief Structure of arrays of up to kSize shading points in camera space. The lit color (sum of
+// every light, not multiplied by the surface color) is written to r, g, b.
+// @note shadow is how much of the shadow casting light reaches each point, it's only read when
+// shading with shadows.
+struct ShadeBatch
+{
+    static constexpr int kSize = 8;
+    alignas(32) float px[kSize], py[kSize], pz[kSize];
+    alignas(32) float nx[kSize], ny[kSize], nz[kSize];
+    alignas(32) float r[kSize], g[kSize], b[kSize];
+    alignas(32) float shadow[kSize];
+};
+
+// @brief Lights moved to camera space and packed for shading. Upload() is meant to be called once
+// per frame (or whenever the lights or the camera change), never per triangle.
+class LightBuffer
+{
+public:
+    void Upload(const std::vector<Light>& lights, const Mat44f& viewMat);
+
+    // @brief Lit color of a single point, pos and normal are in camera space. normal doesn't have
+    // to be normalized.
+    Vec3f Shade(const Vec3f& pos, const Vec3f& normal) const;
+
+    // @brief Same as Shade() for the first count points of batch. Processes 8 points at a time
+    // with AVX, 4 with SSE.
+    // @param useShadows Multiply the shadow casting light by batch.shadow
+    void Shade(ShadeBatch& batch, int count, bool useShadows = false) const;
+
+    // @brief Whether one of the lights casts shadows, see Light::castsShadows
+    bool HasShadowLight() const;
+
+private:
+    struct PackedLight
+    {
+        bool isPoint;
+        Vec3f vec;          // Normalized direction, or position, in camera space
+        Vec3f color;        // color * intensity
+        float invRangeSqr;
+        bool castsShadows;
+    };
+
+    std::vector<PackedLight> m_lights;
+    bool m_hasShadowLight = false;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+
+// Forward declarations
+struct Model;
+
+// @brief Binary cache of models, with their clusters and lods, so that the parsing and the
+// simplification only run once per source file. A cache file is only valid for the source file it
+// was built from (same size and modification time) and the lod settings it was built with.
+// @note Native byte order and struct layouts, the files aren't meant to be shared across machines.
+namespace MeshCache
+{
+    // @param lodLevels, keepSeams See Model::BuildLods()
+    // @return False if the file couldn't be written
+    bool Save(const std::string& cachePath, const Model& model, const std::string& sourcePath, int lodLevels, bool keepSeams);
+
+    // @return False if the file is missing, corrupt (indices out of range included), from another
+    // version of the format, or out of date with sourcePath or the lod settings. outModel is left
+    // untouched then.
+    bool Load(const std::string& cachePath, const std::string& sourcePath, int lodLevels, bool keepSeams, Model& outModel);
+
+    // @brief Load an .obj through its cache, next to it as objPath + ".qmesh". On a miss the model is
+    // parsed, its lods built, and the cache written for the next run.
+    // @param outIsHit If not nullptr, set to whether the model came from the cache
+    Model LoadOBJ(const std::string& objPath, int lodLevels = 4, bool keepSeams = true, bool *outIsHit = nullptr);
+}
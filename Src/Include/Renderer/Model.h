@@ -9,6 +9,53 @@ enum class InputWindingOrder
     kCCW,
 };
 
+// @brief Object space bounding volumes, an AABB and a sphere centered on it
+struct Bounds
+{
+    Vec3f min{0.0f};
+    Vec3f max{0.0f};
+    Vec3f center{0.0f};
+    float radius = 0.0f;
+};
+
+// @brief A run of spatially close tris with similar facing, culled as a unit by the rasterizer.
+// @param firstIndex, indexCount Range in vertIndices (and uvIndices, nIndices)
+// @param coneAxis, coneCutoff Normal cone of the tris. coneAxis is the average front facing
+// direction and coneCutoff the sine of the cone's half angle, it's > 1 when the cone is too wide to
+// ever be back facing as a whole.
+struct Cluster
+{
+    int firstIndex = 0;
+    int indexCount = 0;
+    Bounds bounds;
+    Vec3f coneAxis{0.0f};
+    float coneCutoff = 2.0f;
+};
+
+// @brief An edge of the mesh, listed once however many tris share it, for wireframe draws
+// @param v0, v1 Indices in verts
+// @param tri0, tri1 The tris on either side, as their first index in vertIndices / 3. tri1 is -1 on
+// an open border. An edge shared by more than 2 tris is listed once per pair.
+struct Edge
+{
+    int v0 = 0;
+    int v1 = 0;
+    int tri0 = 0;
+    int tri1 = -1;
+};
+
+// @brief A simplified version of a model's tris, indexing the model's own vertex buffers
+// @param error Largest distance (object space) between the simplified surface and the original one,
+// as estimated by the simplifier's quadrics
+struct Lod
+{
+    std::vector<int> vertIndices;
+    std::vector<int> uvIndices;
+    std::vector<int> nIndices;
+    std::vector<Cluster> clusters;
+    std::vector<Edge> edges;
+    float error = 0.0f;
+};
 
 // @param indices An index buffer where 3 successive elements are 3 vertices from verts that make up
 // a tri. This is used to save space
@@ -30,4 +77,42 @@ struct Model
         std::vector<Vec2f> inTexCoords = {}, std::vector<int> inUVIndices = {},
         std::vector<Vec3f> inNormals = {}, std::vector<int> inNIndices = {});
 
+    // @brief Compute bounds, then split the tris into clusters. Large meshes have their tris
+    // reordered so that each cluster is contiguous in the index buffers. Within a cluster the tris
+    // are ordered for vertex reuse, and the clusters facing out of the mesh go first to cut
+    // overdraw. The edges are built from the reordered tris.
+    // @note Called at load, call it again after modifying verts or indices.
+    void BuildClusters();
+
+    // @brief Reorder verts (and colors), texCoords and normals in the order the index buffers first
+    // use them, so that the draws fetch them mostly in sequence. Unused ones go last.
+    // @note Called at load after BuildClusters(), indices into the vertex buffers held elsewhere
+    // are invalid after it.
+    void ReorderVertices();
+
+    // @brief Average cache miss ratio of an index buffer: verts transformed per tri with a FIFO
+    // cache of the last cacheSize verts. From 3 (no reuse) down to about 0.5 for large meshes.
+    static float ComputeACMR(const std::vector<int>& indices, int cacheSize = kVertexCacheSize);
+
+    // @brief Cache size the tris are ordered for
+    static constexpr int kVertexCacheSize = 16;
+
+    // @brief Build lods by quadric edge collapse, each level with about half the tris of the previous
+    // one. Stops after maxLevels, or when a level would go under 64 tris or can't shrink any
+    // more. Open borders are kept in place.
+    // @param keepSeams Keep UV seams and normal creases in place too, so that textures don't tear.
+    // Meshes whose UVs are split almost everywhere (e.g. the teapot asset) barely simplify with it,
+    // turn it off for those when they're drawn untextured.
+    // @note Replaces any previous lods. Lods only index the existing vertex buffers, nothing new is
+    // allocated in verts, texCoords or normals.
+    void BuildLods(int maxLevels = 4, bool keepSeams = true);
+
+    Bounds bounds;
+    std::vector<Cluster> clusters;
+
+    // @brief Unique edges of the tris in tri order, see BuildClusters()
+    std::vector<Edge> edges;
+
+    // @brief lods[i] is level i + 1, level 0 being the model's own index buffers
+    std::vector<Lod> lods;
 };
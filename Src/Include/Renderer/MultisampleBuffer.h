@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Math/Vector.h"
+
+// @brief Per-sample depth and colors of a multisampled frame. Edges and depth are tested at every
+// sample, but each pixel is still shaded once and its color goes to the samples it covers.
+// Pixels whose samples all hold the same color only keep it in the pixel buffer. Only the pixels on
+// the edges of tris keep a color per sample, and only those are averaged by Resolve(), so the cost
+// beyond the depth tests scales with the edges rather than the whole frame.
+// @note Depth is 1/w like the main z-buffer, 0 is the furthest. Each sample plane is laid out like
+// the z-buffer, so that a quad reads 2 pairs of contiguous floats per sample.
+class MultisampleBuffer
+{
+public:
+    // @param samples 2, 4 or 8, at the standard D3D sample positions
+    void Init(int samples, int w, int h);
+
+    int GetSampleCount() const;
+
+    // @brief Position of sample s relative to the pixel center, within [-0.5, 0.5]
+    Vec2f GetSampleOffset(int s) const;
+
+    // @brief Depth of sample s of every pixel
+    float *GetDepth(int s);
+
+    // @brief Reset every sample to the furthest depth. The colors are left as they are, every pixel
+    // is back to the single color of the pixel buffer.
+    void Clear();
+
+    // @brief Write color to the samples of pixel i in sampleMask (bit per sample)
+    void Write(uint32_t *pixels, int i, uint32_t color, int sampleMask);
+
+    // @brief Average the samples of the edge pixels into pixels, rounded per channel
+    void Resolve(uint32_t *pixels) const;
+
+    // @brief Pixels whose samples differ, e.g. to check that it scales with the edges
+    int CountEdgePixels() const;
+
+private:
+    int m_samples = 1;
+    int m_fullMask = 1;
+    int m_pixelCnt = 0;
+
+    // @brief m_samples planes of m_pixelCnt floats
+    std::vector<float> m_depth;
+
+    // @brief Sample s of pixel i is at [i * m_samples + s], only valid where m_isEdge[i] is set
+    std::vector<uint32_t> m_colors;
+    std::vector<uint8_t> m_isEdge;
+};
+
+inline void MultisampleBuffer::Write(uint32_t *pixels, int i, uint32_t color, int sampleMask)
+{
+    if (sampleMask == m_fullMask)
+    {
+        pixels[i] = color;
+        m_isEdge[i] = 0;
+        return;
+    }
+
+    // The samples that aren't covered keep the color the pixel had so far
+    uint32_t *colors = m_colors.data() + (size_t)i * m_samples;
+    if (!m_isEdge[i])
+    {
+        for (int s = 0; s < m_samples; ++s)
+            colors[s] = pixels[i];
+        m_isEdge[i] = 1;
+    }
+    for (int s = 0; s < m_samples; ++s)
+    {
+        if ((sampleMask >> s) & 1)
+            colors[s] = color;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+
+#include "Math/Matrix.h"
+#include "Math/Batch.h"
+
+struct Bounds;
+struct Model;
+
+// @brief Small depth buffer for software occlusion culling. Occluders are rasterized into it first,
+// then the screen space bounding box of each occludee is tested against it before it's drawn.
+// Depth is 1/w like the main z-buffer, 0 is the furthest.
+// @note The buffer is conservative. Only texels fully covered by an occluder are written, so an
+// occludee that shows past the silhouette by less than a texel isn't hidden. The depth written is
+// the furthest the occluder's plane gets over the whole texel, so it's never in front of the
+// occluder itself.
+class OcclusionBuffer
+{
+public:
+    static constexpr int kW = 256;
+    static constexpr int kH = 128;
+
+    OcclusionBuffer();
+
+    void Clear();
+
+    // @param mvp Object space to clip space. Only front facing tris entirely in front of the near
+    // plane are drawn, skipping the others only makes the buffer less occluding.
+    void Rasterize(const Model& model, const Mat44f& mvp);
+
+    // @brief True if the box of bounds is behind the occluders everywhere it could be on screen.
+    // Boxes crossing the near plane are never occluded.
+    bool IsOccluded(const Bounds& bounds, const Mat44f& mvp) const;
+
+    const std::vector<float>& GetDepth() const;
+
+private:
+    // @param v0, v1, v2 In the raster space of the buffer, z is 1/w
+    // @param sharedEdges Bit i is set if the edge opposite to vert i is shared with another drawn
+    // tri, the other edges are silhouettes
+    void RasterizeTri(const Vec3f& v0, const Vec3f& v1, const Vec3f& v2, int sharedEdges);
+
+    // @brief Set in m_triFlags for the tris that are drawn, the low 3 bits are their shared edges
+    static constexpr unsigned char kDrawn = 1 << 3;
+
+    std::vector<float> m_depth;
+
+    // @brief Per-draw scratch buffers
+    Math::SoAPositions m_objectPos;
+    Math::SoAPositions m_clipPos;
+    std::vector<Vec3f> m_raster;
+    std::vector<unsigned char> m_triFlags;
+};
@@ -1,13 +1,21 @@
 #pragma once
 #include <memory>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "Math/Vector.h"
 #include "Math/Matrix.h"
+#include "Renderer/CommandBuffer.h"
+#include "Renderer/MultisampleBuffer.h"
 #include "Renderer/Rasterizer.h"
+#include "Renderer/ShadowMap.h"
+#include "Renderer/TransparencyBuffer.h"
 #include "SDL_Deleter.h"
 
 // Forward declarations
@@ -16,30 +24,165 @@ class QTexture;
 
 enum class QRendererMode
 {
-    kNone,
+    kNone,          // Flat shading, lit per tri
     kWireframe,
     kZBuffer,
+    kGouraud,       // Lit per vert, the colors are interpolated
+    kPhong,         // Lit per pixel, the normals are interpolated
+};
+
+// @brief Per instance data of QRenderer::RenderInstanced()
+struct Instance
+{
+    Mat44f modelMat;
+    Vec3f color{1.0f, 1.0f, 1.0f};      // Multiplies the surface color
+    int textureIndex = -1;              // In the textures given to RenderInstanced(), -1 for none
 };
 
 // @brief Controls the window
 class QRenderer
 {
 public:
+    ~QRenderer();
+
     bool Init(SDL_Window *window, int w, int h);
 
-    void Render(const Model& model, QRendererMode drawMode);
-    void Render(const Model& model, std::shared_ptr<QTexture> texture, QRendererMode drawMode);
+    // @brief Headless init, there's no window to present to so only the pixel buffer and the
+    // z-buffer are allocated. Read the result back with GetPixels().
+    bool Init(int w, int h);
+
+    // @brief Draw a model in object space, modelMat moves it to world space. The verts are only
+    // transformed inside the rasterizer, so the model itself is never copied or modified.
+    // Models whose bounds are outside of the frustum, or occluded, are skipped before any vertex
+    // work, as long as Model::BuildClusters() was called.
+    void Render(const Model& model, const Mat44f& modelMat, QRendererMode drawMode);
+    void Render(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, QRendererMode drawMode);
+
+    // @brief Draw a model that lets opacity of the pixels behind it through (times the alpha of
+    // the texels), see TransparencyBuffer. Transparent draws need no sorting, but they don't hide
+    // what's drawn after them, so draw them after the opaque ones. They're composited by Resolve().
+    void RenderTransparent(const Model& model, const Mat44f& modelMat, float opacity, QRendererMode drawMode);
+    void RenderTransparent(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, float opacity, QRendererMode drawMode);
+
+    // @brief Draw one model once per instance. Instances are culled one by one, then split in
+    // contiguous batches across worker threads that each draw into their own buffers, merged by
+    // depth at the end. The pixels are the same as one Render() call per instance.
+    // Workers are started by the first call that needs them and wait for the next batch until the
+    // renderer is destroyed. Their buffers are only cleared and merged over the screen rect that the
+    // bounds of their instances cover.
+    // @note Wireframe draws have no depth to merge by, so they stay on the calling thread.
+    void RenderInstanced(const Model& model, const std::vector<Instance>& instances, QRendererMode drawMode);
+    void RenderInstanced(const Model& model, const std::vector<Instance>& instances,
+        const std::vector<std::shared_ptr<QTexture>>& textures, QRendererMode drawMode);
+
+    // @brief Most threads RenderInstanced() uses, the calling one included. 0 (the default) picks
+    // from the hardware.
+    void SetInstanceThreads(int count);
+
+    // @brief Execute every draw of commands in one go. Culled draws are dropped, then the others are
+    // sorted by mode and texture (each texture is locked once), and front to back within those so
+    // that the depth test rejects as much as possible before shading. Transparent draws go after
+    // the opaque ones, sorted by state only.
+    void Execute(const CommandBuffer& commands);
     void SwapBuffers();
 
+    // @brief Reset the pixel buffer to black and the z-buffer to the furthest depth
+    void ClearBuffers();
+
     // @brief Move the projection matrix from caller 
     void SetProjectionMatrix(Mat44f m);
 
+    // @brief Move the view matrix from caller, used by every Render() call until it's set again
+    void SetViewMatrix(Mat44f m);
+
+    // @brief Lights are in world space. They're moved to camera space here and in SetViewMatrix(),
+    // so once per frame rather than per draw or per tri.
+    // @note Defaults to a single white directional light.
+    void SetLights(std::vector<Light> lights);
+
+    // @brief Software occlusion culling, off by default. Occluders drawn with RenderOccluder() go to
+    // a small depth buffer (see OcclusionBuffer), then Render() skips the models whose bounds are
+    // behind them. Occluders are cleared with the other buffers, so draw them first every frame.
+    // @note An occluder isn't drawn to the screen, Render() it as well to see it.
+    void SetOcclusionCulling(bool enable);
+    void RenderOccluder(const Model& model, const Mat44f& modelMat);
+
+    // @brief Shadows of the first directional light with Light::castsShadows, off by default, see
+    // ShadowMap. Casters are drawn depth-only from the light by RenderShadowCaster(), before the
+    // draws they shadow, every frame. Execute() casts with the opaque draws of the buffer on its own.
+    // Only kPhong draws receive shadows, they're looked up per pixel.
+    // @note Set the camera and the lights before the first draw of a frame, the cascades are fitted
+    // to them then.
+    void SetShadows(bool enable, const ShadowSettings& settings = ShadowSettings{});
+    void RenderShadowCaster(const Model& model, const Mat44f& modelMat);
+
+    // @brief With ShadowSettings::isCached, draw the casters again next frame, e.g. once they moved
+    void InvalidateShadows();
+
+    // @brief Models with lods (see Model::BuildLods()) are drawn with the coarsest one whose error
+    // projects to at most this many pixels at the nearest point of their bounds. 0 always draws the
+    // full model.
+    void SetLodErrorThreshold(float pixels);
+
+    // @brief Used by every following Render() call, e.g. to compare the traversals in benchmarks
+    void SetRasterTraversal(RasterTraversal traversal);
+
+    // @brief See Rasterizer::SetPixelCounting(), e.g. to measure overdraw
+    void SetPixelCounting(bool enable);
+
+    // @brief See Rasterizer::SetTextureFilter()
+    void SetTextureFilter(TextureFilter filter);
+
+    // @brief See Rasterizer::SetLineDepthTest(), e.g. to draw a wireframe over the same model
+    void SetWireframeDepthTest(bool enable);
+
+    // @brief 2, 4 or 8 samples per pixel, 1 (the default) turns it off, see MultisampleBuffer.
+    // Edges are anti-aliased while each pixel is still shaded once.
+    // @note Call it after Init(), the buffers are cleared. RenderInstanced() stays on the calling
+    // thread while it's on, the workers have no samples to merge.
+    void SetMultisampling(int samples);
+
+    // @brief Average the samples of the pixels on edges into the pixel buffer, then composite the
+    // transparent draws over it. SwapBuffers() does it before presenting, call it once before
+    // GetPixels() otherwise. Does nothing when single sampled with no transparent draw.
+    void Resolve();
+
+    // @brief Culling counts of every Render() call since the last ResetStats()
+    const RasterStats& GetStats() const;
+    void ResetStats();
+
     // @brief Construct a view matrix.
     Mat44f LookAt(const Vec3f& eye, const Vec3f& at, const Vec3f& up = Vec3f{0.0f, 1.0f, 0.0f});
 
     SDL_Renderer *GetRenderer();
+    const std::vector<uint32_t>& GetPixels() const;
 
 private:
+    // @brief Object level culling of a model before any vertex work, from its bounds
+    bool IsCulled(const Model& model, const Mat44f& mvp);
+
+    // @brief Fit the shadow maps and clear the cascades that have to be drawn again, once per frame
+    // before its first caster or draw
+    void PrepareShadows();
+
+    // @brief Level of detail to draw model with, see SetLodErrorThreshold()
+    int SelectLod(const Model& model, const Mat44f& modelViewMat) const;
+
+    // @brief Draws its share of the instances of RenderInstanced() into its own buffers, on its own
+    // thread
+    struct InstanceWorker
+    {
+        Rasterizer rasterizer;
+        std::vector<uint32_t> pixels;
+        std::vector<float> zBuffer;
+        int x0 = 0, y0 = 0, x1 = -1, y1 = -1;      // Screen rect of the last batch, inclusive
+        std::function<void()> batch;                // Queued by RenderInstanced(), empty when idle
+        std::thread thread;
+    };
+
+    // @brief Run the batches queued to worker until the renderer is destroyed
+    void WorkerLoop(InstanceWorker& worker);
+
     // @brief Information about rendering that is only used for the window
     std::unique_ptr<SDL_Renderer, SDL_Deleter> m_renderer;
 
@@ -49,7 +192,46 @@ private:
     Rasterizer m_rasterizer;
     int m_w, m_h;
 
+    Mat44f m_viewMat;
     Mat44f m_projMat;
+    std::vector<Light> m_lights{Light{}};
+    bool m_occlusionCulling = false;
+    bool m_shadowsEnabled = false;
+    ShadowMap m_shadowMap;
+    bool m_shadowsPrepared = false;     // Since the last ClearBuffers() or change of camera or lights
+    bool m_shadowsInvalid = true;       // The cached depth is out of date, see InvalidateShadows()
+    int m_shadowRedraw = 0;             // Bit per cascade that the casters are drawn to this frame
+    RasterTraversal m_traversal = RasterTraversal::kAuto;
+    bool m_pixelCounting = false;
+    TextureFilter m_textureFilter = TextureFilter::kBilinear;
+    int m_samples = 1;
+    MultisampleBuffer m_msaa;
+    TransparencyBuffer m_oit;
+    bool m_hasTransparency = false;     // Since the last Resolve() or ClearBuffers()
+    int m_instanceThreads = 0;
+    float m_lodErrorThreshold = 1.0f;
+
+    // @brief Created on the first RenderInstanced() that needs them
+    std::vector<std::unique_ptr<InstanceWorker>> m_workers;
+
+    // @brief Guards the batches of the workers and the counts below
+    std::mutex m_workerMutex;
+    std::condition_variable m_batchQueued;
+    std::condition_variable m_batchesDone;
+    int m_busyWorkers = 0;
+    bool m_workersStopping = false;
+    std::vector<int> m_visibleInstances;
+    std::vector<QTexture*> m_instanceTextures;   // Unique textures of a RenderInstanced()
+
+    // @brief Draws of Execute() that survived culling, in the order they're drawn
+    struct SortedDraw
+    {
+        const DrawCommand *command;
+        Mat44f modelViewMat;
+        float depth;
+        int lod;
+    };
+    std::vector<SortedDraw> m_sortedDraws;
 
     // @brief pixel data of the bitmap
     std::vector<uint32_t> m_pixels;
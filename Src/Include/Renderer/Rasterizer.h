@@ -3,55 +3,277 @@
 #include <vector>
 
 #include "Math/Matrix.h"
+#include "Math/Batch.h"
+#include "Renderer/BlockCompression.h"
+#include "Renderer/Light.h"
+#include "Renderer/OcclusionBuffer.h"
+#include "Renderer/Triangle.h"
 
+struct Bounds;
 struct Model;
+class MultisampleBuffer;
 class QTexture;
-struct Triangle;
+class ShadowMap;
+class TransparencyBuffer;
 enum class QRendererMode;
 
+// @brief How the pixels covered by a tri are visited
+enum class RasterTraversal
+{
+    kBoundingBox,   // Every quad of the bounding box is edge tested
+    kBlocks,        // 8x8 blocks are classified first, then skipped, filled or edge tested per quad
+    kSpans,         // Rows are walked between the edges, the quads inside are filled incrementally
+    kAuto,          // Picked per tri from the size of its bounding box
+};
+
+// @brief How textures are sampled within the mip level picked for each quad
+enum class TextureFilter
+{
+    kNearest,
+    kBilinear,      // The 2x2 texels around the sample are blended in 8.8 fixed point
+};
+
+// @brief Tri counts, accumulated over every Rasterize() call until ResetStats()
+struct RasterStats
+{
+    int modelsCulled = 0;       // Whole models outside of the frustum, see QRenderer::Render()
+    int modelsOccluded = 0;     // Whole models behind the occluders, see QRenderer::SetOcclusionCulling()
+    int clustersCulled = 0;     // Clusters outside of the frustum or back facing, see Model::clusters
+    int submitted = 0;          // Tris of the clusters drawn
+    int outsideFrustum = 0;     // All 3 verts outside of the same clipping plane
+    int backFacing = 0;         // Including the ones with no area
+    int noSamples = 0;          // Too small to cover any pixel center
+    int clipped = 0;            // Crossing a clipping plane, they go through ClipAndProject()
+    int rasterized = 0;         // After clipping, so it can be more than submitted
+    int pixelsShaded = 0;       // Pixels that passed the depth test, see Rasterizer::SetPixelCounting()
+    int blocksDecoded = 0;      // Misses of the decoded block cache, see QTexture::Compress()
+    int linesDrawn = 0;         // Edges of kWireframe draws with a facing tri, after clipping
+};
+
 class Rasterizer
 {
 public:
-    void Rasterize(uint32_t *pixels, float *zBuffer, int w, int h, const Model& model, const Mat44f& projMat, QRendererMode mode);
-    void Rasterize(uint32_t *pixels, float *zBuffer, QTexture *texture, int w, int h, const Model& model, const Mat44f& projMat, QRendererMode mode);
+    // @param modelViewMat Object space to camera space. It's fused with projMat so that verts go
+    // to clip space in one batched transform per draw.
+    // @param lod 0 draws the model's own tris, n draws model.lods[n - 1]
+    void Rasterize(uint32_t *pixels, float *zBuffer, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode, int lod = 0);
+    void Rasterize(uint32_t *pixels, float *zBuffer, QTexture *texture, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode, int lod = 0);
+
+    // @brief A draw whose texture the caller locks, e.g. once for several draws (instances, sorted
+    // command buffers). texture is nullptr for none. The surface colors are multiplied by tint.
+    // @note Rasterizers share no state, so several of them can draw at once from different threads
+    // as long as they draw to different buffers.
+    void RasterizeInstance(uint32_t *pixels, float *zBuffer, const QTexture *texture, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode, const Vec3f& tint, int lod = 0);
+
+    // @brief Depth-only draw, e.g. of a shadow caster to a ShadowMap. The pipeline is the same as a
+    // kZBuffer draw with the shading compiled out, so zBuffer ends up the same. It's always single
+    // sampled and opaque, and it isn't counted in the stats.
+    void RasterizeDepth(float *zBuffer, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat);
+
+    // @brief Move the lights to camera space once, every following Rasterize() call uses them
+    void SetLights(const std::vector<Light>& lights, const Mat44f& viewMat);
+    // @brief Used by every following Rasterize() call. The pixels covered are the same for all of
+    // them, kSpans may interpolate slightly differently.
+    void SetTraversal(RasterTraversal traversal);
+
+    // @brief Used by every following Rasterize() call, kBilinear by default
+    void SetTextureFilter(TextureFilter filter);
+
+    // @brief Count RasterStats::pixelsShaded, off by default since it costs a few % of fill rate
+    void SetPixelCounting(bool enable);
+
+    // @brief Multisample every following Rasterize() call into buffer, nullptr (the default) to
+    // sample pixel centers only. The depth test is then against the samples of buffer and zBuffer
+    // isn't used, the pixels only hold the color of the pixels that aren't on an edge until
+    // MultisampleBuffer::Resolve().
+    // @note kSpans walks pixel centers, multisampled draws use kBlocks instead. Lines (kWireframe)
+    // aren't multisampled.
+    void SetMultisampleBuffer(MultisampleBuffer *buffer);
+
+    // @brief Blend every following Rasterize() call into buffer with the given opacity (times the
+    // alpha of the texels), nullptr (the default) for opaque draws. Transparent draws are depth
+    // tested but don't write depth, so they're meant to be drawn after the opaque ones, in any order.
+    // When multisampled they're tested against the first sample and aren't anti-aliased.
+    // @note Lines (kWireframe) are always opaque.
+    void SetTransparency(TransparencyBuffer *buffer, float opacity = 1.0f);
+
+    // @brief Depth test the lines of every following kWireframe draw against the depth of the
+    // earlier draws, off by default so that wireframes are drawn over everything. Lines never write
+    // depth, and win ties with the tris they're the edges of.
+    void SetLineDepthTest(bool enable);
+
+    // @brief Shadows of the light that casts them (see Light::castsShadows) for every following
+    // Rasterize() call, nullptr (the default) for none. They're looked up per pixel, so only kPhong
+    // draws have them. The lights must be set with the view matrix that shadows was fitted to.
+    void SetShadowMap(const ShadowMap *shadows);
+
+    // @brief Object level test of the bounding sphere against the clipping planes, mvp goes from
+    // the space of bounds to clip space. Counted in the stats when it returns true.
+    bool IsOutsideFrustum(const Bounds& bounds, const Mat44f& mvp);
+
+    // @brief Occlusion culling, see OcclusionBuffer. IsOccluded() is counted in the stats when it
+    // returns true.
+    void ClearOccluders();
+    void RasterizeOccluder(const Model& model, const Mat44f& mvp);
+    bool IsOccluded(const Bounds& bounds, const Mat44f& mvp);
+
+    const RasterStats& GetStats() const;
+    void ResetStats();
+    // @brief Accumulate the counts of another rasterizer, e.g. a worker's
+    void AddStats(const RasterStats& stats);
     // @brief Gamma correct the color
     unsigned char DecodeGamma(int value);
 
-private:
+    // @note The kernels below are public so they can be benchmarked in isolation (see
+    // Test/BenchMain.cpp).
     float ComputeEdge(const Vec3f& a, const Vec3f& b, const Vec3f& c);
 
+    // @brief Bresenham line between 2 points in raster space, x, y, and 1/w in w like the verts of
+    // a tri. It's clipped to the w x h viewport first, so the endpoints can be anywhere. The pixels
+    // nearer than zBuffer are written, or all of them if zBuffer is nullptr.
+    // @note Mostly horizontal lines are written a span (row) at a time, 4 pixels per store with SSE.
+    void DrawLine(uint32_t *pixels, float *zBuffer, uint32_t color, int w, int h, const Vec4f& p0, const Vec4f& p1);
+
+    // @brief Nearest-neighbour fetch of a RGBA32 texel at uv, uv is in range [0, 1]
+    uint32_t SampleNearest(const uint32_t *texels, int texW, int texH, const Vec2f& uv);
+
+    // @brief Bilinear fetch of 4 RGBA32 texels at once, one per lane of a quad. Texel (x, y) is
+    // centered on uv (x / texW, y / texH) like in SampleNearest(), and the edges are clamped.
+    // @note SSE2 blends every channel of 2 lanes per register in 16 bit, the texels never leave the
+    // integer registers until they're stored back as RGBA32.
+    void SampleBilinear4(const uint32_t *texels, int texW, int texH, const Vec2f (&uvs)[4], uint32_t (&outTexels)[4]);
+
+    // @brief Clip in homogeneous clip space, a vert v is inside if Dot(plane, v) >= 0. The size of
+    // the return vector is:
+    // 0 triangle is clipped
+    // 1 triangle is inside, or 1 new triangle is created (1 pt is inside 2 pts are clipped)
+    // 2 2 triangles are created (2 pts are inside 1 pt is clipped)
+    // @note Winding order is kept.
+    std::vector<Triangle> ClipTriangleAgainstPlane(const Vec4f& plane, const Triangle& inTri);
+
+private:
+    // @brief Pipeline stages, see Rasterizer.cpp. A vertex stage fills the colors of each tri, a
+    // fragment stage writes each pixel that passes the depth test.
+    struct DrawContext;
+    struct UnlitVertex;
+    struct FlatVertex;
+    struct GouraudVertex;
+    struct PhongVertex;
+    struct DepthFragment;
+    struct DepthOnlyFragment;
+    struct ColorFragment;
+    struct TexturedFragment;
+    struct LitColorFragment;
+    struct LitTexturedFragment;
+
+    // @brief Write the shaded color of a pixel, to the samples in sampleMask when multisampled, or
+    // accumulate it at depth oneOverW when transparent
+    void WritePixel(uint32_t *pixels, int index, uint32_t color, int sampleMask, float oneOverW);
+
+    // @brief Texel (x, y) of a compressed mip level, through m_blockCache
+    uint32_t FetchBlockTexel(const uint8_t *blocks, TextureFormat format, int texW, int x, int y);
+
+    // @brief Pick the stages for mode once per draw
+    void Draw(const DrawContext& ctx, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode);
+
+    // @brief The whole pipeline, instantiated per pair of stages so that the inner loops don't
+    // branch on the mode
+    template<typename VertexStage, typename FragmentStage>
+    void DrawTris(const DrawContext& ctx, const Mat44f& modelViewMat, const Mat44f& projMat);
+
+    // @brief kWireframe, the unique edges (Model::edges) with a tri facing the camera are clipped
+    // and drawn once each. Models without edges draw the 3 edges of each facing tri.
+    void DrawEdges(const DrawContext& ctx, const Mat44f& modelViewMat, const Mat44f& projMat);
+
     // @note Remember that we use RGBA32 in memory
     uint32_t ToColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
     void ToComponent(uint32_t inColor, uint8_t& r, uint8_t& g, uint8_t& b, uint8_t& a);
     uint8_t ClampChannel(float channel);
 
-    void DrawLine(uint32_t* pixels, uint32_t color, int w, int x0, int x1, int y0, int y1);
-
     // @brief Draw 12 lines starting from center of screen, with each new line
     // as the previous rotated by 30deg
     // @param w, h is width * height = size of the pixel buffer
     void TestDrawLine(uint32_t *pixels, int scrW, int scrH);
 
-    // @brief The size of the return vector is:
-    // 0 triangle is clipped
-    // 3 triangle is inside, or 1 new triangle is created (1 pt is inside 2 pts are clipped)
-    // 6 2 triangles are created (2 pts are inside 1 pt is clipped)
-    std::vector<Triangle> ClipTriangleAgainstPlane(Vec3f planeN, Vec3f planePt, const Triangle& inTri);
+    // @brief Vertex stage. Every vert of the model goes to clip space with one fused
+    // model-view-projection matrix, then to raster space with a batched perspective divide.
+    // Also computes the outcode of each vert against the clipping planes.
+    // The camera space positions (and normals if needVertNormals) are kept for lighting.
+    void ProcessVerts(const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat,
+        const Mat44f& normalMat, bool needVertNormals, int w, int h);
 
-    Vec3f IntersectRayPlane(const Vec3f& p0, const Vec3f& p1, float planeD, const Vec3f& planeNormal, float *outT = nullptr);
+    // @brief Gouraud shading, lights every corner of every tri in batches of ShadeBatch::kSize.
+    // Corners are used rather than verts since a vert can have a different normal per tri.
+    void ShadeCorners(const DrawContext& ctx);
+
+    // @brief Phong shading defers the lighting of each pixel that passes the depth test, so that
+    // the light loop runs over ShadeBatch::kSize pixels at once.
+    void StagePhongPixel(uint32_t *pixels, int index, int sampleMask, float oneOverW, const Vec3f& base, uint8_t alpha, const Vec3f& pos, const Vec3f& normal);
+    void FlushPhongPixels(uint32_t *pixels);
+
+    // @brief Clip tri (in clip space) against the planes in clipMask, and append the survivors in
+    // raster space to outTris.
+    void ClipAndProject(const Triangle& tri, uint8_t clipMask, int w, int h, std::vector<Triangle>& outTris);
 
 private:
     // @note Maybe useful in the future but right now only necessary to clean up Clipping algorithm
     struct Point
     {
-        Vec3f pos;
+        Vec4f pos;
         Vec2f texCoord;
-        float wCoord;
         Vec3f color;
-        Point(Vec3f inPos, Vec2f inTexCoord, float inWCoord = 1.0f, Vec3f inColor = Vec3f(0.0f)) :
-            pos{std::move(inPos)}, texCoord{std::move(inTexCoord)}, wCoord{inWCoord}, color{std::move(inColor)} {}
+        Vec3f normal;
+        Vec3f viewPos;
+        Point() = default;
+        Point(Vec4f inPos, Vec2f inTexCoord, Vec3f inColor = Vec3f(0.0f)) :
+            pos{std::move(inPos)}, texCoord{std::move(inTexCoord)}, color{std::move(inColor)} {}
     };
 
+    LightBuffer m_lights;
+    RasterTraversal m_traversal = RasterTraversal::kAuto;
+    bool m_countPixels = false;
+    TextureFilter m_filter = TextureFilter::kBilinear;
+    MultisampleBuffer *m_msaa = nullptr;
+    TransparencyBuffer *m_oit = nullptr;
+    float m_opacity = 1.0f;
+    const ShadowMap *m_shadows = nullptr;
+    bool m_lineDepthTest = false;
+    RasterStats m_stats;
+    OcclusionBuffer m_occluders;
+
+    // @brief Decoded 4x4 blocks of compressed textures, direct mapped on the block coords so that
+    // an 8x8 tile of blocks (32x32 texels) fits. Every thread draws with its own Rasterizer, so the
+    // cache is per thread. It's cleared every draw since blocks are keyed by address.
+    struct DecodedBlock
+    {
+        const uint8_t *block = nullptr;
+        uint32_t texels[16];
+    };
+    static constexpr int kBlockCacheSize = 64;
+    DecodedBlock m_blockCache[kBlockCacheSize];
+
+    // @brief Per-draw scratch buffers, kept around so that they don't reallocate every draw
+    Math::SoAPositions m_objectPos;
+    Math::SoAPositions m_clipPos;
+    Math::SoAPositions m_rasterPos;
+    Math::SoAPositions m_viewPos;
+    Math::SoAPositions m_objectNormals;
+    Math::SoAPositions m_viewNormals;
+    std::vector<Vec3f> m_cornerLight;
+    std::vector<uint8_t> m_outcodes;
+    std::vector<uint8_t> m_triFacing;
+    std::vector<Triangle> m_clippedTris;
+    std::vector<Triangle> m_clipScratch;
+
+    // @brief Phong pixels waiting to be lit
+    ShadeBatch m_phongBatch;
+    int m_phongCnt = 0;
+    int m_phongPixels[ShadeBatch::kSize];
+    int m_phongSamples[ShadeBatch::kSize];
+    float m_phongDepth[ShadeBatch::kSize];
+    Vec3f m_phongBase[ShadeBatch::kSize];
+    uint8_t m_phongAlpha[ShadeBatch::kSize];
+
     // @brief Gamma decoded LUT with gamma = 2.2, 8-bit.
     // @see https://scantips.com/lights/gamma3.html
     const unsigned char g_gammaDecodedTable[256] = 
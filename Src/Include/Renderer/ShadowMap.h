@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+
+#include "Math/Matrix.h"
+#include "Math/Vector.h"
+
+// @brief How the shadow maps are sampled
+enum class ShadowFilter
+{
+    kHard,          // One depth test at the nearest texel
+    kPCF,           // Percentage closer filtering, the 3x3 texels around are tested and averaged
+};
+
+// @brief See QRenderer::SetShadows()
+struct ShadowSettings
+{
+    int resolution = 1024;          // Width and height of each cascade, in texels
+    int cascadeCount = 3;           // 1 to ShadowMap::kMaxCascades
+    float maxDistance = 20.0f;      // From the camera, further points are lit
+    ShadowFilter filter = ShadowFilter::kPCF;
+
+    // @brief The casters are only drawn again when a cascade moves, or after
+    // QRenderer::InvalidateShadows(). For static lights and casters.
+    bool isCached = false;
+};
+
+// @brief Cascaded shadow maps of a directional light. The view range of the camera is split into
+// cascades, the further ones cover more of the scene with the same resolution, so that their texels
+// are about the same size on screen. Each cascade is a depth-only draw of the casters from the
+// light, see Rasterizer::RasterizeDepth().
+// @note The depth of the rasterizer is 1/w, which an orthographic projection would leave constant.
+// So each cascade looks at the bounding sphere of its split from a distant point up the light
+// instead, through a narrow perspective that is almost parallel.
+// The spheres don't depend on where the camera looks, and their centers are snapped to a grid, so
+// a cascade only moves once the camera has moved far enough. Until then its depth can be cached.
+class ShadowMap
+{
+public:
+    static constexpr int kMaxCascades = 4;
+
+    void Init(const ShadowSettings& settings);
+    const ShadowSettings& GetSettings() const;
+
+    // @brief Fit the cascades to the camera. lightDir is the direction the light travels, in world
+    // space.
+    // @return Bit per cascade whose light matrices changed since the last Fit(), every cascade the
+    // first time
+    int Fit(const Vec3f& lightDir, const Mat44f& viewMat, const Mat44f& projMat);
+
+    // @brief Draw the casters of cascade c with world space * GetLightView(c) and GetLightProj(c),
+    // to GetDepth(c) of resolution x resolution
+    const Mat44f& GetLightView(int c) const;
+    const Mat44f& GetLightProj(int c) const;
+    float *GetDepth(int c);
+
+    // @brief Reset the depth of the cascades in cascadeMask to the furthest
+    void Clear(int cascadeMask);
+
+    // @brief How much of the light reaches a point in the camera space of the last Fit(), from 0 in
+    // shadow to 1 lit. The lookup is moved a texel along normal (camera space, not normalized)
+    // against shadow acne.
+    float Lookup(const Vec3f& viewPos, const Vec3f& normal) const;
+
+private:
+    struct Cascade
+    {
+        float splitFar;         // View depth where the cascade ends
+        Vec3f center;           // World space, snapped
+        float radius;
+        float texelSize;        // At the center, in world units
+        Mat44f lightView;
+        Mat44f lightProj;
+        Mat44f viewToLight;     // Camera space to the clip space of the light
+    };
+
+    ShadowSettings m_settings;
+    Vec3f m_lightDir;
+    bool m_isFitted = false;
+    Cascade m_cascades[kMaxCascades];
+
+    // @brief One resolution x resolution plane per cascade, 1/w like the z-buffer
+    std::vector<float> m_depth;
+};
@@ -1,8 +1,18 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
+#include "Renderer/BlockCompression.h"
 #include "SDL_Deleter.h"
 
 // @brief A wrapper that handles texture data, using SDL_Texture
@@ -10,18 +20,119 @@ class QTexture
 {
 public:
     void Init(const std::string& filePath, SDL_Renderer *renderer);
+
+    // @brief Init from RGBA32 texels already in memory. The texture isn't backed by an SDL_Texture,
+    // which is what the headless path (tests) needs.
+    void Init(int w, int h, std::vector<uint32_t> texels);
+
+    // @brief Decode an image file to RGBA32 texels. It needs no SDL_Renderer, so it can run on any
+    // thread.
+    // @return False if the file couldn't be loaded
+    static bool LoadImage(const std::string& filePath, int& outW, int& outH, std::vector<uint32_t>& outTexels);
+
+    // @brief Init from every mip level down to 1x1, packed back to back in format (see
+    // BlockCompression::GetImageSize()), e.g. from a mapped TextureCache file. The texels are used
+    // in place, storage keeps them alive.
+    void Init(int w, int h, TextureFormat format, std::shared_ptr<uint8_t> storage, uint8_t *levels);
+
+    // @note Locking counts as a use, see GetLastUse()
     void LockTexture();
     void UnlockTexture();
 
+    // @brief Re-encode every mip level in a block format, and free the RGBA32 texels (the
+    // SDL_Texture too). Compressed textures are always resident, locking them does nothing.
+    // @note Lossy, and alpha is dropped by kBC1
+    void Compress(TextureFormat format);
+    TextureFormat GetFormat() const;
+
+    // @brief Memory used by the texels of every mip level
+    size_t GetByteSize() const;
+
+    // @brief Free level 0, level 1 becomes the texture. It's sampled at a lower resolution from then
+    // on, the level can only come back by loading the texture again.
+    // @return False if there's only 1 level left
+    // @note The texture must not be locked, nor be drawn by another thread
+    bool DropTopMip();
+
+    // @brief Stamp of the last LockTexture() or Touch(), higher is more recent. The stamps are
+    // shared by every texture.
+    uint64_t GetLastUse() const;
+    void Touch();
+
     int GetW() const;
     int GetH() const;
     int GetPitch() const;
+    // @note nullptr once compressed
     const uint32_t *GetTexels() const;
 
+    // @brief Level 0 is the texture itself and is only valid while locked, the smaller levels
+    // (each half the size of the previous one, down to 1x1) are always resident.
+    // Compressed levels have blocks instead of texels, see BlockCompression::EncodeImage().
+    struct MipLevel
+    {
+        const uint32_t *texels;
+        int w, h;
+        const uint8_t *blocks = nullptr;
+    };
+    int GetMipCount() const;
+    MipLevel GetMip(int level) const;
+
+private:
+    // @brief Box filter texels down to 1x1, called once at Init()
+    void BuildMips(const uint32_t *texels);
+
+    // @brief Free the texels of every level, whatever holds them
+    void ReleaseStorage();
+
+    // @brief Point level 0 and m_mips into levels, packed like Init(w, h, format, storage, levels)
+    void UsePackedLevels(uint8_t *levels);
+
 private:
     std::unique_ptr<SDL_Texture, SDL_Deleter> m_texture;
     int m_w, m_h, m_pitch;
-    uint32_t *m_texels;
+    uint32_t *m_texels = nullptr;
+
+    // @brief Level 0 when there's no SDL_Texture, in m_cpuTexels or the packed levels
+    uint32_t *m_baseTexels = nullptr;
+
+    // @brief Only used when there's no SDL_Texture
+    std::vector<uint32_t> m_cpuTexels;
+
+    // @brief Every level from 1 packed back to back, m_mips[i] is level i + 1
+    std::vector<uint32_t> m_mipTexels;
+    std::vector<MipLevel> m_mips;
+
+    // @brief Every level from 0 packed back to back once compressed or once a mip is dropped, in
+    // m_packed. m_storage holds them instead when they come from elsewhere, e.g. a mapped file.
+    TextureFormat m_format = TextureFormat::kRGBA32;
+    std::vector<uint8_t> m_packed;
+    std::shared_ptr<uint8_t> m_storage;
+    const uint8_t *m_baseBlocks = nullptr;
+
+    // @brief Atomic since the manager reads it from the loader threads
+    std::atomic<uint64_t> m_lastUse{0};
+};
+
+// @brief A texture that may still be loading, see TextureManager::LoadAsync(). Handles are cheap
+// to copy, and every copy sees the texture once it's loaded.
+class TextureHandle
+{
+public:
+    // @brief False for a default constructed handle, e.g. for an untextured model
+    bool IsValid() const;
+    bool IsReady() const;
+
+    // @brief Block until the load is done, e.g. before a screenshot
+    void Wait() const;
+
+    // @return The texture once loaded. The placeholder until then, and for good if the load failed.
+    // nullptr if the handle isn't valid.
+    std::shared_ptr<QTexture> Get() const;
+
+private:
+    friend class TextureManager;
+    std::shared_future<std::shared_ptr<QTexture>> m_future;
+    std::shared_ptr<QTexture> m_placeholder;
 };
 
 // @details A resource manager that manages shareable and reusable textures. Responsibilities:
@@ -41,17 +152,95 @@ public:
     TextureManager(const TextureManager&) = delete;
     TextureManager& operator=(const TextureManager&) = delete;
     static TextureManager& Instance();
+    ~TextureManager();
     
-    std::shared_ptr<QTexture> Load(const std::string& filePath, SDL_Renderer *renderer);
+    // @param format The texture is compressed to it when it's first loaded, a texture that's already
+    // loaded is shared as is
+    // @note Waits for the texture if it's loading asynchronously
+    std::shared_ptr<QTexture> Load(const std::string& filePath, SDL_Renderer *renderer, TextureFormat format = TextureFormat::kRGBA32);
     void Unload(const std::string& filePath);
 
     // @brief We can manually calls UnloadAll() to reuse again.
     void UnloadAll();
 
+    // @brief Decode filePath on the loader threads, and return at once. Loads of a path that's
+    // already loading share its handle. The texture isn't backed by an SDL_Texture, see
+    // QTexture::Init(w, h, texels).
+    // @param format See Load()
+    TextureHandle LoadAsync(const std::string& filePath, TextureFormat format = TextureFormat::kRGBA32);
+
+    // @brief Block until every queued load is done, e.g. at the end of a loading screen. Unlike
+    // TextureHandle::Wait(), the loaders have let go of the textures by then.
+    void WaitForLoads();
+
+    // @brief 1x1 white, drawn in place of textures that aren't loaded yet so that the surface
+    // colors show through
+    std::shared_ptr<QTexture> GetPlaceholder();
+
+    // @brief Number of loader threads. 0 (the default) picks one less than the hardware threads.
+    // Only the first LoadAsync() call starts them, later calls to this have no effect.
+    void SetLoaderThreads(int count);
+
+    // @brief Let LoadAsync() go through a TextureCache file next to each image, off by default. A
+    // hit maps the decoded and compressed levels instead of decoding the image, a miss writes the
+    // file for the next run.
+    void SetDiskCache(bool enable);
+
+    // @brief Bytes of texels to keep loaded, 0 (the default) for no limit. Every load evicts the
+    // least recently used textures nobody else references until the total fits, see Trim() for
+    // the textures still in use.
+    void SetMemoryBudget(size_t bytes);
+
+    // @brief Let Trim() drop the largest mip levels of textures still in use, off by default
+    void SetMipEviction(bool enable);
+
+    // @brief Evict unreferenced textures like a load does. If it's still over budget and mip
+    // eviction is on, drop the top level of the least recently used textures, one level at a time,
+    // until it fits.
+    // @note Call it from the render thread between frames, a texture must not be drawn while its
+    // mips are dropped
+    void Trim();
+
+    // @brief Memory accounting of every loaded texture, see QTexture::GetByteSize()
+    struct TextureUsage
+    {
+        std::string filePath;
+        size_t bytes;
+        int w, h;
+        long refCount;          // Outside of the manager, 0 if it can be evicted
+        uint64_t lastUse;       // See QTexture::GetLastUse()
+    };
+    std::vector<TextureUsage> GetUsage();
+    size_t GetResidentBytes();
+
 private:
     TextureManager() = default;
 
+    // @brief Run the queued loads until the manager is destroyed
+    void LoaderLoop();
+
+    // @note These expect m_mutex to be held
+    size_t CountResidentBytes() const;
+    void EvictUnreferenced();
+    void DropMips();
+
 private:
+    // @brief Guards everything below, the loader threads touch loadedTexs and pendingTexs too
+    std::mutex m_mutex;
     std::unordered_map<std::string, std::shared_ptr<QTexture>> loadedTexs;
+    std::unordered_map<std::string, TextureHandle> pendingTexs;
+    std::shared_ptr<QTexture> m_placeholder;
+
+    std::deque<std::function<void()>> m_loads;
+    std::condition_variable m_loadQueued;
+    std::condition_variable m_loadsDone;
+    int m_busyLoaders = 0;
+    std::vector<std::thread> m_loaders;
+    int m_loaderThreads = 0;
+    bool m_stopping = false;
+    bool m_diskCache = false;
+
+    size_t m_budget = 0;
+    bool m_mipEviction = false;
 };
 
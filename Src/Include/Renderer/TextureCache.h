@@ -0,0 +1,29 @@
+#pragma once
+#include <memory>
+#include <string>
+
+#include "Renderer/BlockCompression.h"
+
+// Forward declarations
+class QTexture;
+
+// @brief Disk cache of decoded textures, with every mip level in their final format, so that the
+// image decoding, the mip generation and the compression only run once per source file. Loading a
+// cache file maps it, the texture samples the mapped pages in place and nothing is copied until it's
+// written to. A cache file is only valid for the source file it was built from (same size and
+// modification time) and the format it was built in.
+// @note Native byte order, the files aren't meant to be shared across machines
+namespace TextureCache
+{
+    // @return False if the file couldn't be written
+    bool Save(const std::string& cachePath, QTexture& texture, const std::string& sourcePath);
+
+    // @return False if the file is missing, corrupt, from another version of the format, or out of
+    // date with sourcePath or format. outTexture is left untouched then.
+    bool Load(const std::string& cachePath, const std::string& sourcePath, TextureFormat format, QTexture& outTexture);
+
+    // @brief Load an image through its cache, next to it as imagePath + ".qtex". On a miss the image
+    // is decoded, compressed to format, and the cache written for the next run.
+    // @return nullptr if the image couldn't be loaded
+    std::shared_ptr<QTexture> LoadImage(const std::string& imagePath, TextureFormat format = TextureFormat::kRGBA32);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Math/Vector.h"
+
+// @brief Weighted blended order-independent transparency (McGuire and Bavoil 2013). Transparent
+// fragments aren't blended one over the other in draw order, they're summed into 2 buffers:
+// - accumulation, the colors premultiplied by their alpha and a weight that falls off with depth,
+// and the sum of the weighted alphas
+// - revealage, the product of (1 - alpha), how much of the opaque pixel behind still shows
+// Resolve() then composites the weighted average color over the opaque pixels in one pass. Sums and
+// products don't depend on the order, so transparent draws need no sorting, and buffers filled on
+// different threads could be merged by adding (and multiplying) them.
+// @note Exact for a single layer, and for layers of the same color. Otherwise the nearer layers
+// only dominate through the weight, which is the approximation of the technique.
+class TransparencyBuffer
+{
+public:
+    void Init(int w, int h);
+
+    // @brief Nothing accumulated, every pixel is fully revealed
+    void Clear();
+
+    // @brief Add a fragment of pixel i. The alpha of color (RGBA32) is multiplied by opacity.
+    // @param oneOverW Depth of the fragment, 1/w like the z-buffer
+    void Accumulate(int i, uint32_t color, float opacity, float oneOverW);
+
+    // @brief Composite the average transparent color of each pixel over pixels, and clear what was
+    // accumulated. Pixels with no transparent fragment are left as they are.
+    void Resolve(uint32_t *pixels);
+
+private:
+    int m_pixelCnt = 0;
+    std::vector<Vec4f> m_accum;
+    std::vector<float> m_revealage;
+};
+
+inline void TransparencyBuffer::Accumulate(int i, uint32_t color, float opacity, float oneOverW)
+{
+    const float alpha = (float)(color >> 24) * (1.0f / 255.0f) * opacity;
+    if (!(alpha > 0.0f))
+        return;
+
+    // Eq. 10 of the paper, view depth z is 1/oneOverW
+    const float z = 1.0f / oneOverW;
+    const float z5 = z * (1.0f / 5.0f);
+    const float z200 = z * (1.0f / 200.0f);
+    const float z200Cube = z200 * z200 * z200;
+    const float weight = alpha * std::max(1e-2f, std::min(3e3f, 10.0f / (1e-5f + z5 * z5 + z200Cube * z200Cube)));
+
+    const float scale = weight * (1.0f / 255.0f);
+    Vec4f& accum = m_accum[i];
+    accum.r += (float)(color & 0xff) * scale;
+    accum.g += (float)((color >> 8) & 0xff) * scale;
+    accum.b += (float)((color >> 16) & 0xff) * scale;
+    accum.a += weight;
+    m_revealage[i] *= 1.0f - alpha;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <string>
+
+namespace Helper
+{
+    // @brief Size and modification time of a source file, the disk caches keep them to know when
+    // they're out of date with it
+    // @return False if the file can't be found
+    inline bool StatSource(const std::string& sourcePath, uint64_t& outSize, int64_t& outTime)
+    {
+        struct stat st;
+        if (stat(sourcePath.c_str(), &st) != 0)
+            return false;
+        outSize = (uint64_t)st.st_size;
+        outTime = (int64_t)st.st_mtime;
+        return true;
+    }
+}
@@ -4,8 +4,8 @@
 
 #include "Math/Matrix.h"
 #include "QApp.h"
+#include "Renderer/MeshCache.h"
 #include "Renderer/Model.h"
-#include "Renderer/OBJLoader.h"
 
 void RunTest(QApp& app);
 void RunExample(QApp& app);
@@ -24,20 +24,22 @@ int main(int argc, char **argv)
 
 }
 
+// @note The meshes are loaded through MeshCache, so their lods are only built on the first run
 void RunExample(QApp& app)
 {
     {
-        Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+        Model suzanne{MeshCache::LoadOBJ("Assets/suzanne.obj")};
         app.LoadModel(suzanne);
         app.LoadTexture("Assets/bricks2.jpg");
     }
 
 #if 0
     {
-        Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+        Model plane{MeshCache::LoadOBJ("Assets/plane.obj")};
         Mat44f transMat = Math::InitTranslation(0.0f, -1.5f, 0.0f);
         for (int i = 0; i < plane.verts.size(); ++i)
             plane.verts[i] = Math::MultiplyVecMat(plane.verts[i], transMat);
+        plane.BuildClusters();
         app.LoadModel(plane);
         app.LoadTexture("Assets/wood.jpg");
     }
@@ -45,7 +47,7 @@ void RunExample(QApp& app)
 
 #if 0
     {
-        Model cube{OBJ::LoadFileData("Assets/cube.obj")};
+        Model cube{MeshCache::LoadOBJ("Assets/cube.obj")};
         app.LoadModel(cube);
         app.LoadTexture("Assets/bricks.jpg");
     }
@@ -83,6 +85,7 @@ void RunTest(QApp& app)
         Mat44f transMat = Math::InitTranslation(1.5f, 1.0f, 0.0f);
         for (int i = 0; i < topRightTri.verts.size(); ++i)
             topRightTri.verts[i] = Math::MultiplyVecMat(topRightTri.verts[i], transMat);
+        topRightTri.BuildClusters();
         app.LoadModel(topRightTri);
     }
 #endif
@@ -107,6 +110,7 @@ void RunTest(QApp& app)
         Mat44f transMat = Math::InitTranslation(1.5f, 1.0f, 0.0f);
         for (int i = 0; i < tri.verts.size(); ++i)
             tri.verts[i] = Math::MultiplyVecMat(tri.verts[i], transMat);
+        tri.BuildClusters();
         app.LoadModel(tri);
     }
 
@@ -140,6 +144,7 @@ void RunTest(QApp& app)
         Mat44f transMat = Math::InitTranslation(-1.5f, -2.0f, 0.0f);
         for (int i = 0; i < quad.verts.size(); ++i)
             quad.verts[i] = Math::MultiplyVecMat(quad.verts[i], transMat);
+        quad.BuildClusters();
         app.LoadModel(quad);
         app.LoadTexture("Assets/checkerboard.jpg");
     }
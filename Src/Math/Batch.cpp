@@ -0,0 +1,187 @@
+#include <algorithm>
+
+#include "Math/Batch.h"
+#include "Math/SIMD.h"
+
+namespace Math
+{
+    void SoAPositions::Resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        w.resize(count);
+    }
+
+    void ToSoA(const std::vector<Vec3f>& verts, SoAPositions& out)
+    {
+        out.Resize(verts.size());
+        for (size_t i = 0; i < verts.size(); ++i)
+        {
+            out.x[i] = verts[i].x;
+            out.y[i] = verts[i].y;
+            out.z[i] = verts[i].z;
+            out.w[i] = 1.0f;
+        }
+    }
+
+    void TransformPositions(const SoAPositions& in, const Mat44f& m, SoAPositions& out)
+    {
+        const size_t count = in.Size();
+        out.Resize(count);
+        const float *inX = in.x.data(), *inY = in.y.data(), *inZ = in.z.data();
+        float *outX = out.x.data(), *outY = out.y.data(), *outZ = out.z.data(), *outW = out.w.data();
+        float *outs[4] = {outX, outY, outZ, outW};
+
+        size_t i = 0;
+#if defined(QR_SIMD_AVX)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 vx = _mm256_loadu_ps(inX + i);
+            __m256 vy = _mm256_loadu_ps(inY + i);
+            __m256 vz = _mm256_loadu_ps(inZ + i);
+            for (int j = 0; j < 4; ++j)
+            {
+                __m256 r = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(vx, _mm256_set1_ps(m(0, j))), _mm256_mul_ps(vy, _mm256_set1_ps(m(1, j)))),
+                    _mm256_add_ps(_mm256_mul_ps(vz, _mm256_set1_ps(m(2, j))), _mm256_set1_ps(m(3, j))));
+                _mm256_storeu_ps(outs[j] + i, r);
+            }
+        }
+#endif
+#if defined(QR_SIMD_SSE)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 vx = _mm_loadu_ps(inX + i);
+            __m128 vy = _mm_loadu_ps(inY + i);
+            __m128 vz = _mm_loadu_ps(inZ + i);
+            for (int j = 0; j < 4; ++j)
+            {
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(m(0, j))), _mm_mul_ps(vy, _mm_set1_ps(m(1, j)))),
+                    _mm_add_ps(_mm_mul_ps(vz, _mm_set1_ps(m(2, j))), _mm_set1_ps(m(3, j))));
+                _mm_storeu_ps(outs[j] + i, r);
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+                outs[j][i] = (inX[i] * m(0, j) + inY[i] * m(1, j)) + (inZ[i] * m(2, j) + m(3, j));
+        }
+    }
+
+    void TransformDirections(const SoAPositions& in, const Mat44f& m, SoAPositions& out)
+    {
+        const size_t count = in.Size();
+        out.Resize(count);
+        const float *inX = in.x.data(), *inY = in.y.data(), *inZ = in.z.data();
+        float *outs[3] = {out.x.data(), out.y.data(), out.z.data()};
+        std::fill(out.w.begin(), out.w.end(), 0.0f);
+
+        size_t i = 0;
+#if defined(QR_SIMD_AVX)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 vx = _mm256_loadu_ps(inX + i);
+            __m256 vy = _mm256_loadu_ps(inY + i);
+            __m256 vz = _mm256_loadu_ps(inZ + i);
+            for (int j = 0; j < 3; ++j)
+            {
+                __m256 r = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(vx, _mm256_set1_ps(m(0, j))), _mm256_mul_ps(vy, _mm256_set1_ps(m(1, j)))),
+                    _mm256_mul_ps(vz, _mm256_set1_ps(m(2, j))));
+                _mm256_storeu_ps(outs[j] + i, r);
+            }
+        }
+#endif
+#if defined(QR_SIMD_SSE)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 vx = _mm_loadu_ps(inX + i);
+            __m128 vy = _mm_loadu_ps(inY + i);
+            __m128 vz = _mm_loadu_ps(inZ + i);
+            for (int j = 0; j < 3; ++j)
+            {
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(m(0, j))), _mm_mul_ps(vy, _mm_set1_ps(m(1, j)))),
+                    _mm_mul_ps(vz, _mm_set1_ps(m(2, j))));
+                _mm_storeu_ps(outs[j] + i, r);
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                outs[j][i] = (inX[i] * m(0, j) + inY[i] * m(1, j)) + inZ[i] * m(2, j);
+        }
+    }
+
+    void PerspectiveDivide(SoAPositions& p)
+    {
+        const size_t count = p.Size();
+        float *px = p.x.data(), *py = p.y.data(), *pz = p.z.data(), *pw = p.w.data();
+
+        size_t i = 0;
+#if defined(QR_SIMD_AVX)
+        for (; i + 8 <= count; i += 8)
+        {
+            // @note Full precision divide rather than _mm256_rcp_ps, so results match the scalar path
+            __m256 oneOverW = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(pw + i));
+            _mm256_storeu_ps(px + i, _mm256_mul_ps(_mm256_loadu_ps(px + i), oneOverW));
+            _mm256_storeu_ps(py + i, _mm256_mul_ps(_mm256_loadu_ps(py + i), oneOverW));
+            _mm256_storeu_ps(pz + i, _mm256_mul_ps(_mm256_loadu_ps(pz + i), oneOverW));
+            _mm256_storeu_ps(pw + i, oneOverW);
+        }
+#endif
+#if defined(QR_SIMD_SSE)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 oneOverW = _mm_div_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(pw + i));
+            _mm_storeu_ps(px + i, _mm_mul_ps(_mm_loadu_ps(px + i), oneOverW));
+            _mm_storeu_ps(py + i, _mm_mul_ps(_mm_loadu_ps(py + i), oneOverW));
+            _mm_storeu_ps(pz + i, _mm_mul_ps(_mm_loadu_ps(pz + i), oneOverW));
+            _mm_storeu_ps(pw + i, oneOverW);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            float oneOverW = 1.0f / pw[i];
+            px[i] *= oneOverW;
+            py[i] *= oneOverW;
+            pz[i] *= oneOverW;
+            pw[i] = oneOverW;
+        }
+    }
+
+    void ViewportTransform(SoAPositions& p, int w, int h)
+    {
+        const size_t count = p.Size();
+        float *px = p.x.data(), *py = p.y.data();
+        const float halfW = w / 2.0f;
+        const float halfH = h / 2.0f;
+
+        size_t i = 0;
+#if defined(QR_SIMD_AVX)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 one = _mm256_set1_ps(1.0f);
+            _mm256_storeu_ps(px + i, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(px + i), one), _mm256_set1_ps(halfW)));
+            _mm256_storeu_ps(py + i, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(py + i), one), _mm256_set1_ps(halfH)));
+        }
+#endif
+#if defined(QR_SIMD_SSE)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 one = _mm_set1_ps(1.0f);
+            _mm_storeu_ps(px + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(px + i), one), _mm_set1_ps(halfW)));
+            _mm_storeu_ps(py + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(py + i), one), _mm_set1_ps(halfH)));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            px[i] = (px[i] + 1.0f) * halfW;
+            py[i] = (py[i] + 1.0f) * halfH;
+        }
+    }
+}
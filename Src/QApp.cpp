@@ -47,19 +47,22 @@ bool QApp::Init(std::string title, int w, int h)
     m_qrenderer = std::make_unique<QRenderer>();
     if (!m_qrenderer->Init(m_window.get(), m_w, m_h)) { return false; }
 
+    // Later runs map the decoded textures instead of decoding the images again
+    TextureManager::Instance().SetDiskCache(true);
+
     return true;
 }
 
 void QApp::LoadModel(Model model)
 {
     m_models.push_back(std::move(model));
+    m_modelTextures.push_back(TextureHandle{});
 }
 
 void QApp::LoadTexture(const std::string& textureFilePath)
 {
     assert(!m_models.empty() && "Load model first.");
-    m_textures.push_back(TextureManager::Instance().Load(textureFilePath, m_qrenderer->GetRenderer()));
-    m_modelToTextureIndex.insert(std::make_pair((int)m_models.size() - 1, (int)m_textures.size() - 1));
+    m_modelTextures.back() = TextureManager::Instance().LoadAsync(textureFilePath);
 }
 
 void QApp::SetDrawMode(QRendererMode drawMode)
@@ -85,8 +88,14 @@ void QApp::Start()
     bool isRunning = true;
     float rotAmount = 0;
     float yaw = 0.0f;   // Amount of rotation in lookDir
+    int samples = 1;    // Per pixel, M cycles through 1, 2, 4 and 8
+    bool isMonkeyTransparent = false;   // T toggles it
+    bool areShadowsOn = false;          // H toggles them
     constexpr float pi = 3.141592653589f;
     m_qrenderer->SetProjectionMatrix(Math::InitPersp(pi / 2.0f, (float)m_w / m_h, 0.5f, 100.0f));
+    Light sun;
+    sun.castsShadows = true;
+    m_qrenderer->SetLights({sun});
     while (isRunning)
     {
         uint64_t endCounts = SDL_GetPerformanceCounter();
@@ -107,6 +116,18 @@ void QApp::Start()
             {
                 if (e.key.keysym.sym == SDLK_p)
                     m_isPaused = !m_isPaused;
+                if (e.key.keysym.sym == SDLK_m)
+                {
+                    samples = (samples == 8) ? 1 : samples * 2;
+                    m_qrenderer->SetMultisampling(samples);
+                }
+                if (e.key.keysym.sym == SDLK_t)
+                    isMonkeyTransparent = !isMonkeyTransparent;
+                if (e.key.keysym.sym == SDLK_h)
+                {
+                    areShadowsOn = !areShadowsOn;
+                    m_qrenderer->SetShadows(areShadowsOn);
+                }
             }
             }
         }
@@ -154,48 +175,45 @@ void QApp::Start()
         at += eye;
         Mat44f viewMat = m_qrenderer->LookAt(eye, at);
 
-        std::vector<Model> changedModels = m_models;
+        m_qrenderer->SetViewMatrix(viewMat);
+
         rotAmount += 0.45f * dt;
         Mat44f rotMonkeyMat = Math::InitRotation(0, 0.0f, rotAmount);
         Mat44f rotCubeMat = Math::InitRotation(-rotAmount, rotAmount, 0.0f);
         Mat44f moveMonkeyMat = Math::InitTranslation(1.5f, 0.0f, 0.0f);
         Mat44f moveCubeMat = Math::InitTranslation(-1.5f, 0.0f, 0.0f);
-        for (int modelIndex = 0; modelIndex < changedModels.size(); ++modelIndex)
+
+        // Rendering, recorded first then executed sorted by the renderer
+        m_commands.Clear();
+        for (int i = 0; i < m_models.size(); ++i)
         {
-            for (int vertIndex = 0; vertIndex < changedModels[modelIndex].verts.size(); ++vertIndex)
+            // Move monkey to right, cube to left. The verts are transformed by the rasterizer, so
+            // the models aren't copied every frame.
+            Mat44f modelMat;
+            if (i == 0)
+                modelMat = rotMonkeyMat;
+            if (i == 2)
+                modelMat = rotCubeMat * moveCubeMat;
+
+            // If there's a texture, draw with texture, else draw with color
+            if (i == 0 && isMonkeyTransparent)
             {
-                // Move monkey to right, cube to left
-                if (modelIndex == 0)
-                {
-                    changedModels[modelIndex].verts[vertIndex] =
-                        Math::MultiplyVecMat(changedModels[modelIndex].verts[vertIndex], rotMonkeyMat);
-                }
-                if (modelIndex == 2)
-                {
-                    changedModels[modelIndex].verts[vertIndex] =
-                        Math::MultiplyVecMat(changedModels[modelIndex].verts[vertIndex], rotCubeMat * moveCubeMat);
-                }
-                
-                changedModels[modelIndex].verts[vertIndex] =
-                    Math::MultiplyVecMat(changedModels[modelIndex].verts[vertIndex], viewMat);
+                if (m_modelTextures[i].IsValid())
+                    m_commands.DrawTransparent(m_models[i], modelMat, m_modelTextures[i].Get(), 0.5f, m_drawMode);
+                else
+                    m_commands.DrawTransparent(m_models[i], modelMat, 0.5f, m_drawMode);
             }
-
-        }
-
-        
-        // Rendering
-        for (int i = 0; i < changedModels.size(); ++i)
-        {
-            auto it = m_modelToTextureIndex.find(i);
-            // If found texture, draw with texture, else draw with color
-            if (it != m_modelToTextureIndex.end())
-                m_qrenderer->Render(changedModels[i], m_textures[it->second], m_drawMode);
+            else if (m_modelTextures[i].IsValid())
+                m_commands.Draw(m_models[i], modelMat, m_modelTextures[i].Get(), m_drawMode);
             else
-                m_qrenderer->Render(changedModels[i], m_drawMode);
-
+                m_commands.Draw(m_models[i], modelMat, m_drawMode);
         }
+        m_qrenderer->Execute(m_commands);
 
         m_qrenderer->SwapBuffers();
+
+        // Between frames, so no texture is being drawn. It does nothing unless a budget is set.
+        TextureManager::Instance().Trim();
         
 
         // Frame statistics every 2s
@@ -226,6 +244,17 @@ void QApp::ShowFrameStatistics(int frameCnt, float dt)
         << std::setprecision(1) << dt << " s: "
         << std::setprecision(2) << frameCnt / dt << " fps, "
         << std::setprecision(3) << (dt * 1000.0) / frameCnt << " ms/frame";
+
+    // Tri counts per frame
+    const RasterStats& stats = m_qrenderer->GetStats();
+    ss << " - tris: " << stats.rasterized / frameCnt << " drawn, "
+        << stats.backFacing / frameCnt << " back facing, "
+        << stats.noSamples / frameCnt << " too small, "
+        << stats.outsideFrustum / frameCnt << " off screen"
+        << " - culled: " << stats.clustersCulled / frameCnt << " clusters, "
+        << stats.modelsCulled / frameCnt << " models, "
+        << stats.modelsOccluded / frameCnt << " occluded";
+    m_qrenderer->ResetStats();
     const std::string& tmp = ss.str();
     
     SDL_SetWindowTitle(m_window.get(), tmp.c_str());
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+#include "Renderer/BlockCompression.h"
+
+namespace
+{
+    uint32_t Channel(uint32_t texel, int shift) { return (texel >> shift) & 0xff; }
+
+    uint16_t ToRGB565(uint32_t texel)
+    {
+        uint32_t r = (Channel(texel, 0) * 31 + 127) / 255;
+        uint32_t g = (Channel(texel, 8) * 63 + 127) / 255;
+        uint32_t b = (Channel(texel, 16) * 31 + 127) / 255;
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    // @brief Opaque RGBA32, the low bits are filled with the high ones so that 0 and 255 are exact
+    uint32_t FromRGB565(uint16_t color)
+    {
+        uint32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        return 0xff000000u | (b << 16) | (g << 8) | r;
+    }
+
+    // @brief (a * wa + b * wb) / (wa + wb) per channel, rounded
+    uint32_t Mix(uint32_t a, uint32_t b, uint32_t wa, uint32_t wb)
+    {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+            result |= ((Channel(a, shift) * wa + Channel(b, shift) * wb + (wa + wb) / 2) / (wa + wb)) << shift;
+        return result;
+    }
+
+    // @brief The 4 colors a BC1 block can pick from. 3-color mode (c0 <= c1) is only chosen by BC1
+    // blocks, BC3 color blocks always use 4 colors.
+    void ColorPalette(uint16_t c0, uint16_t c1, bool allowThreeColor, uint32_t (&outPalette)[4])
+    {
+        outPalette[0] = FromRGB565(c0);
+        outPalette[1] = FromRGB565(c1);
+        if (c0 > c1 || !allowThreeColor)
+        {
+            outPalette[2] = Mix(outPalette[0], outPalette[1], 2, 1);
+            outPalette[3] = Mix(outPalette[0], outPalette[1], 1, 2);
+        }
+        else
+        {
+            outPalette[2] = Mix(outPalette[0], outPalette[1], 1, 1);
+            outPalette[3] = 0;
+        }
+    }
+
+    void AlphaPalette(uint8_t a0, uint8_t a1, uint8_t (&outPalette)[8])
+    {
+        outPalette[0] = a0;
+        outPalette[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 1; i < 7; ++i)
+                outPalette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1 + 3) / 7);
+        }
+        else
+        {
+            for (int i = 1; i < 5; ++i)
+                outPalette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1 + 2) / 5);
+            outPalette[6] = 0;
+            outPalette[7] = 255;
+        }
+    }
+
+    int SquaredDistance(uint32_t a, uint32_t b)
+    {
+        int sum = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int d = (int)Channel(a, shift) - (int)Channel(b, shift);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    // @brief The texels at both ends of the principal axis of the colors, found by power iteration
+    // on their covariance
+    void FindEndpoints(const uint32_t (&texels)[16], uint32_t& outMax, uint32_t& outMin)
+    {
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (uint32_t texel : texels)
+        {
+            for (int c = 0; c < 3; ++c)
+                mean[c] += (float)Channel(texel, c * 8) / 16.0f;
+        }
+
+        float cov[3][3] = {};
+        for (uint32_t texel : texels)
+        {
+            float d[3];
+            for (int c = 0; c < 3; ++c)
+                d[c] = (float)Channel(texel, c * 8) - mean[c];
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < 3; ++j)
+                    cov[i][j] += d[i] * d[j];
+            }
+        }
+
+        // Start from the diagonal of the bounding box, it's close to the axis most of the time
+        float axis[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            uint32_t lo = 255, hi = 0;
+            for (uint32_t texel : texels)
+            {
+                lo = std::min(lo, Channel(texel, c * 8));
+                hi = std::max(hi, Channel(texel, c * 8));
+            }
+            axis[c] = (float)(hi - lo);
+        }
+        for (int iter = 0; iter < 8; ++iter)
+        {
+            float next[3];
+            for (int i = 0; i < 3; ++i)
+                next[i] = cov[i][0] * axis[0] + cov[i][1] * axis[1] + cov[i][2] * axis[2];
+            float norm = std::max(std::abs(next[0]), std::max(std::abs(next[1]), std::abs(next[2])));
+            if (!(norm > 0.0f))
+                break;
+            for (int i = 0; i < 3; ++i)
+                axis[i] = next[i] / norm;
+        }
+
+        float minDot = 0.0f, maxDot = 0.0f;
+        outMax = outMin = texels[0];
+        for (int i = 0; i < 16; ++i)
+        {
+            float dot = 0.0f;
+            for (int c = 0; c < 3; ++c)
+                dot += (float)Channel(texels[i], c * 8) * axis[c];
+            if (i == 0 || dot > maxDot)
+            {
+                maxDot = dot;
+                outMax = texels[i];
+            }
+            if (i == 0 || dot < minDot)
+            {
+                minDot = dot;
+                outMin = texels[i];
+            }
+        }
+    }
+
+    void EncodeColor(const uint32_t (&texels)[16], uint8_t *outBlock)
+    {
+        uint32_t hi, lo;
+        FindEndpoints(texels, hi, lo);
+        uint16_t c0 = ToRGB565(hi), c1 = ToRGB565(lo);
+
+        // c0 > c1 selects the 4-color mode in BC1, and a single color only needs index 0
+        if (c0 < c1)
+            std::swap(c0, c1);
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            uint32_t palette[4];
+            ColorPalette(c0, c1, true, palette);
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0;
+                int bestDistance = SquaredDistance(texels[i], palette[0]);
+                for (int k = 1; k < 4; ++k)
+                {
+                    int distance = SquaredDistance(texels[i], palette[k]);
+                    if (distance < bestDistance)
+                    {
+                        best = k;
+                        bestDistance = distance;
+                    }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+
+        outBlock[0] = (uint8_t)(c0 & 0xff);
+        outBlock[1] = (uint8_t)(c0 >> 8);
+        outBlock[2] = (uint8_t)(c1 & 0xff);
+        outBlock[3] = (uint8_t)(c1 >> 8);
+        for (int k = 0; k < 4; ++k)
+            outBlock[4 + k] = (uint8_t)(indices >> (k * 8));
+    }
+
+    void DecodeColor(const uint8_t *block, bool allowThreeColor, uint32_t (&outTexels)[16])
+    {
+        uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+        uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+        uint32_t palette[4];
+        ColorPalette(c0, c1, allowThreeColor, palette);
+        uint32_t indices = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+        for (int i = 0; i < 16; ++i)
+            outTexels[i] = palette[(indices >> (i * 2)) & 3];
+    }
+
+    void EncodeAlpha(const uint32_t (&texels)[16], uint8_t *outBlock)
+    {
+        uint8_t a0 = 0, a1 = 255;
+        for (uint32_t texel : texels)
+        {
+            a0 = std::max(a0, (uint8_t)(texel >> 24));
+            a1 = std::min(a1, (uint8_t)(texel >> 24));
+        }
+
+        // a0 > a1 selects the 8 alpha mode, a single alpha only needs index 0
+        uint64_t indices = 0;
+        if (a0 != a1)
+        {
+            uint8_t palette[8];
+            AlphaPalette(a0, a1, palette);
+            for (int i = 0; i < 16; ++i)
+            {
+                int alpha = (int)(texels[i] >> 24);
+                int best = 0;
+                for (int k = 1; k < 8; ++k)
+                {
+                    if (std::abs(alpha - palette[k]) < std::abs(alpha - palette[best]))
+                        best = k;
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+
+        outBlock[0] = a0;
+        outBlock[1] = a1;
+        for (int k = 0; k < 6; ++k)
+            outBlock[2 + k] = (uint8_t)(indices >> (k * 8));
+    }
+
+    void DecodeAlpha(const uint8_t *block, uint32_t (&inOutTexels)[16])
+    {
+        uint8_t palette[8];
+        AlphaPalette(block[0], block[1], palette);
+        uint64_t indices = 0;
+        for (int k = 0; k < 6; ++k)
+            indices |= (uint64_t)block[2 + k] << (k * 8);
+        for (int i = 0; i < 16; ++i)
+            inOutTexels[i] = (inOutTexels[i] & 0x00ffffffu) | ((uint32_t)palette[(indices >> (i * 3)) & 7] << 24);
+    }
+}
+
+namespace BlockCompression
+{
+    size_t GetBlockSize(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::kBC1: return 8;
+        case TextureFormat::kBC3: return 16;
+        default: return 0;
+        }
+    }
+
+    size_t GetImageSize(TextureFormat format, int w, int h)
+    {
+        if (format == TextureFormat::kRGBA32)
+            return (size_t)w * h * sizeof(uint32_t);
+        return (size_t)((w + 3) / 4) * ((h + 3) / 4) * GetBlockSize(format);
+    }
+
+    void EncodeBlock(TextureFormat format, const uint32_t (&texels)[16], uint8_t *outBlock)
+    {
+        assert(format != TextureFormat::kRGBA32 && "Uh oh, RGBA32 isn't a block format!");
+        if (format == TextureFormat::kBC3)
+        {
+            EncodeAlpha(texels, outBlock);
+            outBlock += 8;
+        }
+        EncodeColor(texels, outBlock);
+    }
+
+    void DecodeBlock(TextureFormat format, const uint8_t *block, uint32_t (&outTexels)[16])
+    {
+        assert(format != TextureFormat::kRGBA32 && "Uh oh, RGBA32 isn't a block format!");
+        if (format == TextureFormat::kBC1)
+        {
+            DecodeColor(block, true, outTexels);
+            return;
+        }
+        DecodeColor(block + 8, false, outTexels);
+        DecodeAlpha(block, outTexels);
+    }
+
+    void EncodeImage(TextureFormat format, const uint32_t *texels, int w, int h, uint8_t *outBlocks)
+    {
+        const size_t blockSize = GetBlockSize(format);
+        for (int by = 0; by < h; by += 4)
+        {
+            for (int bx = 0; bx < w; bx += 4)
+            {
+                uint32_t block[16];
+                for (int y = 0; y < 4; ++y)
+                {
+                    const uint32_t *row = texels + std::min(by + y, h - 1) * w;
+                    for (int x = 0; x < 4; ++x)
+                        block[x + y * 4] = row[std::min(bx + x, w - 1)];
+                }
+                EncodeBlock(format, block, outBlocks);
+                outBlocks += blockSize;
+            }
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#include <utility>
+
+#include "Renderer/CommandBuffer.h"
+
+void CommandBuffer::Draw(const Model& model, const Mat44f& modelMat, QRendererMode mode)
+{
+    m_commands.push_back(DrawCommand{&model, nullptr, modelMat, mode});
+}
+
+void CommandBuffer::Draw(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, QRendererMode mode)
+{
+    m_commands.push_back(DrawCommand{&model, std::move(texture), modelMat, mode});
+}
+
+void CommandBuffer::DrawTransparent(const Model& model, const Mat44f& modelMat, float opacity, QRendererMode mode)
+{
+    m_commands.push_back(DrawCommand{&model, nullptr, modelMat, mode, true, opacity});
+}
+
+void CommandBuffer::DrawTransparent(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, float opacity, QRendererMode mode)
+{
+    m_commands.push_back(DrawCommand{&model, std::move(texture), modelMat, mode, true, opacity});
+}
+
+void CommandBuffer::Clear() { m_commands.clear(); }
+
+const std::vector<DrawCommand>& CommandBuffer::GetCommands() const { return m_commands; }
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Math/SIMD.h"
+#include "Renderer/Light.h"
+
+namespace
+{
+    // @brief Thin wrappers so that the light loop below is written once for every lane width
+    struct ScalarOps
+    {
+        using Reg = float;
+        static constexpr int kWidth = 1;
+        static Reg Load(const float *p) { return *p; }
+        static void Store(float *p, Reg a) { *p = a; }
+        static Reg Set(float a) { return a; }
+        static Reg Add(Reg a, Reg b) { return a + b; }
+        static Reg Sub(Reg a, Reg b) { return a - b; }
+        static Reg Mul(Reg a, Reg b) { return a * b; }
+        static Reg Div(Reg a, Reg b) { return a / b; }
+        static Reg Max(Reg a, Reg b) { return std::max(a, b); }
+        static Reg Sqrt(Reg a) { return std::sqrt(a); }
+    };
+
+#if defined(QR_SIMD_SSE)
+    struct SSEOps
+    {
+        using Reg = __m128;
+        static constexpr int kWidth = 4;
+        static Reg Load(const float *p) { return _mm_load_ps(p); }
+        static void Store(float *p, Reg a) { _mm_store_ps(p, a); }
+        static Reg Set(float a) { return _mm_set1_ps(a); }
+        static Reg Add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+        static Reg Sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+        static Reg Mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+        static Reg Div(Reg a, Reg b) { return _mm_div_ps(a, b); }
+        static Reg Max(Reg a, Reg b) { return _mm_max_ps(a, b); }
+        static Reg Sqrt(Reg a) { return _mm_sqrt_ps(a); }
+    };
+#endif
+
+#if defined(QR_SIMD_AVX)
+    struct AVXOps
+    {
+        using Reg = __m256;
+        static constexpr int kWidth = 8;
+        static Reg Load(const float *p) { return _mm256_load_ps(p); }
+        static void Store(float *p, Reg a) { _mm256_store_ps(p, a); }
+        static Reg Set(float a) { return _mm256_set1_ps(a); }
+        static Reg Add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+        static Reg Sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+        static Reg Mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+        static Reg Div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+        static Reg Max(Reg a, Reg b) { return _mm256_max_ps(a, b); }
+        static Reg Sqrt(Reg a) { return _mm256_sqrt_ps(a); }
+    };
+#endif
+}
+
+void LightBuffer::Upload(const std::vector<Light>& lights, const Mat44f& viewMat)
+{
+    m_lights.clear();
+    m_hasShadowLight = false;
+    for (const Light& light : lights)
+    {
+        PackedLight packed;
+        packed.isPoint = (light.type == LightType::kPoint);
+        if (packed.isPoint)
+        {
+            packed.vec = Math::MultiplyVecMat(light.vec, viewMat);
+        }
+        else
+        {
+            Vec4f dir = Math::MultiplyVecMat(Vec4f{light.vec.x, light.vec.y, light.vec.z, 0.0f}, viewMat);
+            packed.vec = Math::Normal(Vec3f{dir.x, dir.y, dir.z});
+        }
+        packed.color = light.color * light.intensity;
+        packed.invRangeSqr = 1.0f / (light.range * light.range);
+        packed.castsShadows = !packed.isPoint && light.castsShadows && !m_hasShadowLight;
+        m_hasShadowLight |= packed.castsShadows;
+        m_lights.push_back(packed);
+    }
+}
+
+Vec3f LightBuffer::Shade(const Vec3f& pos, const Vec3f& normal) const
+{
+    ShadeBatch batch;
+    batch.px[0] = pos.x;
+    batch.py[0] = pos.y;
+    batch.pz[0] = pos.z;
+    batch.nx[0] = normal.x;
+    batch.ny[0] = normal.y;
+    batch.nz[0] = normal.z;
+    Shade(batch, 1);
+    return Vec3f{batch.r[0], batch.g[0], batch.b[0]};
+}
+
+namespace
+{
+    template<typename Ops, bool kUseShadows, typename PackedLight>
+    void ShadeLanes(const std::vector<PackedLight>& lights, ShadeBatch& batch, int i)
+    {
+        using Reg = typename Ops::Reg;
+        const Reg zero = Ops::Set(0.0f);
+
+        // @note Guard against degenerate normals, so that they end up black rather than NaN
+        Reg nx = Ops::Load(batch.nx + i);
+        Reg ny = Ops::Load(batch.ny + i);
+        Reg nz = Ops::Load(batch.nz + i);
+        Reg len = Ops::Sqrt(Ops::Add(Ops::Add(Ops::Mul(nx, nx), Ops::Mul(ny, ny)), Ops::Mul(nz, nz)));
+        Reg invLen = Ops::Div(Ops::Set(1.0f), Ops::Max(len, Ops::Set(1e-20f)));
+        nx = Ops::Mul(nx, invLen);
+        ny = Ops::Mul(ny, invLen);
+        nz = Ops::Mul(nz, invLen);
+
+        Reg px = Ops::Load(batch.px + i);
+        Reg py = Ops::Load(batch.py + i);
+        Reg pz = Ops::Load(batch.pz + i);
+
+        Reg r = zero, g = zero, b = zero;
+        for (const auto& light : lights)
+        {
+            Reg nDotL;
+            if (light.isPoint)
+            {
+                Reg lx = Ops::Sub(Ops::Set(light.vec.x), px);
+                Reg ly = Ops::Sub(Ops::Set(light.vec.y), py);
+                Reg lz = Ops::Sub(Ops::Set(light.vec.z), pz);
+                Reg distSqr = Ops::Add(Ops::Add(Ops::Mul(lx, lx), Ops::Mul(ly, ly)), Ops::Mul(lz, lz));
+                Reg invDist = Ops::Div(Ops::Set(1.0f), Ops::Max(Ops::Sqrt(distSqr), Ops::Set(1e-20f)));
+                nDotL = Ops::Mul(Ops::Add(Ops::Add(Ops::Mul(nx, lx), Ops::Mul(ny, ly)), Ops::Mul(nz, lz)), invDist);
+
+                // Fades out to 0 at range
+                Reg atten = Ops::Max(zero, Ops::Sub(Ops::Set(1.0f), Ops::Mul(distSqr, Ops::Set(light.invRangeSqr))));
+                nDotL = Ops::Mul(nDotL, atten);
+            }
+            else
+            {
+                // vec is the direction the light travels, so it's inverted
+                nDotL = Ops::Sub(zero, Ops::Add(Ops::Add(
+                    Ops::Mul(nx, Ops::Set(light.vec.x)), Ops::Mul(ny, Ops::Set(light.vec.y))), Ops::Mul(nz, Ops::Set(light.vec.z))));
+            }
+            nDotL = Ops::Max(nDotL, zero);
+            if (kUseShadows && light.castsShadows)
+                nDotL = Ops::Mul(nDotL, Ops::Load(batch.shadow + i));
+
+            r = Ops::Add(r, Ops::Mul(nDotL, Ops::Set(light.color.r)));
+            g = Ops::Add(g, Ops::Mul(nDotL, Ops::Set(light.color.g)));
+            b = Ops::Add(b, Ops::Mul(nDotL, Ops::Set(light.color.b)));
+        }
+
+        Ops::Store(batch.r + i, r);
+        Ops::Store(batch.g + i, g);
+        Ops::Store(batch.b + i, b);
+    }
+}
+
+namespace
+{
+    template<bool kUseShadows, typename PackedLight>
+    void ShadeBatchWith(const std::vector<PackedLight>& lights, ShadeBatch& batch, int count)
+    {
+        int i = 0;
+#if defined(QR_SIMD_AVX)
+        for (; i + AVXOps::kWidth <= count; i += AVXOps::kWidth)
+            ShadeLanes<AVXOps, kUseShadows>(lights, batch, i);
+#endif
+#if defined(QR_SIMD_SSE)
+        for (; i + SSEOps::kWidth <= count; i += SSEOps::kWidth)
+            ShadeLanes<SSEOps, kUseShadows>(lights, batch, i);
+#endif
+        for (; i < count; ++i)
+            ShadeLanes<ScalarOps, kUseShadows>(lights, batch, i);
+    }
+}
+
+void LightBuffer::Shade(ShadeBatch& batch, int count, bool useShadows) const
+{
+    if (useShadows && m_hasShadowLight)
+        ShadeBatchWith<true>(m_lights, batch, count);
+    else
+        ShadeBatchWith<false>(m_lights, batch, count);
+}
+
+bool LightBuffer::HasShadowLight() const { return m_hasShadowLight; }
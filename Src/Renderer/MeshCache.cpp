@@ -0,0 +1,197 @@
+#include <cstdint>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+#include "Renderer/MeshCache.h"
+#include "Renderer/Model.h"
+#include "Renderer/OBJLoader.h"
+#include "Utils/FileStat.h"
+
+namespace
+{
+    constexpr uint32_t kMagic = 0x48534d51;     // "QMSH"
+    constexpr uint32_t kVersion = 2;
+
+    // @brief Identifies what a cache file was built from
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        int32_t lodLevels;
+        int32_t keepSeams;
+    };
+
+    static_assert(std::is_trivially_copyable<Vec3f>::value && std::is_trivially_copyable<Vec2f>::value,
+        "Vectors are written as raw bytes");
+    static_assert(std::is_trivially_copyable<Cluster>::value, "Clusters are written as raw bytes");
+    static_assert(std::is_trivially_copyable<Edge>::value, "Edges are written as raw bytes");
+
+    template <typename T>
+    void WriteArray(std::ofstream& ofs, const std::vector<T>& v)
+    {
+        uint64_t size = v.size();
+        ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        ofs.write(reinterpret_cast<const char*>(v.data()), sizeof(T) * size);
+    }
+
+    template <typename T>
+    bool ReadArray(std::ifstream& ifs, std::vector<T>& v)
+    {
+        uint64_t size = 0;
+        if (!ifs.read(reinterpret_cast<char*>(&size), sizeof(size)))
+            return false;
+
+        // Guards the allocation against a corrupt size
+        std::streampos pos = ifs.tellg();
+        ifs.seekg(0, std::ios::end);
+        const uint64_t left = (uint64_t)(ifs.tellg() - pos);
+        ifs.seekg(pos);
+        if (size > left / sizeof(T))
+            return false;
+
+        v.resize(size);
+        return (bool)ifs.read(reinterpret_cast<char*>(v.data()), sizeof(T) * size);
+    }
+
+    bool AreInRange(const std::vector<int>& indices, size_t count)
+    {
+        for (int i : indices)
+        {
+            if (i < 0 || (size_t)i >= count)
+                return false;
+        }
+        return true;
+    }
+
+    // @brief A corrupt file can hold any index, the draws would read out of the vertex buffers
+    // @param uvIndices, nIndices Either empty, or one per vert index
+    bool AreValid(const Model& model, const std::vector<int>& vertIndices, const std::vector<int>& uvIndices,
+        const std::vector<int>& nIndices, const std::vector<Cluster>& clusters, const std::vector<Edge>& edges)
+    {
+        const size_t indexCnt = vertIndices.size();
+        const int triCnt = (int)(indexCnt / 3);
+        if (indexCnt % 3 != 0 || !AreInRange(vertIndices, model.verts.size()))
+            return false;
+        if (!uvIndices.empty() && (uvIndices.size() != indexCnt || !AreInRange(uvIndices, model.texCoords.size())))
+            return false;
+        if (!nIndices.empty() && (nIndices.size() != indexCnt || !AreInRange(nIndices, model.normals.size())))
+            return false;
+
+        for (const Cluster& cluster : clusters)
+        {
+            if (cluster.firstIndex < 0 || cluster.indexCount < 0 || (size_t)cluster.firstIndex + cluster.indexCount > indexCnt)
+                return false;
+        }
+        for (const Edge& edge : edges)
+        {
+            if (edge.v0 < 0 || (size_t)edge.v0 >= model.verts.size() || edge.v1 < 0 || (size_t)edge.v1 >= model.verts.size() ||
+                edge.tri0 < 0 || edge.tri0 >= triCnt || edge.tri1 < -1 || edge.tri1 >= triCnt)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+namespace MeshCache
+{
+    bool Save(const std::string& cachePath, const Model& model, const std::string& sourcePath, int lodLevels, bool keepSeams)
+    {
+        Header header{kMagic, kVersion, 0, 0, lodLevels, keepSeams ? 1 : 0};
+        if (!Helper::StatSource(sourcePath, header.sourceSize, header.sourceTime))
+            return false;
+
+        std::ofstream ofs{cachePath, std::ios::binary | std::ios::trunc};
+        if (!ofs)
+            return false;
+
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        WriteArray(ofs, model.verts);
+        WriteArray(ofs, model.colors);
+        WriteArray(ofs, model.texCoords);
+        WriteArray(ofs, model.normals);
+        WriteArray(ofs, model.vertIndices);
+        WriteArray(ofs, model.uvIndices);
+        WriteArray(ofs, model.nIndices);
+        ofs.write(reinterpret_cast<const char*>(&model.bounds), sizeof(model.bounds));
+        WriteArray(ofs, model.clusters);
+        WriteArray(ofs, model.edges);
+
+        uint64_t lodCnt = model.lods.size();
+        ofs.write(reinterpret_cast<const char*>(&lodCnt), sizeof(lodCnt));
+        for (const Lod& lod : model.lods)
+        {
+            WriteArray(ofs, lod.vertIndices);
+            WriteArray(ofs, lod.uvIndices);
+            WriteArray(ofs, lod.nIndices);
+            WriteArray(ofs, lod.clusters);
+            WriteArray(ofs, lod.edges);
+            ofs.write(reinterpret_cast<const char*>(&lod.error), sizeof(lod.error));
+        }
+        return (bool)ofs;
+    }
+
+    bool Load(const std::string& cachePath, const std::string& sourcePath, int lodLevels, bool keepSeams, Model& outModel)
+    {
+        Header expected{kMagic, kVersion, 0, 0, lodLevels, keepSeams ? 1 : 0};
+        if (!Helper::StatSource(sourcePath, expected.sourceSize, expected.sourceTime))
+            return false;
+
+        std::ifstream ifs{cachePath, std::ios::binary};
+        Header header;
+        if (!ifs || !ifs.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            return false;
+        if (header.magic != expected.magic || header.version != expected.version ||
+            header.sourceSize != expected.sourceSize || header.sourceTime != expected.sourceTime ||
+            header.lodLevels != expected.lodLevels || header.keepSeams != expected.keepSeams)
+        {
+            return false;
+        }
+
+        Model model;
+        uint64_t lodCnt = 0;
+        bool ok = ReadArray(ifs, model.verts) && ReadArray(ifs, model.colors) && ReadArray(ifs, model.texCoords) &&
+            ReadArray(ifs, model.normals) && ReadArray(ifs, model.vertIndices) && ReadArray(ifs, model.uvIndices) &&
+            ReadArray(ifs, model.nIndices) && ifs.read(reinterpret_cast<char*>(&model.bounds), sizeof(model.bounds)) &&
+            ReadArray(ifs, model.clusters) && ReadArray(ifs, model.edges) && ifs.read(reinterpret_cast<char*>(&lodCnt), sizeof(lodCnt));
+        if (!ok || lodCnt > (uint64_t)lodLevels ||
+            !AreValid(model, model.vertIndices, model.uvIndices, model.nIndices, model.clusters, model.edges))
+        {
+            return false;
+        }
+
+        model.lods.resize(lodCnt);
+        for (Lod& lod : model.lods)
+        {
+            if (!ReadArray(ifs, lod.vertIndices) || !ReadArray(ifs, lod.uvIndices) || !ReadArray(ifs, lod.nIndices) ||
+                !ReadArray(ifs, lod.clusters) || !ReadArray(ifs, lod.edges) || !ifs.read(reinterpret_cast<char*>(&lod.error), sizeof(lod.error)) ||
+                !AreValid(model, lod.vertIndices, lod.uvIndices, lod.nIndices, lod.clusters, lod.edges))
+            {
+                return false;
+            }
+        }
+
+        outModel = std::move(model);
+        return true;
+    }
+
+    Model LoadOBJ(const std::string& objPath, int lodLevels, bool keepSeams, bool *outIsHit)
+    {
+        const std::string cachePath = objPath + ".qmesh";
+        Model model;
+        const bool isHit = Load(cachePath, objPath, lodLevels, keepSeams, model);
+        if (outIsHit)
+            *outIsHit = isHit;
+        if (isHit)
+            return model;
+
+        model = OBJ::LoadFileData(objPath);
+        model.BuildLods(lodLevels, keepSeams);
+        Save(cachePath, model, objPath, lodLevels, keepSeams);
+        return model;
+    }
+}
@@ -1,4 +1,10 @@
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <type_traits>
 
 #include "Renderer/Model.h"
 
@@ -31,5 +37,904 @@ Model::Model(InputWindingOrder order,
             }
         }
     }
+
+    BuildClusters();
+    ReorderVertices();
+}
+
+namespace
+{
+    // @brief Tris per cluster. Clusters grow over the tris next to them up to kMaxClusterTris. Once
+    // they have kMinClusterTris, they only take the tris facing within acos(kClusterFacingCos) of
+    // their average normal, so that their normal cones stay narrow.
+    constexpr int kMinClusterTris = 64;
+    constexpr int kMaxClusterTris = 256;
+    constexpr float kClusterFacingCos = 0.7f;
+
+    // @brief Spread the low 10 bits of v so that there are 2 zero bits between each of them
+    uint32_t SpreadBits(uint32_t v)
+    {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    void GrowBounds(Bounds& b, const Vec3f& p)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            b.min[k] = std::min(b.min[k], p[k]);
+            b.max[k] = std::max(b.max[k], p[k]);
+        }
+    }
+
+    // @brief The sphere is centered on the AABB, then shrunk to the farthest point
+    template<typename ForEachPoint>
+    Bounds ComputeBounds(ForEachPoint forEachPoint)
+    {
+        Bounds b;
+        b.min = Vec3f{std::numeric_limits<float>::max()};
+        b.max = Vec3f{-std::numeric_limits<float>::max()};
+        bool empty = true;
+        forEachPoint([&b, &empty](const Vec3f& p) { GrowBounds(b, p); empty = false; });
+        if (empty)
+            return Bounds{};
+
+        b.center = (b.min + b.max) * 0.5f;
+        float radiusSqr = 0.0f;
+        forEachPoint([&b, &radiusSqr](const Vec3f& p) { radiusSqr = std::max(radiusSqr, Math::LengthSqr(p - b.center)); });
+        b.radius = std::sqrt(radiusSqr);
+        return b;
+    }
+
+    // @brief Tri t of the result is tri order[t] of the input, in every index buffer that is per corner
+    void ReorderTris(const std::vector<int>& order, std::vector<int>& vertIndices, std::vector<int>& uvIndices, std::vector<int>& nIndices)
+    {
+        auto reorder = [&vertIndices, &order](std::vector<int>& indices)
+        {
+            if (indices.size() != vertIndices.size())
+                return;
+            std::vector<int> sorted(indices.size());
+            for (int t = 0; t < (int)order.size(); ++t)
+            {
+                for (int k = 0; k < 3; ++k)
+                    sorted[t * 3 + k] = indices[order[t] * 3 + k];
+            }
+            indices = std::move(sorted);
+        };
+        reorder(uvIndices);
+        reorder(nIndices);
+        reorder(vertIndices);
+    }
+
+    // @brief Every pair of tris that shares 2 verts makes an edge, as does every border. The edges
+    // are sorted by their first tri, so that a draw walks the verts in about the same order as the
+    // tris.
+    void BuildEdges(const std::vector<int>& vertIndices, std::vector<Edge>& outEdges)
+    {
+        struct HalfEdge
+        {
+            int v0, v1;     // v0 < v1
+            int tri;
+        };
+        std::vector<HalfEdge> halfEdges;
+        halfEdges.reserve(vertIndices.size());
+        for (int i = 0; i + 2 < (int)vertIndices.size(); i += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const int a = vertIndices[i + k];
+                const int b = vertIndices[i + (k + 1) % 3];
+                if (a != b)
+                    halfEdges.push_back(HalfEdge{std::min(a, b), std::max(a, b), i / 3});
+            }
+        }
+        std::sort(halfEdges.begin(), halfEdges.end(), [](const HalfEdge& l, const HalfEdge& r)
+        {
+            return (l.v0 != r.v0) ? l.v0 < r.v0 : (l.v1 != r.v1) ? l.v1 < r.v1 : l.tri < r.tri;
+        });
+
+        outEdges.clear();
+        for (size_t j = 0; j < halfEdges.size(); ++j)
+        {
+            const HalfEdge& h = halfEdges[j];
+            Edge edge{h.v0, h.v1, h.tri, -1};
+            if (j + 1 < halfEdges.size() && halfEdges[j + 1].v0 == h.v0 && halfEdges[j + 1].v1 == h.v1)
+                edge.tri1 = halfEdges[++j].tri;
+            outEdges.push_back(edge);
+        }
+        std::sort(outEdges.begin(), outEdges.end(), [](const Edge& l, const Edge& r) { return l.tri0 < r.tri0; });
+    }
+
+    // @brief Tipsify (Sander et al. 2007), appends the tris [firstTri, firstTri + triCnt) to outOrder
+    // in an order that reuses the verts of the last cacheSize verts transformed as much as possible.
+    // It fans around one vert at a time, and then moves on to the most recent vert of the cache that
+    // still has tris left.
+    // @param localIds Scratch of verts.size() set to -1, it's left that way
+    void OrderForVertexCache(const std::vector<int>& vertIndices, int firstTri, int triCnt, int cacheSize,
+        std::vector<int>& localIds, std::vector<int>& outOrder)
+    {
+        // Local ids of the verts, in order of first use
+        std::vector<int> globalIds;
+        std::vector<int> corners(triCnt * 3);
+        for (int i = 0; i < triCnt * 3; ++i)
+        {
+            int& id = localIds[vertIndices[firstTri * 3 + i]];
+            if (id < 0)
+            {
+                id = (int)globalIds.size();
+                globalIds.push_back(vertIndices[firstTri * 3 + i]);
+            }
+            corners[i] = id;
+        }
+        for (int v : globalIds)
+            localIds[v] = -1;
+
+        // Tris of each vert, packed
+        const int vertCnt = (int)globalIds.size();
+        std::vector<int> live(vertCnt, 0), offsets(vertCnt + 1, 0), adjacency(triCnt * 3);
+        for (int v : corners)
+            ++live[v];
+        for (int v = 0; v < vertCnt; ++v)
+            offsets[v + 1] = offsets[v] + live[v];
+        std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+        for (int i = 0; i < triCnt * 3; ++i)
+            adjacency[fill[corners[i]]++] = i / 3;
+
+        std::vector<int> cacheTime(vertCnt, 0);
+        std::vector<bool> emitted(triCnt, false);
+        std::vector<int> deadEnd, candidates;
+        int time = cacheSize + 1;
+        int cursor = 1;
+        int fan = 0;
+        while (fan >= 0)
+        {
+            candidates.clear();
+            for (int a = offsets[fan]; a < offsets[fan + 1]; ++a)
+            {
+                const int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                emitted[t] = true;
+                outOrder.push_back(firstTri + t);
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int v = corners[t * 3 + k];
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // The candidate that stays in the cache after its tris are emitted, the oldest one
+            // that does, or else any with tris left
+            fan = -1;
+            int bestPriority = -1;
+            for (int v : candidates)
+            {
+                if (live[v] <= 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                    priority = time - cacheTime[v];
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    fan = v;
+                }
+            }
+
+            // Dead end, back to the most recent vert with tris left, or the next one in order
+            while (fan < 0 && !deadEnd.empty())
+            {
+                int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    fan = v;
+            }
+            while (fan < 0 && cursor < vertCnt)
+            {
+                if (live[cursor] > 0)
+                    fan = cursor;
+                ++cursor;
+            }
+        }
+    }
+
+    // @brief Order the tris of each cluster for the vertex cache, then the clusters themselves so
+    // that the ones facing out of the mesh come first: from most views, they're in front of the
+    // others and the depth test rejects what follows (Tipsify's overdraw pass, at cluster level).
+    void OrderTris(const std::vector<Vec3f>& verts, const Bounds& bounds, std::vector<int>& vertIndices,
+        std::vector<int>& uvIndices, std::vector<int>& nIndices, std::vector<Cluster>& clusters)
+    {
+        std::vector<float> outwardness(clusters.size());
+        std::vector<int> clusterOrder(clusters.size());
+        for (int c = 0; c < (int)clusters.size(); ++c)
+        {
+            outwardness[c] = Math::Dot(clusters[c].bounds.center - bounds.center, clusters[c].coneAxis);
+            clusterOrder[c] = c;
+        }
+        std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&outwardness](int a, int b) { return outwardness[a] > outwardness[b]; });
+
+        std::vector<int> order;
+        order.reserve(vertIndices.size() / 3);
+        std::vector<int> localIds(verts.size(), -1);
+        std::vector<int> clusterIndices;
+        std::vector<Cluster> sorted;
+        sorted.reserve(clusters.size());
+        for (int c : clusterOrder)
+        {
+            Cluster cluster = clusters[c];
+            const int firstTri = cluster.firstIndex / 3;
+            const int triCnt = cluster.indexCount / 3;
+            cluster.firstIndex = (int)order.size() * 3;
+            OrderForVertexCache(vertIndices, firstTri, triCnt, Model::kVertexCacheSize, localIds, order);
+
+            // Some meshes already come in a good order (e.g. grids), keep it if it's better
+            clusterIndices.clear();
+            for (int t = (int)order.size() - triCnt; t < (int)order.size(); ++t)
+                clusterIndices.insert(clusterIndices.end(), vertIndices.begin() + order[t] * 3, vertIndices.begin() + order[t] * 3 + 3);
+            std::vector<int> current(vertIndices.begin() + firstTri * 3, vertIndices.begin() + (firstTri + triCnt) * 3);
+            if (Model::ComputeACMR(current) <= Model::ComputeACMR(clusterIndices))
+            {
+                for (int t = 0; t < triCnt; ++t)
+                    order[order.size() - triCnt + t] = firstTri + t;
+            }
+            sorted.push_back(cluster);
+        }
+        ReorderTris(order, vertIndices, uvIndices, nIndices);
+        clusters = std::move(sorted);
+    }
+
+    // @brief Reorder the tris of a set of index buffers so that clusters are contiguous, and split
+    // them into outClusters, see OrderTris() for the final order. bounds are those of verts.
+    void SplitClusters(const std::vector<Vec3f>& verts, const Bounds& bounds, std::vector<int>& vertIndices,
+        std::vector<int>& uvIndices, std::vector<int>& nIndices, std::vector<Cluster>& outClusters)
+    {
+        outClusters.clear();
+
+        const int triCnt = (int)vertIndices.size() / 3;
+        if (triCnt == 0)
+            return;
+
+        // Surface normals, same orientation as the renderer's front face
+        std::vector<Vec3f> faceNormals(triCnt);
+        for (int t = 0; t < triCnt; ++t)
+        {
+            const Vec3f& p0 = verts[vertIndices[t * 3]];
+            const Vec3f& p1 = verts[vertIndices[t * 3 + 1]];
+            const Vec3f& p2 = verts[vertIndices[t * 3 + 2]];
+            faceNormals[t] = Math::Cross(p2 - p0, p1 - p0);
+        }
+
+        // Clusters are grown from seeds taken along a Morton curve of the centroids, so that
+        // consecutive clusters are close too
+        std::vector<int> order(triCnt);
+        for (int t = 0; t < triCnt; ++t)
+            order[t] = t;
+
+        std::vector<int> clusterEnds{triCnt};
+        if (triCnt > kMaxClusterTris)
+        {
+            std::vector<uint32_t> keys(triCnt);
+            Vec3f extent = bounds.max - bounds.min;
+            for (int t = 0; t < triCnt; ++t)
+            {
+                Vec3f centroid = (verts[vertIndices[t * 3]] + verts[vertIndices[t * 3 + 1]] + verts[vertIndices[t * 3 + 2]]) / 3.0f;
+                uint32_t morton = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    float n = extent[k] > 0.0f ? (centroid[k] - bounds.min[k]) / extent[k] : 0.0f;
+                    morton |= SpreadBits((uint32_t)std::min(std::max(n * 1023.0f, 0.0f), 1023.0f)) << k;
+                }
+                keys[t] = morton;
+            }
+            std::vector<int> seeds = order;
+            std::stable_sort(seeds.begin(), seeds.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+
+            std::vector<std::vector<int>> vertTris(verts.size());
+            for (int i = 0; i < triCnt * 3; ++i)
+                vertTris[vertIndices[i]].push_back(i / 3);
+
+            // Breadth first over the tris sharing a vert, order doubles as the queue
+            order.clear();
+            clusterEnds.clear();
+            std::vector<bool> assigned(triCnt, false);
+            for (int seed : seeds)
+            {
+                if (assigned[seed])
+                    continue;
+
+                const int start = (int)order.size();
+                Vec3f axis{0.0f};
+                auto take = [&order, &assigned, &axis, &faceNormals](int t)
+                {
+                    assigned[t] = true;
+                    order.push_back(t);
+                    if (Math::LengthSqr(faceNormals[t]) > 0.0f)
+                        axis += Math::Normal(faceNormals[t]);
+                };
+                take(seed);
+                for (int head = start; head < (int)order.size() && (int)order.size() - start < kMaxClusterTris; ++head)
+                {
+                    const int t = order[head];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        for (int next : vertTris[vertIndices[t * 3 + k]])
+                        {
+                            if (assigned[next] || (int)order.size() - start >= kMaxClusterTris)
+                                continue;
+                            const Vec3f& n = faceNormals[next];
+                            if ((int)order.size() - start < kMinClusterTris || Math::LengthSqr(n) == 0.0f ||
+                                Math::Dot(n, axis) >= kClusterFacingCos * std::sqrt(Math::LengthSqr(n) * Math::LengthSqr(axis)))
+                            {
+                                take(next);
+                            }
+                        }
+                    }
+                }
+                clusterEnds.push_back((int)order.size());
+            }
+
+            ReorderTris(order, vertIndices, uvIndices, nIndices);
+        }
+
+        int first = 0;
+        for (int last : clusterEnds)
+        {
+            Cluster cluster;
+            cluster.firstIndex = first * 3;
+            cluster.indexCount = (last - first) * 3;
+            cluster.bounds = ComputeBounds([&verts, &vertIndices, &cluster](auto&& f)
+            {
+                for (int i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; ++i)
+                    f(verts[vertIndices[i]]);
+            });
+
+            // The cone axis is the average of the unit normals, its half angle reaches the one
+            // furthest from it. Tris with no area don't constrain it.
+            Vec3f axis{0.0f};
+            for (int t = first; t < last; ++t)
+            {
+                const Vec3f& n = faceNormals[order[t]];
+                if (Math::LengthSqr(n) > 0.0f)
+                    axis += Math::Normal(n);
+            }
+            if (Math::LengthSqr(axis) > 1e-12f)
+            {
+                axis = Math::Normal(axis);
+                float minDot = 1.0f;
+                for (int t = first; t < last; ++t)
+                {
+                    const Vec3f& n = faceNormals[order[t]];
+                    if (Math::LengthSqr(n) > 0.0f)
+                        minDot = std::min(minDot, Math::Dot(Math::Normal(n), axis));
+                }
+                cluster.coneAxis = axis;
+                cluster.coneCutoff = (minDot <= 0.0f) ? 2.0f : std::sqrt(1.0f - minDot * minDot);
+            }
+
+            outClusters.push_back(cluster);
+            first = last;
+        }
+
+        OrderTris(verts, bounds, vertIndices, uvIndices, nIndices, outClusters);
+    }
+}
+
+void Model::BuildClusters()
+{
+    bounds = ComputeBounds([this](auto&& f) { for (const Vec3f& v : verts) f(v); });
+    SplitClusters(verts, bounds, vertIndices, uvIndices, nIndices, clusters);
+    BuildEdges(vertIndices, edges);
+    for (Lod& lod : lods)
+    {
+        SplitClusters(verts, bounds, lod.vertIndices, lod.uvIndices, lod.nIndices, lod.clusters);
+        BuildEdges(lod.vertIndices, lod.edges);
+    }
+}
+
+namespace
+{
+    // @brief Levels under this many tris aren't worth drawing over the previous one
+    constexpr int kMinLodTris = 64;
+
+    // @brief Cosine of the angle between the normals of a vert's corners past which it's a crease
+    constexpr float kCreaseCos = 0.5f;
+
+    // @brief Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of
+    // Garland-Heckbert's quadric error metric (its upper triangle)
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0;
+        double b2 = 0, bc = 0, bd = 0;
+        double c2 = 0, cd = 0;
+        double d2 = 0;
+
+        static Quadric FromPlane(const Vec3f& n, float d)
+        {
+            Quadric q;
+            q.a2 = (double)n.x * n.x; q.ab = (double)n.x * n.y; q.ac = (double)n.x * n.z; q.ad = (double)n.x * d;
+            q.b2 = (double)n.y * n.y; q.bc = (double)n.y * n.z; q.bd = (double)n.y * d;
+            q.c2 = (double)n.z * n.z; q.cd = (double)n.z * d;
+            q.d2 = (double)d * d;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& o)
+        {
+            a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+            b2 += o.b2; bc += o.bc; bd += o.bd;
+            c2 += o.c2; cd += o.cd;
+            d2 += o.d2;
+            return *this;
+        }
+
+        double Evaluate(const Vec3f& p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                + c2 * z * z + 2 * cd * z
+                + d2;
+            return std::max(e, 0.0);
+        }
+    };
+
+    // @brief Collapse of vert from into vert to, see Simplifier
+    struct Collapse
+    {
+        double cost;
+        int from, to;
+        int fromStamp, toStamp;
+
+        bool operator>(const Collapse& o) const { return cost > o.cost; }
+    };
+
+    // @brief Half edge collapse simplifier. A collapse removes a vert by moving it onto a neighbour,
+    // so every lod keeps indexing the original verts, and uvs and normals.
+    // @note A vert is locked (never removed) when it's on an open border or a non manifold edge, or
+    // when its corners don't all share the same uv and normal (see SameAttributes()), i.e. it's on
+    // a seam or a crease.
+    class Simplifier
+    {
+    public:
+        Simplifier(const Model& model, bool keepSeams)
+            : m_keepSeams(keepSeams), m_verts(model.verts), m_texCoords(model.texCoords), m_normals(model.normals), m_vertIndices(model.vertIndices), m_uvIndices(model.uvIndices), m_nIndices(model.nIndices)
+        {
+            const int vertCnt = (int)m_verts.size();
+            const int triCnt = (int)m_vertIndices.size() / 3;
+            m_hasUVs = m_uvIndices.size() == m_vertIndices.size();
+            m_hasNormals = m_nIndices.size() == m_vertIndices.size();
+
+            m_triAlive.assign(triCnt, true);
+            m_triCnt = triCnt;
+            m_vertTris.resize(vertCnt);
+            m_quadrics.resize(vertCnt);
+            m_stamps.assign(vertCnt, 0);
+            m_locked.assign(vertCnt, false);
+
+            std::vector<int> firstCorner(vertCnt, -1);
+            for (int t = 0; t < triCnt; ++t)
+            {
+                const Vec3f& p0 = m_verts[m_vertIndices[t * 3]];
+                Vec3f n = TriNormal(t);
+                float lenSqr = Math::LengthSqr(n);
+                Quadric q;
+                if (lenSqr > 0.0f)
+                {
+                    n = n / std::sqrt(lenSqr);
+                    q = Quadric::FromPlane(n, -Math::Dot(n, p0));
+                }
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int i = t * 3 + k;
+                    const int v = m_vertIndices[i];
+                    m_vertTris[v].push_back(t);
+                    m_quadrics[v] += q;
+
+                    // Seams
+                    if (firstCorner[v] < 0)
+                        firstCorner[v] = i;
+                    else if (!SameAttributes(firstCorner[v], i))
+                        m_locked[v] = true;
+                }
+            }
+
+            // Borders and non manifold edges: every edge of a closed manifold is shared by exactly 2 tris
+            for (int v = 0; v < vertCnt; ++v)
+            {
+                for (int w : Neighbours(v))
+                {
+                    if (CountSharedTris(v, w) != 2)
+                    {
+                        m_locked[v] = true;
+                        break;
+                    }
+                }
+            }
+
+            for (int v = 0; v < vertCnt; ++v)
+                PushCollapses(v);
+        }
+
+        int GetTriCount() const { return m_triCnt; }
+
+        // @brief Collapse the cheapest edges until there are at most targetTris tris left
+        // @return False if no valid collapse is left before reaching it
+        bool CollapseTo(int targetTris)
+        {
+            while (m_triCnt > targetTris)
+            {
+                if (m_heap.empty())
+                    return false;
+
+                Collapse c = m_heap.top();
+                m_heap.pop();
+                if (c.fromStamp != m_stamps[c.from] || c.toStamp != m_stamps[c.to] || !IsValid(c.from, c.to))
+                    continue;
+
+                Apply(c.from, c.to);
+                m_maxCost = std::max(m_maxCost, c.cost);
+            }
+            return true;
+        }
+
+        // @brief Largest distance to the original surface so far, as estimated by the quadrics
+        float GetError() const { return (float)std::sqrt(m_maxCost); }
+
+        void Snapshot(Lod& lod) const
+        {
+            lod.vertIndices.clear();
+            lod.uvIndices.clear();
+            lod.nIndices.clear();
+            for (int t = 0; t < (int)m_triAlive.size(); ++t)
+            {
+                if (!m_triAlive[t])
+                    continue;
+                for (int k = 0; k < 3; ++k)
+                {
+                    lod.vertIndices.push_back(m_vertIndices[t * 3 + k]);
+                    if (m_hasUVs)
+                        lod.uvIndices.push_back(m_uvIndices[t * 3 + k]);
+                    if (m_hasNormals)
+                        lod.nIndices.push_back(m_nIndices[t * 3 + k]);
+                }
+            }
+            lod.error = GetError();
+        }
+
+    private:
+        // @brief Same orientation as the renderer's surface normals
+        Vec3f TriNormal(int t, int moved = -1, const Vec3f& movedTo = Vec3f{0.0f}) const
+        {
+            Vec3f p[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                int v = m_vertIndices[t * 3 + k];
+                p[k] = (v == moved) ? movedTo : m_verts[v];
+            }
+            return Math::Cross(p[2] - p[0], p[1] - p[0]);
+        }
+
+        std::vector<int> Neighbours(int v) const
+        {
+            std::vector<int> out;
+            for (int t : m_vertTris[v])
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    int w = m_vertIndices[t * 3 + k];
+                    if (w != v && std::find(out.begin(), out.end(), w) == out.end())
+                        out.push_back(w);
+                }
+            }
+            return out;
+        }
+
+        // @brief Corners i and j could be the same corner. Uvs are compared by value since meshes often
+        // duplicate them, and normals are only different across a crease so that flat shaded meshes
+        // can be simplified.
+        bool SameAttributes(int i, int j) const
+        {
+            if (!m_keepSeams)
+                return true;
+            if (m_hasUVs)
+            {
+                const Vec2f& a = m_texCoords[m_uvIndices[i]];
+                const Vec2f& b = m_texCoords[m_uvIndices[j]];
+                if (a.x != b.x || a.y != b.y)
+                    return false;
+            }
+            if (m_hasNormals)
+            {
+                const Vec3f& a = m_normals[m_nIndices[i]];
+                const Vec3f& b = m_normals[m_nIndices[j]];
+                if (Math::Dot(a, b) < kCreaseCos * std::sqrt(Math::LengthSqr(a) * Math::LengthSqr(b)))
+                    return false;
+            }
+            return true;
+        }
+
+        bool HasVert(int t, int v) const
+        {
+            return m_vertIndices[t * 3] == v || m_vertIndices[t * 3 + 1] == v || m_vertIndices[t * 3 + 2] == v;
+        }
+
+        int CountSharedTris(int v, int w) const
+        {
+            int cnt = 0;
+            for (int t : m_vertTris[v])
+                cnt += HasVert(t, w) ? 1 : 0;
+            return cnt;
+        }
+
+        void PushCollapses(int v)
+        {
+            if (m_locked[v] || m_vertTris[v].empty())
+                return;
+
+            for (int w : Neighbours(v))
+            {
+                Quadric q = m_quadrics[v];
+                q += m_quadrics[w];
+                m_heap.push(Collapse{q.Evaluate(m_verts[w]), v, w, m_stamps[v], m_stamps[w]});
+            }
+        }
+
+        // @brief The corner of to in a tri that shares the edge, -1 if there's none
+        int SharedCorner(int from, int to) const
+        {
+            for (int t : m_vertTris[from])
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    if (m_vertIndices[t * 3 + k] == to)
+                        return t * 3 + k;
+                }
+            }
+            return -1;
+        }
+
+        bool IsValid(int from, int to) const
+        {
+            if (m_locked[from])
+                return false;
+
+            // Both tris of the edge must agree on the uv and normal of to, so that from's tris can take them
+            const int corner = SharedCorner(from, to);
+            if (corner < 0)
+                return false;
+            for (int t : m_vertTris[from])
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int i = t * 3 + k;
+                    if (m_vertIndices[i] == to && !SameAttributes(i, corner))
+                        return false;
+                }
+            }
+
+            // Link condition: only the 2 verts opposite to the edge can be neighbours of both,
+            // otherwise the collapse pinches the surface
+            std::vector<int> fromNeighbours = Neighbours(from);
+            int common = 0;
+            for (int w : Neighbours(to))
+                common += std::find(fromNeighbours.begin(), fromNeighbours.end(), w) != fromNeighbours.end() ? 1 : 0;
+            if (common != 2 || CountSharedTris(from, to) != 2)
+                return false;
+
+            // The tris that remain must not flip, or become degenerate
+            for (int t : m_vertTris[from])
+            {
+                if (HasVert(t, to))
+                    continue;
+                Vec3f before = TriNormal(t);
+                Vec3f after = TriNormal(t, from, m_verts[to]);
+                if (Math::Dot(before, after) <= 0.0f)
+                    return false;
+            }
+            return true;
+        }
+
+        void Apply(int from, int to)
+        {
+            const int corner = SharedCorner(from, to);
+            const int uv = m_hasUVs ? m_uvIndices[corner] : -1;
+            const int n = m_hasNormals ? m_nIndices[corner] : -1;
+
+            for (int t : m_vertTris[from])
+            {
+                if (HasVert(t, to))
+                {
+                    m_triAlive[t] = false;
+                    --m_triCnt;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        std::vector<int>& tris = m_vertTris[m_vertIndices[t * 3 + k]];
+                        if (m_vertIndices[t * 3 + k] != from)
+                            tris.erase(std::find(tris.begin(), tris.end(), t));
+                    }
+                    continue;
+                }
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int i = t * 3 + k;
+                    if (m_vertIndices[i] != from)
+                        continue;
+                    m_vertIndices[i] = to;
+                    if (m_hasUVs)
+                        m_uvIndices[i] = uv;
+                    if (m_hasNormals)
+                        m_nIndices[i] = n;
+                }
+                m_vertTris[to].push_back(t);
+            }
+            m_vertTris[from].clear();
+            m_quadrics[to] += m_quadrics[from];
+
+            // Older collapses of both are stale now, the ones of to's new edges replace them
+            ++m_stamps[from];
+            ++m_stamps[to];
+            PushCollapses(to);
+            for (int w : Neighbours(to))
+                PushCollapses(w);
+        }
+
+        bool m_keepSeams;
+        const std::vector<Vec3f>& m_verts;
+        const std::vector<Vec2f>& m_texCoords;
+        const std::vector<Vec3f>& m_normals;
+        std::vector<int> m_vertIndices;
+        std::vector<int> m_uvIndices;
+        std::vector<int> m_nIndices;
+        bool m_hasUVs, m_hasNormals;
+
+        std::vector<bool> m_triAlive;
+        int m_triCnt;
+        std::vector<std::vector<int>> m_vertTris;
+        std::vector<Quadric> m_quadrics;
+        std::vector<int> m_stamps;
+        std::vector<bool> m_locked;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_heap;
+        double m_maxCost = 0.0;
+    };
 }
 
+void Model::ReorderVertices()
+{
+    // New index of each element in order of first use, then the unused ones in their current order
+    auto remap = [](const std::vector<const std::vector<int>*>& indexBuffers, int elementCnt)
+    {
+        std::vector<int> newIds(elementCnt, -1);
+        int next = 0;
+        for (const std::vector<int> *indices : indexBuffers)
+        {
+            for (int i : *indices)
+            {
+                if (newIds[i] < 0)
+                    newIds[i] = next++;
+            }
+        }
+        for (int& id : newIds)
+        {
+            if (id < 0)
+                id = next++;
+        }
+        return newIds;
+    };
+    auto apply = [](const std::vector<int>& newIds, auto& elements)
+    {
+        std::remove_reference_t<decltype(elements)> sorted(elements.size());
+        for (int i = 0; i < (int)elements.size(); ++i)
+            sorted[newIds[i]] = elements[i];
+        elements = std::move(sorted);
+    };
+    auto reindex = [](const std::vector<int>& newIds, std::vector<int>& indices)
+    {
+        for (int& i : indices)
+            i = newIds[i];
+    };
+    auto reindexEdges = [](const std::vector<int>& newIds, std::vector<Edge>& edges)
+    {
+        for (Edge& edge : edges)
+        {
+            edge.v0 = newIds[edge.v0];
+            edge.v1 = newIds[edge.v1];
+        }
+    };
+
+    std::vector<const std::vector<int>*> vertBuffers{&vertIndices};
+    for (const Lod& lod : lods)
+        vertBuffers.push_back(&lod.vertIndices);
+    std::vector<int> newIds = remap(vertBuffers, (int)verts.size());
+    apply(newIds, verts);
+    if (colors.size() == verts.size())
+        apply(newIds, colors);
+    reindex(newIds, vertIndices);
+    reindexEdges(newIds, edges);
+    for (Lod& lod : lods)
+    {
+        reindex(newIds, lod.vertIndices);
+        reindexEdges(newIds, lod.edges);
+    }
+
+    // Only when they're per corner, the constructor can fill normals per tri
+    if (uvIndices.size() == vertIndices.size())
+    {
+        std::vector<const std::vector<int>*> uvBuffers{&uvIndices};
+        for (const Lod& lod : lods)
+            uvBuffers.push_back(&lod.uvIndices);
+        newIds = remap(uvBuffers, (int)texCoords.size());
+        apply(newIds, texCoords);
+        reindex(newIds, uvIndices);
+        for (Lod& lod : lods)
+            reindex(newIds, lod.uvIndices);
+    }
+    if (nIndices.size() == vertIndices.size())
+    {
+        std::vector<const std::vector<int>*> nBuffers{&nIndices};
+        for (const Lod& lod : lods)
+            nBuffers.push_back(&lod.nIndices);
+        newIds = remap(nBuffers, (int)normals.size());
+        apply(newIds, normals);
+        reindex(newIds, nIndices);
+        for (Lod& lod : lods)
+            reindex(newIds, lod.nIndices);
+    }
+}
+
+float Model::ComputeACMR(const std::vector<int>& indices, int cacheSize)
+{
+    if (indices.empty())
+        return 0.0f;
+
+    std::vector<int> cache;
+    int misses = 0;
+    for (int i : indices)
+    {
+        if (std::find(cache.begin(), cache.end(), i) != cache.end())
+            continue;
+        ++misses;
+        cache.push_back(i);
+        if ((int)cache.size() > cacheSize)
+            cache.erase(cache.begin());
+    }
+    return misses / (indices.size() / 3.0f);
+}
+
+void Model::BuildLods(int maxLevels, bool keepSeams)
+{
+    lods.clear();
+
+    Simplifier simplifier(*this, keepSeams);
+    int prevTris = simplifier.GetTriCount();
+    for (int level = 0; level < maxLevels; ++level)
+    {
+        const int target = prevTris / 2;
+        if (target < kMinLodTris)
+            break;
+
+        // A level that can't get close to its target is still kept if it saves a good share of tris
+        bool reached = simplifier.CollapseTo(target);
+        if (!reached && simplifier.GetTriCount() > prevTris * 3 / 4)
+            break;
+
+        Lod lod;
+        simplifier.Snapshot(lod);
+        SplitClusters(verts, bounds, lod.vertIndices, lod.uvIndices, lod.nIndices, lod.clusters);
+        BuildEdges(lod.vertIndices, lod.edges);
+        lods.push_back(std::move(lod));
+        prevTris = simplifier.GetTriCount();
+
+        if (!reached)
+            break;
+    }
+}
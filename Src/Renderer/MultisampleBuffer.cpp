@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "Renderer/MultisampleBuffer.h"
+
+namespace
+{
+    // @brief Standard D3D sample positions, in 1/16 of a pixel from the center
+    const int g_samples2[2][2] = {{4, 4}, {-4, -4}};
+    const int g_samples4[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+    const int g_samples8[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+}
+
+void MultisampleBuffer::Init(int samples, int w, int h)
+{
+    assert((samples == 2 || samples == 4 || samples == 8) && "Uh oh, only 2, 4 or 8 samples are supported!");
+    m_samples = samples;
+    m_fullMask = (1 << samples) - 1;
+    m_pixelCnt = w * h;
+    m_depth.assign((size_t)m_pixelCnt * samples, 0.0f);
+    m_colors.assign((size_t)m_pixelCnt * samples, 0);
+    m_isEdge.assign(m_pixelCnt, 0);
+}
+
+int MultisampleBuffer::GetSampleCount() const { return m_samples; }
+
+Vec2f MultisampleBuffer::GetSampleOffset(int s) const
+{
+    assert(s >= 0 && s < m_samples && "Uh oh, sample is out of range!");
+    const int *offset = (m_samples == 2) ? g_samples2[s] : (m_samples == 4) ? g_samples4[s] : g_samples8[s];
+    return Vec2f{offset[0] / 16.0f, offset[1] / 16.0f};
+}
+
+float *MultisampleBuffer::GetDepth(int s) { return m_depth.data() + (size_t)s * m_pixelCnt; }
+
+void MultisampleBuffer::Clear()
+{
+    std::fill(m_depth.begin(), m_depth.end(), 0.0f);
+    std::fill(m_isEdge.begin(), m_isEdge.end(), 0);
+}
+
+void MultisampleBuffer::Resolve(uint32_t *pixels) const
+{
+    const uint32_t half = (uint32_t)m_samples / 2;
+    for (int i = 0; i < m_pixelCnt; ++i)
+    {
+        // Most of the frame isn't on an edge, skip 8 flags at a time
+        if ((i & 7) == 0 && i + 8 <= m_pixelCnt)
+        {
+            uint64_t flags;
+            memcpy(&flags, m_isEdge.data() + i, sizeof(flags));
+            if (flags == 0)
+            {
+                i += 7;
+                continue;
+            }
+        }
+        if (!m_isEdge[i])
+            continue;
+
+        const uint32_t *colors = m_colors.data() + (size_t)i * m_samples;
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            uint32_t sum = half;
+            for (int s = 0; s < m_samples; ++s)
+                sum += (colors[s] >> shift) & 0xff;
+            result |= (sum / m_samples) << shift;
+        }
+        pixels[i] = result;
+    }
+}
+
+int MultisampleBuffer::CountEdgePixels() const
+{
+    return (int)std::count(m_isEdge.begin(), m_isEdge.end(), 1);
+}
@@ -22,6 +22,30 @@ namespace OBJ
         }
 
         ifs.close();
+
+        // The renderer treats Cross(p2 - p0, p1 - p0) as the front of a face. If most of the vert
+        // normals disagree with it (the bundled assets do), flip them so that lighting matches.
+        if (!mesh.nIndices.empty() && mesh.nIndices.size() == mesh.vertIndices.size())
+        {
+            int agreeCnt = 0;
+            for (int i = 0; i < mesh.vertIndices.size(); i += 3)
+            {
+                const Vec3f& p0 = mesh.verts[mesh.vertIndices[i]];
+                const Vec3f& p1 = mesh.verts[mesh.vertIndices[i + 1]];
+                const Vec3f& p2 = mesh.verts[mesh.vertIndices[i + 2]];
+                Vec3f n = mesh.normals[mesh.nIndices[i]] + mesh.normals[mesh.nIndices[i + 1]] + mesh.normals[mesh.nIndices[i + 2]];
+                agreeCnt += (Math::Dot(Math::Cross(p2 - p0, p1 - p0), n) >= 0.0f) ? 1 : -1;
+            }
+
+            if (agreeCnt < 0)
+            {
+                for (auto& n : mesh.normals)
+                    n = -n;
+            }
+        }
+
+        mesh.BuildClusters();
+        mesh.ReorderVertices();
         return mesh;
     }
 
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Math/SIMD.h"
+#include "Renderer/Model.h"
+#include "Renderer/OcclusionBuffer.h"
+
+OcclusionBuffer::OcclusionBuffer() : m_depth(kW * kH, 0.0f) {}
+
+void OcclusionBuffer::Clear() { std::fill(m_depth.begin(), m_depth.end(), 0.0f); }
+
+void OcclusionBuffer::Rasterize(const Model& model, const Mat44f& mvp)
+{
+    Math::ToSoA(model.verts, m_objectPos);
+    Math::TransformPositions(m_objectPos, mvp, m_clipPos);
+
+    const int triCnt = (int)model.vertIndices.size() / 3;
+    m_raster.resize(triCnt * 3);
+    m_triFlags.assign(triCnt, 0);
+    for (int t = 0; t < triCnt; ++t)
+    {
+        Vec3f *raster = &m_raster[t * 3];
+        bool inFront = true;
+        for (int k = 0; k < 3; ++k)
+        {
+            Vec4f c = m_clipPos.Get(model.vertIndices[t * 3 + k]);
+            if (c.z < 0.0f)
+            {
+                inFront = false;
+                break;
+            }
+            float oneOverW = 1.0f / c.w;
+            raster[k] = Vec3f{(c.x * oneOverW + 1.0f) * (kW / 2.0f), (c.y * oneOverW + 1.0f) * (kH / 2.0f), oneOverW};
+        }
+
+        // Same sign as Rasterizer::ComputeEdge(), back faces and tris with no area are skipped
+        if (inFront && (raster[2].x - raster[0].x) * (raster[1].y - raster[0].y) - (raster[2].y - raster[0].y) * (raster[1].x - raster[0].x) > 0.0f)
+            m_triFlags[t] = kDrawn;
+    }
+
+    // An edge between 2 drawn tris isn't a silhouette, the texels it crosses are covered by the 2
+    // of them together. Only the silhouette edges need to be inset, or every such texel would be a
+    // hole. Models without edges (see Model::BuildClusters()) have all of their edges inset.
+    for (const Edge& edge : model.edges)
+    {
+        if (edge.tri1 < 0 || !(m_triFlags[edge.tri0] & kDrawn) || !(m_triFlags[edge.tri1] & kDrawn))
+            continue;
+        for (int t : {edge.tri0, edge.tri1})
+        {
+            // Edge k is opposite to vert k
+            for (int k = 0; k < 3; ++k)
+            {
+                const int p = model.vertIndices[t * 3 + (k + 1) % 3];
+                const int q = model.vertIndices[t * 3 + (k + 2) % 3];
+                if ((p == edge.v0 && q == edge.v1) || (p == edge.v1 && q == edge.v0))
+                    m_triFlags[t] |= 1 << k;
+            }
+        }
+    }
+
+    for (int t = 0; t < triCnt; ++t)
+    {
+        if (m_triFlags[t] & kDrawn)
+            RasterizeTri(m_raster[t * 3], m_raster[t * 3 + 1], m_raster[t * 3 + 2], m_triFlags[t]);
+    }
+}
+
+void OcclusionBuffer::RasterizeTri(const Vec3f& v0, const Vec3f& v1, const Vec3f& v2, int sharedEdges)
+{
+    float area = (v2.x - v0.x) * (v1.y - v0.y) - (v2.y - v0.y) * (v1.x - v0.x);
+    if (!(area > 0.0f))
+        return;
+
+    // @note Clamped before the cast, verts close to the near plane can be very far off screen
+    int minX = (int)std::ceil(std::max(0.0f, std::min(v0.x, std::min(v1.x, v2.x))));
+    int minY = (int)std::ceil(std::max(0.0f, std::min(v0.y, std::min(v1.y, v2.y))));
+    int maxX = (int)std::floor(std::min(kW - 1.0f, std::max(v0.x, std::max(v1.x, v2.x))));
+    int maxY = (int)std::floor(std::min(kH - 1.0f, std::max(v0.y, std::max(v1.y, v2.y))));
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // Edges as e(x, y) = a * x + b * y + c, (+) inside. Edge i is opposite to vert i.
+    const Vec3f *edges[3][2] = {{&v1, &v2}, {&v2, &v0}, {&v0, &v1}};
+    const float z[3] = {v0.z, v1.z, v2.z};
+    float a[3], b[3], c[3];
+    float dzdx = 0.0f, dzdy = 0.0f, z0 = 0.0f;
+    for (int i = 0; i < 3; ++i)
+    {
+        const Vec3f& p = *edges[i][0];
+        const Vec3f& q = *edges[i][1];
+        a[i] = q.y - p.y;
+        b[i] = p.x - q.x;
+        c[i] = -(p.x * a[i] + p.y * b[i]);
+        dzdx += a[i] * z[i];
+        dzdy += b[i] * z[i];
+        z0 += c[i] * z[i];
+    }
+    const float invArea = 1.0f / area;
+    dzdx *= invArea;
+    dzdy *= invArea;
+    z0 *= invArea;
+
+    // Only texels fully covered by the tri are written, a texel that is partly covered would hide
+    // what shows past the silhouette. Each edge is tested at the corner of the texel furthest inside
+    // of it, half a texel away from the center along both axes. Shared edges are tested at the
+    // center, the tri on the other side covers the rest.
+    float inset[3];
+    for (int i = 0; i < 3; ++i)
+        inset[i] = (sharedEdges & (1 << i)) ? 0.0f : 0.5f * (std::abs(a[i]) + std::abs(b[i]));
+
+    // The plane's furthest value over a texel is at one of its corners. Those are inside the tri
+    // except past a shared edge, where the plane is only continued over a fraction of a texel.
+    const float zOffset = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+    const float minZ = std::min(v0.z, std::min(v1.z, v2.z));
+
+    // Rows are walked 4 texels at a time from a multiple of 4, kW is one too so it stays in the row
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float *row = m_depth.data() + y * kW;
+        float ey[3] = {b[0] * y + c[0] - inset[0], b[1] * y + c[1] - inset[1], b[2] * y + c[2] - inset[2]};
+        float zy = dzdy * y + z0 - zOffset;
+        for (int x = minX & ~3; x <= maxX; x += 4)
+        {
+#if defined(QR_SIMD_SSE)
+            const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+            const __m128 zero = _mm_setzero_ps();
+            __m128 mask = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), _mm_set1_ps(ey[0])), zero);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), _mm_set1_ps(ey[1])), zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), _mm_set1_ps(ey[2])), zero));
+            __m128 depth = _mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(zy)), _mm_set1_ps(minZ));
+
+            // minZ > 0, so the masked out lanes (0) never win
+            _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), _mm_and_ps(mask, depth)));
+#else
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                const float px = (float)(x + lane);
+                if (a[0] * px + ey[0] >= 0.0f && a[1] * px + ey[1] >= 0.0f && a[2] * px + ey[2] >= 0.0f)
+                    row[x + lane] = std::max(row[x + lane], std::max(dzdx * px + zy, minZ));
+            }
+#endif
+        }
+    }
+}
+
+bool OcclusionBuffer::IsOccluded(const Bounds& bounds, const Mat44f& mvp) const
+{
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    float nearest = 0.0f;
+    for (int i = 0; i < 8; ++i)
+    {
+        Vec4f corner{(i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y,
+            (i & 4) ? bounds.max.z : bounds.min.z, 1.0f};
+        Vec4f c = Math::MultiplyVecMat(corner, mvp);
+        if (c.z < 0.0f)
+            return false;
+
+        float oneOverW = 1.0f / c.w;
+        float x = (c.x * oneOverW + 1.0f) * (kW / 2.0f);
+        float y = (c.y * oneOverW + 1.0f) * (kH / 2.0f);
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+        nearest = std::max(nearest, oneOverW);
+    }
+
+    // Every texel the box overlaps, texel (x, y) spans [x - 0.5, x + 0.5]
+    int x0 = (int)std::floor(std::max(0.0f, minX + 0.5f));
+    int y0 = (int)std::floor(std::max(0.0f, minY + 0.5f));
+    int x1 = (int)std::floor(std::min(kW - 1.0f, maxX + 0.5f));
+    int y1 = (int)std::floor(std::min(kH - 1.0f, maxY + 0.5f));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float *row = m_depth.data() + y * kW;
+        for (int x = x0; x <= x1; ++x)
+        {
+            if (row[x] <= nearest)
+                return false;
+        }
+    }
+    return true;
+}
+
+const std::vector<float>& OcclusionBuffer::GetDepth() const { return m_depth; }
@@ -1,15 +1,30 @@
 #include "SDL.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <cassert>
+#include <limits>
 #include <string>
 #include <sstream>  // To use stringstream
+#include <thread>
 #include <utility>
 
 #include "Renderer/QRenderer.h"
 #include "Renderer/Model.h"
 #include "Renderer/Texture.h"
 
+QRenderer::~QRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_workerMutex};
+        m_workersStopping = true;
+    }
+    m_batchQueued.notify_all();
+    for (const auto& worker : m_workers)
+        worker->thread.join();
+}
+
 bool QRenderer::Init(SDL_Window *window, int w, int h)
 {
     m_renderer.reset(SDL_CreateRenderer(window, -1, 0));
@@ -19,9 +34,6 @@ bool QRenderer::Init(SDL_Window *window, int w, int h)
         return false;
     }
 
-    m_w = w;
-    m_h = h;
-
     m_bitmap.reset(SDL_CreateTexture(
         m_renderer.get(), SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, w, h));
     if (!m_bitmap)
@@ -30,56 +42,513 @@ bool QRenderer::Init(SDL_Window *window, int w, int h)
         return false;
     }
 
+    return Init(w, h);
+}
+
+bool QRenderer::Init(int w, int h)
+{
+    m_w = w;
+    m_h = h;
     m_pixels = std::vector<uint32_t>(m_w * m_h, 0);
     m_zBuffer = std::vector<float>(m_w * m_h, 0.0f);
+    m_rasterizer.SetLights(m_lights, m_viewMat);
+    m_oit.Init(w, h);
+    m_hasTransparency = false;
+    SetMultisampling(m_samples);
 
     return true;
 }
 
-void QRenderer::Render(const Model& model, QRendererMode drawMode)
+void QRenderer::Render(const Model& model, const Mat44f& modelMat, QRendererMode drawMode)
+{
+    PrepareShadows();
+    Mat44f modelViewMat = modelMat * m_viewMat;
+    if (IsCulled(model, modelViewMat * m_projMat))
+        return;
+    m_rasterizer.Rasterize(m_pixels.data(), m_zBuffer.data(), m_w, m_h, model, modelViewMat, m_projMat, drawMode, SelectLod(model, modelViewMat));
+}
+
+void QRenderer::Render(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, QRendererMode drawMode)
+{
+    // @note Before the texture is locked
+    PrepareShadows();
+    Mat44f modelViewMat = modelMat * m_viewMat;
+    if (IsCulled(model, modelViewMat * m_projMat))
+        return;
+    m_rasterizer.Rasterize(m_pixels.data(), m_zBuffer.data(), texture.get(), m_w, m_h, model, modelViewMat, m_projMat, drawMode, SelectLod(model, modelViewMat));
+}
+
+void QRenderer::RenderTransparent(const Model& model, const Mat44f& modelMat, float opacity, QRendererMode drawMode)
+{
+    PrepareShadows();
+    Mat44f modelViewMat = modelMat * m_viewMat;
+    if (IsCulled(model, modelViewMat * m_projMat))
+        return;
+    m_hasTransparency = true;
+    m_rasterizer.SetTransparency(&m_oit, opacity);
+    m_rasterizer.Rasterize(m_pixels.data(), m_zBuffer.data(), m_w, m_h, model, modelViewMat, m_projMat, drawMode, SelectLod(model, modelViewMat));
+    m_rasterizer.SetTransparency(nullptr);
+}
+
+void QRenderer::RenderTransparent(const Model& model, const Mat44f& modelMat, std::shared_ptr<QTexture> texture, float opacity, QRendererMode drawMode)
+{
+    PrepareShadows();
+    Mat44f modelViewMat = modelMat * m_viewMat;
+    if (IsCulled(model, modelViewMat * m_projMat))
+        return;
+    m_hasTransparency = true;
+    m_rasterizer.SetTransparency(&m_oit, opacity);
+    m_rasterizer.Rasterize(m_pixels.data(), m_zBuffer.data(), texture.get(), m_w, m_h, model, modelViewMat, m_projMat, drawMode, SelectLod(model, modelViewMat));
+    m_rasterizer.SetTransparency(nullptr);
+}
+
+namespace
+{
+    // @brief Fewer instances than that per worker aren't worth a thread
+    constexpr int kMinInstancesPerWorker = 4;
+    constexpr int kMaxInstanceWorkers = 8;
+
+    // @brief Grow the pixel rect [x0, x1] x [y0, y1] of a w x h screen to what the box of bounds can
+    // cover, with a pixel of margin. A box crossing the near plane can cover all of it.
+    void GrowScreenRect(const Bounds& bounds, const Mat44f& mvp, int w, int h, int& x0, int& y0, int& x1, int& y1)
+    {
+        float minX = std::numeric_limits<float>::max();
+        float minY = std::numeric_limits<float>::max();
+        float maxX = -std::numeric_limits<float>::max();
+        float maxY = -std::numeric_limits<float>::max();
+        for (int i = 0; i < 8; ++i)
+        {
+            Vec4f corner{(i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y,
+                (i & 4) ? bounds.max.z : bounds.min.z, 1.0f};
+            Vec4f c = Math::MultiplyVecMat(corner, mvp);
+            if (c.z < 0.0f || !(c.w > 0.0f))
+            {
+                x0 = 0, y0 = 0, x1 = w - 1, y1 = h - 1;
+                return;
+            }
+
+            // Same raster space as the rasterizer
+            float oneOverW = 1.0f / c.w;
+            float x = (c.x * oneOverW + 1.0f) * (w / 2.0f);
+            float y = (c.y * oneOverW + 1.0f) * (h / 2.0f);
+            minX = std::min(minX, x);
+            minY = std::min(minY, y);
+            maxX = std::max(maxX, x);
+            maxY = std::max(maxY, y);
+        }
+        x0 = std::min(x0, (int)std::max(0.0f, std::floor(minX) - 1.0f));
+        y0 = std::min(y0, (int)std::max(0.0f, std::floor(minY) - 1.0f));
+        x1 = std::max(x1, (int)std::min(w - 1.0f, std::ceil(maxX) + 1.0f));
+        y1 = std::max(y1, (int)std::min(h - 1.0f, std::ceil(maxY) + 1.0f));
+    }
+}
+
+void QRenderer::RenderInstanced(const Model& model, const std::vector<Instance>& instances, QRendererMode drawMode)
+{
+    RenderInstanced(model, instances, {}, drawMode);
+}
+
+void QRenderer::RenderInstanced(const Model& model, const std::vector<Instance>& instances,
+    const std::vector<std::shared_ptr<QTexture>>& textures, QRendererMode drawMode)
+{
+    // Culled on this thread, it's cheap and it's where the occluders and the counts are
+    PrepareShadows();
+    m_visibleInstances.clear();
+    for (int i = 0; i < (int)instances.size(); ++i)
+    {
+        assert(instances[i].textureIndex < (int)textures.size() && "Uh oh, instance texture is out of range!");
+        if (!IsCulled(model, instances[i].modelMat * m_viewMat * m_projMat))
+            m_visibleInstances.push_back(i);
+    }
+    const int count = (int)m_visibleInstances.size();
+    if (count == 0)
+        return;
+
+    int workerCnt = 1;
+    if (drawMode != QRendererMode::kWireframe && m_samples == 1)
+    {
+        int threadCnt = m_instanceThreads > 0 ? m_instanceThreads : std::min((int)std::thread::hardware_concurrency(), kMaxInstanceWorkers);
+        workerCnt = std::max(1, std::min(threadCnt, count / kMinInstancesPerWorker));
+    }
+    while ((int)m_workers.size() < workerCnt - 1)
+    {
+        m_workers.push_back(std::make_unique<InstanceWorker>());
+        InstanceWorker& worker = *m_workers.back();
+        worker.thread = std::thread{&QRenderer::WorkerLoop, this, std::ref(worker)};
+    }
+
+    // Locked once here, the workers only read them. Instances can share a texture through several
+    // shared_ptrs, each texture is only locked once.
+    m_instanceTextures.clear();
+    for (const auto& texture : textures)
+        m_instanceTextures.push_back(texture.get());
+    std::sort(m_instanceTextures.begin(), m_instanceTextures.end());
+    m_instanceTextures.erase(std::unique(m_instanceTextures.begin(), m_instanceTextures.end()), m_instanceTextures.end());
+    for (QTexture *texture : m_instanceTextures)
+        texture->LockTexture();
+
+    auto drawBatch = [this, &model, &instances, &textures, drawMode](Rasterizer& rasterizer, uint32_t *pixels, float *zBuffer, int first, int last)
+    {
+        for (int i = first; i < last; ++i)
+        {
+            const Instance& instance = instances[m_visibleInstances[i]];
+            const QTexture *texture = (instance.textureIndex >= 0) ? textures[instance.textureIndex].get() : nullptr;
+            Mat44f modelViewMat = instance.modelMat * m_viewMat;
+            rasterizer.RasterizeInstance(pixels, zBuffer, texture, m_w, m_h, model, modelViewMat, m_projMat, drawMode, instance.color,
+                SelectLod(model, modelViewMat));
+        }
+    };
+
+    // Batches are contiguous and in order, the first one draws straight into the frame on this
+    // thread. The workers only touch the rect of their instances, the rest of their buffers is
+    // stale.
+    {
+        std::lock_guard<std::mutex> lock{m_workerMutex};
+        for (int k = 1; k < workerCnt; ++k)
+        {
+            InstanceWorker& worker = *m_workers[k - 1];
+            worker.pixels.resize(m_w * m_h);
+            worker.zBuffer.resize(m_w * m_h);
+            worker.rasterizer.SetLights(m_lights, m_viewMat);
+            worker.rasterizer.SetTraversal(m_traversal);
+            worker.rasterizer.SetPixelCounting(m_pixelCounting);
+            worker.rasterizer.SetTextureFilter(m_textureFilter);
+            worker.rasterizer.SetShadowMap(m_shadowsEnabled ? &m_shadowMap : nullptr);
+            worker.rasterizer.ResetStats();
+            const int first = count * k / workerCnt;
+            const int last = count * (k + 1) / workerCnt;
+            worker.batch = [this, &worker, &model, &instances, &drawBatch, first, last]()
+            {
+                // Bounds are only there once Model::BuildClusters() was called
+                if (model.clusters.empty())
+                {
+                    worker.x0 = 0, worker.y0 = 0, worker.x1 = m_w - 1, worker.y1 = m_h - 1;
+                }
+                else
+                {
+                    worker.x0 = m_w, worker.y0 = m_h, worker.x1 = -1, worker.y1 = -1;
+                    for (int i = first; i < last; ++i)
+                    {
+                        const Mat44f mvp = instances[m_visibleInstances[i]].modelMat * m_viewMat * m_projMat;
+                        GrowScreenRect(model.bounds, mvp, m_w, m_h, worker.x0, worker.y0, worker.x1, worker.y1);
+                    }
+                }
+                for (int y = worker.y0; y <= worker.y1; ++y)
+                {
+                    std::fill_n(worker.pixels.begin() + worker.x0 + y * m_w, worker.x1 + 1 - worker.x0, 0);
+                    std::fill_n(worker.zBuffer.begin() + worker.x0 + y * m_w, worker.x1 + 1 - worker.x0, 0.0f);
+                }
+                drawBatch(worker.rasterizer, worker.pixels.data(), worker.zBuffer.data(), first, last);
+            };
+        }
+        m_busyWorkers = workerCnt - 1;
+    }
+    m_batchQueued.notify_all();
+
+    drawBatch(m_rasterizer, m_pixels.data(), m_zBuffer.data(), 0, count / workerCnt);
+    {
+        std::unique_lock<std::mutex> lock{m_workerMutex};
+        m_batchesDone.wait(lock, [this]() { return m_busyWorkers == 0; });
+    }
+
+    // Every worker is done with its batch, none of them reads the textures anymore
+    for (QTexture *texture : m_instanceTextures)
+        texture->UnlockTexture();
+
+    // Merged in batch order, and only when strictly nearer: that's what the depth test does when
+    // the instances are drawn one after the other
+    for (int k = 1; k < workerCnt; ++k)
+    {
+        const InstanceWorker& worker = *m_workers[k - 1];
+        for (int y = worker.y0; y <= worker.y1; ++y)
+        {
+            for (int i = worker.x0 + y * m_w; i <= worker.x1 + y * m_w; ++i)
+            {
+                if (worker.zBuffer[i] > m_zBuffer[i])
+                {
+                    m_zBuffer[i] = worker.zBuffer[i];
+                    m_pixels[i] = worker.pixels[i];
+                }
+            }
+        }
+        m_rasterizer.AddStats(worker.rasterizer.GetStats());
+    }
+}
+
+void QRenderer::WorkerLoop(InstanceWorker& worker)
+{
+    std::unique_lock<std::mutex> lock{m_workerMutex};
+    while (true)
+    {
+        m_batchQueued.wait(lock, [this, &worker]() { return m_workersStopping || worker.batch; });
+        if (!worker.batch)
+            return;
+        std::function<void()> batch = std::move(worker.batch);
+        worker.batch = nullptr;
+        lock.unlock();
+        batch();
+
+        // The batch refers to the draw, which ends once the last worker is done
+        batch = nullptr;
+        lock.lock();
+        if (--m_busyWorkers == 0)
+            m_batchesDone.notify_all();
+    }
+}
+
+void QRenderer::Execute(const CommandBuffer& commands)
+{
+    // Every opaque draw casts, culled or not, since it can be in the light of what's on screen
+    if (m_shadowsEnabled)
+    {
+        for (const DrawCommand& command : commands.GetCommands())
+        {
+            if (!command.isTransparent)
+                RenderShadowCaster(*command.model, command.modelMat);
+        }
+    }
+
+    m_sortedDraws.clear();
+    for (const DrawCommand& command : commands.GetCommands())
+    {
+        Mat44f modelViewMat = command.modelMat * m_viewMat;
+        if (IsCulled(*command.model, modelViewMat * m_projMat))
+            continue;
+
+        // Distance along the view direction of the center of the bounds, the camera looks down -z
+        const Vec3f& center = command.model->bounds.center;
+        float depth = -Math::MultiplyVecMat(Vec4f{center.x, center.y, center.z, 1.0f}, modelViewMat).z;
+        m_sortedDraws.push_back(SortedDraw{&command, modelViewMat, depth, SelectLod(*command.model, modelViewMat)});
+    }
+
+    // Stable, so that draws with the same state and depth keep their recorded order. Transparent draws
+    // only need to come after the opaque ones, their order doesn't change the result.
+    std::stable_sort(m_sortedDraws.begin(), m_sortedDraws.end(), [](const SortedDraw& a, const SortedDraw& b)
+    {
+        if (a.command->isTransparent != b.command->isTransparent)
+            return b.command->isTransparent;
+        if (a.command->mode != b.command->mode)
+            return a.command->mode < b.command->mode;
+        if (a.command->texture != b.command->texture)
+            return a.command->texture < b.command->texture;
+        return a.depth < b.depth;
+    });
+
+    QTexture *locked = nullptr;
+    for (const SortedDraw& draw : m_sortedDraws)
+    {
+        QTexture *texture = draw.command->texture.get();
+        if (texture != locked)
+        {
+            if (locked)
+                locked->UnlockTexture();
+            if (texture)
+                texture->LockTexture();
+            locked = texture;
+        }
+        if (draw.command->isTransparent)
+        {
+            m_hasTransparency = true;
+            m_rasterizer.SetTransparency(&m_oit, draw.command->opacity);
+        }
+        m_rasterizer.RasterizeInstance(m_pixels.data(), m_zBuffer.data(), texture, m_w, m_h,
+            *draw.command->model, draw.modelViewMat, m_projMat, draw.command->mode, Vec3f{1.0f, 1.0f, 1.0f}, draw.lod);
+    }
+    if (locked)
+        locked->UnlockTexture();
+    m_rasterizer.SetTransparency(nullptr);
+}
+
+void QRenderer::RenderOccluder(const Model& model, const Mat44f& modelMat)
+{
+    if (m_occlusionCulling)
+        m_rasterizer.RasterizeOccluder(model, modelMat * m_viewMat * m_projMat);
+}
+
+void QRenderer::RenderShadowCaster(const Model& model, const Mat44f& modelMat)
 {
-    m_rasterizer.Rasterize(m_pixels.data(), m_zBuffer.data(), m_w, m_h, model, m_projMat, drawMode);
+    PrepareShadows();
+    const int resolution = m_shadowMap.GetSettings().resolution;
+    for (int c = 0; c < ShadowMap::kMaxCascades; ++c)
+    {
+        if ((m_shadowRedraw >> c) & 1)
+            m_rasterizer.RasterizeDepth(m_shadowMap.GetDepth(c), resolution, resolution, model, modelMat * m_shadowMap.GetLightView(c), m_shadowMap.GetLightProj(c));
+    }
 }
 
-void QRenderer::Render(const Model& model, std::shared_ptr<QTexture> texture, QRendererMode drawMode)
+void QRenderer::PrepareShadows()
 {
-    m_rasterizer.Rasterize(m_pixels.data(), m_zBuffer.data(), texture.get(), m_w, m_h, model, m_projMat, drawMode);
+    if (!m_shadowsEnabled || m_shadowsPrepared)
+        return;
+    m_shadowsPrepared = true;
+    m_shadowRedraw = 0;
+
+    auto light = std::find_if(m_lights.begin(), m_lights.end(), [](const Light& l) { return l.type == LightType::kDirectional && l.castsShadows; });
+    if (light == m_lights.end())
+        return;
+
+    const ShadowSettings& settings = m_shadowMap.GetSettings();
+    const int moved = m_shadowMap.Fit(light->vec, m_viewMat, m_projMat);
+    m_shadowRedraw = (settings.isCached && !m_shadowsInvalid) ? moved : (1 << settings.cascadeCount) - 1;
+    m_shadowsInvalid = false;
+    m_shadowMap.Clear(m_shadowRedraw);
 }
 
+bool QRenderer::IsCulled(const Model& model, const Mat44f& mvp)
+{
+    // Bounds are only there once Model::BuildClusters() was called
+    if (model.clusters.empty())
+        return false;
+    if (m_rasterizer.IsOutsideFrustum(model.bounds, mvp))
+        return true;
+    return m_occlusionCulling && m_rasterizer.IsOccluded(model.bounds, mvp);
+}
+
+int QRenderer::SelectLod(const Model& model, const Mat44f& modelViewMat) const
+{
+    if (model.lods.empty() || m_lodErrorThreshold <= 0.0f)
+        return 0;
+
+    // Largest scale of modelViewMat, object space errors and radius grow by at most that much
+    float scaleSqr = 0.0f;
+    for (int i = 0; i < 3; ++i)
+        scaleSqr = std::max(scaleSqr, modelViewMat(i, 0) * modelViewMat(i, 0) + modelViewMat(i, 1) * modelViewMat(i, 1) + modelViewMat(i, 2) * modelViewMat(i, 2));
+    const float scale = std::sqrt(scaleSqr);
+
+    // Nearest point of the bounding sphere along the view direction, the camera looks down -z
+    const Vec3f& center = model.bounds.center;
+    float distance = -Math::MultiplyVecMat(Vec4f{center.x, center.y, center.z, 1.0f}, modelViewMat).z - model.bounds.radius * scale;
+    if (distance <= 0.0f)
+        return 0;
+
+    // Pixels per unit of view space at that distance
+    const float pixelsPerUnit = m_projMat(1, 1) * m_h * 0.5f / distance;
+    int lod = 0;
+    for (int i = 0; i < (int)model.lods.size(); ++i)
+    {
+        if (model.lods[i].error * scale * pixelsPerUnit > m_lodErrorThreshold)
+            break;
+        lod = i + 1;
+    }
+    return lod;
+}
 
 void QRenderer::SwapBuffers()
 {
+    Resolve();
     SDL_UpdateTexture(m_bitmap.get(), nullptr, reinterpret_cast<const void*>(m_pixels.data()), m_w * 4);
     SDL_RenderCopyEx(m_renderer.get(), m_bitmap.get(), nullptr, nullptr, 0, nullptr, SDL_FLIP_VERTICAL);
     SDL_RenderPresent(m_renderer.get());
+    ClearBuffers();
+}
+
+void QRenderer::ClearBuffers()
+{
     std::fill(m_pixels.begin(), m_pixels.end(), 0);
     std::fill(m_zBuffer.begin(), m_zBuffer.end(), 0.0f);
+    if (m_samples > 1)
+        m_msaa.Clear();
+    if (m_hasTransparency)
+    {
+        m_oit.Clear();
+        m_hasTransparency = false;
+    }
+    m_rasterizer.ClearOccluders();
+    m_shadowsPrepared = false;
 }
 
-void QRenderer::SetProjectionMatrix(Mat44f m) { m_projMat = std::move(m); }
+void QRenderer::SetProjectionMatrix(Mat44f m)
+{
+    m_projMat = std::move(m);
+    m_shadowsPrepared = false;
+}
 
-Mat44f QRenderer::LookAt(const Vec3f& eye, const Vec3f& at, const Vec3f& up)
+void QRenderer::SetViewMatrix(Mat44f m)
 {
-    Vec3f camForward = Math::Normal(eye - at);
-    Vec3f camRight = Math::Normal(Math::Cross(up, camForward));
-    Vec3f camUp = Cross(camForward, camRight);
+    m_viewMat = std::move(m);
+    m_rasterizer.SetLights(m_lights, m_viewMat);
+    m_shadowsPrepared = false;
+}
 
-    Mat44f viewMat{};
-    for (int i = 0; i < 3; ++i)
+void QRenderer::SetLights(std::vector<Light> lights)
+{
+    m_lights = std::move(lights);
+    m_rasterizer.SetLights(m_lights, m_viewMat);
+    m_shadowsPrepared = false;
+}
+
+void QRenderer::SetInstanceThreads(int count) { m_instanceThreads = count; }
+
+void QRenderer::SetOcclusionCulling(bool enable) { m_occlusionCulling = enable; }
+
+void QRenderer::SetShadows(bool enable, const ShadowSettings& settings)
+{
+    m_shadowsEnabled = enable;
+    if (enable)
+        m_shadowMap.Init(settings);
+    m_shadowsPrepared = false;
+    m_shadowsInvalid = true;
+    m_shadowRedraw = 0;
+    m_rasterizer.SetShadowMap(enable ? &m_shadowMap : nullptr);
+}
+
+void QRenderer::InvalidateShadows() { m_shadowsInvalid = true; }
+
+void QRenderer::SetLodErrorThreshold(float pixels) { m_lodErrorThreshold = pixels; }
+
+void QRenderer::SetRasterTraversal(RasterTraversal traversal)
+{
+    m_traversal = traversal;
+    m_rasterizer.SetTraversal(traversal);
+}
+
+void QRenderer::SetPixelCounting(bool enable)
+{
+    m_pixelCounting = enable;
+    m_rasterizer.SetPixelCounting(enable);
+}
+
+void QRenderer::SetTextureFilter(TextureFilter filter)
+{
+    m_textureFilter = filter;
+    m_rasterizer.SetTextureFilter(filter);
+}
+
+void QRenderer::SetWireframeDepthTest(bool enable)
+{
+    m_rasterizer.SetLineDepthTest(enable);
+}
+
+void QRenderer::SetMultisampling(int samples)
+{
+    m_samples = samples;
+    if (samples > 1)
     {
-        // Inverse of orthonormal is transpose
-        viewMat(i, 0) = camRight[i];
-        viewMat(i, 1) = camUp[i];
-        viewMat(i, 2) = camForward[i];
+        m_msaa.Init(samples, m_w, m_h);
+        m_rasterizer.SetMultisampleBuffer(&m_msaa);
     }
+    else
+        m_rasterizer.SetMultisampleBuffer(nullptr);
+}
 
-    // Cam matrix is translation from origin to eye, so inverse is negation, coupled with (RT)^-1 =
-    // T^-1 R^-1, we must also dot by R parts
-    viewMat(3, 0) = -Math::Dot(camRight, eye);
-    viewMat(3, 1) = -Math::Dot(camUp, eye);
-    viewMat(3, 2) = -Math::Dot(camForward, eye);
+void QRenderer::Resolve()
+{
+    if (m_samples > 1)
+        m_msaa.Resolve(m_pixels.data());
+    if (m_hasTransparency)
+    {
+        m_oit.Resolve(m_pixels.data());
+        m_hasTransparency = false;
+    }
+}
+
+const RasterStats& QRenderer::GetStats() const { return m_rasterizer.GetStats(); }
 
-    return viewMat;
+void QRenderer::ResetStats() { m_rasterizer.ResetStats(); }
+
+Mat44f QRenderer::LookAt(const Vec3f& eye, const Vec3f& at, const Vec3f& up)
+{
+    return Math::InitLookAt(eye, at, up);
 }
 
 SDL_Renderer *QRenderer::GetRenderer()
@@ -87,3 +556,5 @@ SDL_Renderer *QRenderer::GetRenderer()
     return m_renderer.get();
 }
 
+const std::vector<uint32_t>& QRenderer::GetPixels() const { return m_pixels; }
+
@@ -1,415 +1,1539 @@
 #include <algorithm>
 #include <cassert>
-#include <deque>
+#include <climits>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
+#include "Math/SIMD.h"
 #include "Renderer/Model.h"
+#include "Renderer/MultisampleBuffer.h"
 #include "Renderer/Rasterizer.h"
 #include "Renderer/QRenderer.h"
+#include "Renderer/ShadowMap.h"
 #include "Renderer/Texture.h"
+#include "Renderer/TransparencyBuffer.h"
 #include "Renderer/Triangle.h"
 
-Vec3f debugColor;
+namespace
+{
+    // @brief Clipping planes in homogeneous clip space, a vert v is inside if Dot(plane, v) >= 0.
+    // @note z is in range [0, w], see Math::InitPersp()
+    enum Plane
+    {
+        kNear,
+        kTop,
+        kRight,
+        kBottom,
+        kLeft,
+        kCount
+    };
+
+    const Vec4f g_clipPlanes[Plane::kCount] =
+    {
+        {0.0f, 0.0f, 1.0f, 0.0f},       // z >= 0
+        {0.0f, -1.0f, 0.0f, 1.0f},      // y <= w
+        {-1.0f, 0.0f, 0.0f, 1.0f},      // x <= w
+        {0.0f, 1.0f, 0.0f, 1.0f},       // y >= -w
+        {1.0f, 0.0f, 0.0f, 1.0f},       // x >= -w
+    };
+
+    Vec3f ToVec3(const Vec4f& v) { return Vec3f{v.x, v.y, v.z}; }
+
+    // @brief Same sign as Rasterizer::ComputeEdge() of the tri once in raster space, i.e. (+) if it
+    // faces the camera. Computed from the x, y, w of the verts in clip space (the 2D homogeneous
+    // determinant), so it's valid before clipping, even for verts behind the camera.
+    float HomogeneousArea(const Vec4f& c0, const Vec4f& c1, const Vec4f& c2)
+    {
+        return -(c0.x * (c1.y * c2.w - c2.y * c1.w) - c0.y * (c1.x * c2.w - c2.x * c1.w) + c0.w * (c1.x * c2.y - c2.x * c1.y));
+    }
+
+    // @brief Liang-Barsky in clip space, the ends of the line c0-c1 that are outside of the planes in
+    // clipMask are moved onto them
+    // @return false if no part of the line is inside
+    bool ClipLine(uint8_t clipMask, Vec4f& c0, Vec4f& c1)
+    {
+        float t0 = 0.0f;
+        float t1 = 1.0f;
+        for (int p = Plane::kNear; p != Plane::kCount; ++p)
+        {
+            if (!(clipMask & (1 << p)))
+                continue;
+            const float d0 = Math::Dot(g_clipPlanes[p], c0);
+            const float d1 = Math::Dot(g_clipPlanes[p], c1);
+            if (d0 < 0.0f && d1 < 0.0f)
+                return false;
+            if (d0 < 0.0f)
+                t0 = std::max(t0, d0 / (d0 - d1));
+            else if (d1 < 0.0f)
+                t1 = std::min(t1, d0 / (d0 - d1));
+        }
+        if (t0 > t1)
+            return false;
+
+        const Vec4f d = c1 - c0;
+        if (t1 < 1.0f)
+            c1 = c0 + d * t1;
+        if (t0 > 0.0f)
+            c0 = c0 + d * t0;
+        return true;
+    }
+
+    // @brief Move the clipping planes to object space, so that Dot(plane, v * mvp) = Dot(outPlane, v)
+    void ToObjectSpace(const Mat44f& mvp, Vec4f (&outPlanes)[Plane::kCount])
+    {
+        for (int p = 0; p < Plane::kCount; ++p)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                outPlanes[p][i] = mvp(i, 0) * g_clipPlanes[p].x + mvp(i, 1) * g_clipPlanes[p].y +
+                    mvp(i, 2) * g_clipPlanes[p].z + mvp(i, 3) * g_clipPlanes[p].w;
+            }
+        }
+    }
 
-void Rasterizer::Rasterize(uint32_t *pixels, float *zBuffer, int w, int h, const Model& model, const Mat44f& projMat, QRendererMode mode)
+    // @brief The bounding sphere is entirely outside of one of the planes
+    bool IsOutside(const Bounds& bounds, const Vec4f (&planes)[Plane::kCount])
+    {
+        for (const Vec4f& plane : planes)
+        {
+            Vec3f n{plane.x, plane.y, plane.z};
+            if (Math::Dot(n, bounds.center) + plane.w < -bounds.radius * Math::Length(n))
+                return true;
+        }
+        return false;
+    }
+
+    // @brief Every tri of the cluster is back facing from eye (in object space), wherever it is in
+    // the bounding sphere
+    // @see https://zeux.io/2023/04/28/triangle-backface-culling/
+    bool IsBackFacing(const Cluster& cluster, const Vec3f& eye)
+    {
+        Vec3f toCenter = cluster.bounds.center - eye;
+        return Math::Dot(toCenter, cluster.coneAxis) >= cluster.coneCutoff * Math::Length(toCenter) + cluster.bounds.radius;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Pipeline stages. DrawTris() is instantiated per (vertex stage, fragment stage) pair, so the mode
+// is dispatched once per draw and the inner loops have no per pixel mode branches.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct Rasterizer::DrawContext
 {
-    assert(!model.verts.empty() && "Uh oh, model is empty!");
+    uint32_t *pixels;
+    float *zBuffer;
+    int w, h;
+    const Model& model;
+
+    // @brief Index buffers of the level of detail drawn, the model's own or one of its lods
+    const std::vector<int>& vertIndices;
+    const std::vector<int>& uvIndices;
+    const std::vector<int>& nIndices;
+    const std::vector<Cluster>& clusters;
+    const std::vector<Edge>& edges;
+
+    // @note nullptr when the draw isn't textured, locked otherwise
+    const QTexture *texture;
+
+    // @brief Multiplies the surface color, e.g. per instance
+    Vec3f tint;
+};
+
+// @brief Vertex stages. They fill the colors of a tri (and what later stages need) from the
+// surface color base. Lit colors are base * light.
+// @param i Index of the first corner of the tri in ctx.vertIndices
+// @param faceNormal, viewPos are in camera space
+struct Rasterizer::UnlitVertex
+{
+    static constexpr bool kNeedsVertNormals = false;
+    static constexpr bool kNeedsCornerLight = false;
+
+    static void Shade(const Rasterizer&, const DrawContext&, int, const Vec3f&, const Vec3f (&)[3], const Vec3f (&base)[3], Triangle& tri)
+    {
+        for (int k = 0; k < 3; ++k)
+            tri.colors[k] = base[k];
+    }
+};
+
+struct Rasterizer::FlatVertex
+{
+    static constexpr bool kNeedsVertNormals = false;
+    static constexpr bool kNeedsCornerLight = false;
+
+    // @brief Lit once at the centroid of the tri
+    static void Shade(const Rasterizer& r, const DrawContext&, int, const Vec3f& faceNormal, const Vec3f (&viewPos)[3], const Vec3f (&base)[3], Triangle& tri)
+    {
+        Vec3f lit = r.m_lights.Shade((viewPos[0] + viewPos[1] + viewPos[2]) * (1.0f / 3.0f), faceNormal);
+        for (int k = 0; k < 3; ++k)
+            tri.colors[k] = base[k] * lit;
+    }
+};
+
+struct Rasterizer::GouraudVertex
+{
+    static constexpr bool kNeedsVertNormals = true;
+    static constexpr bool kNeedsCornerLight = true;
+
+    // @brief The corners are already lit by ShadeCorners(). Falls back to flat without vert normals
+    static void Shade(const Rasterizer& r, const DrawContext& ctx, int i, const Vec3f& faceNormal, const Vec3f (&viewPos)[3], const Vec3f (&base)[3], Triangle& tri)
+    {
+        if (ctx.nIndices.empty())
+        {
+            FlatVertex::Shade(r, ctx, i, faceNormal, viewPos, base, tri);
+            return;
+        }
+
+        for (int k = 0; k < 3; ++k)
+            tri.colors[k] = base[k] * r.m_cornerLight[i + k];
+    }
+};
+
+struct Rasterizer::PhongVertex
+{
+    static constexpr bool kNeedsVertNormals = true;
+    static constexpr bool kNeedsCornerLight = false;
+
+    // @brief Only passes down what the fragment stage needs to light each pixel
+    static void Shade(const Rasterizer& r, const DrawContext& ctx, int i, const Vec3f& faceNormal, const Vec3f (&viewPos)[3], const Vec3f (&base)[3], Triangle& tri)
+    {
+        bool hasVertNormals = !ctx.nIndices.empty();
+        for (int k = 0; k < 3; ++k)
+        {
+            tri.colors[k] = base[k];
+            tri.viewPos[k] = viewPos[k];
+            tri.normals[k] = hasVertNormals ? ToVec3(r.m_viewNormals.Get(ctx.nIndices[i + k])) : faceNormal;
+        }
+    }
+};
+
+namespace
+{
+    // @brief A 2x2 block of pixels, the unit that is covered, depth tested and shaded. Lanes are
+    // 0 (x, y), 1 (x + 1, y), 2 (x, y + 1), 3 (x + 1, y + 1), one SSE register wide.
+    // Lanes that aren't covered (or fail the depth test) are helper lanes: they are still
+    // interpolated, so that derivatives exist for every quad, but they are never written.
+    struct Quad
+    {
+        int index[4];
+        int mask;               // Bit per lane that is written
+        uint8_t samples[4] = {};    // Bit per sample of each lane that passed, when multisampled
+        alignas(16) float oneOverW[4];
+        alignas(16) float b[3][4];   // Perspective correct barycentric coords
+
+        bool IsLive(int lane) const { return (mask >> lane) & 1; }
+
+        template<typename T>
+        T Interpolate(const T (&attr)[3], int lane) const
+        {
+            return attr[0] * b[0][lane] + attr[1] * b[1][lane] + attr[2] * b[2][lane];
+        }
+
+        // @brief Coarse derivatives, shared by the 4 lanes like on a GPU
+        template<typename T>
+        T Ddx(const T (&attr)[3]) const { return Interpolate(attr, 1) - Interpolate(attr, 0); }
+        template<typename T>
+        T Ddy(const T (&attr)[3]) const { return Interpolate(attr, 2) - Interpolate(attr, 0); }
+    };
+
+    // @brief What CoverQuad() needs of a tri in raster space, computed once per tri
+    struct QuadSetup
+    {
+        Vec3f v0, v1, v2;
+        float invArea;
+        float oneOverW0, oneOverW1, oneOverW2;
+        float stepX[3];                 // Change of each edge value from a quad to the next one in x
+        int minX, minY, maxX, maxY;     // Bounding box, clamped to the screen
+        float sampleReach;              // How far from the pixel centers the samples are, 0 if single sampled
+    };
+
+    // @brief Same float ops as Rasterizer::ComputeEdge(a, b, (x, y))
+    float Edge(const Vec3f& a, const Vec3f& b, float x, float y)
+    {
+        return (x - a.x) * (b.y - a.y) - (y - a.y) * (b.x - a.x);
+    }
+
+    // @brief Values of the 3 edge functions (e12, e20, e01) for the 4 lanes of a quad
+    struct QuadEdges
+    {
+        alignas(16) float e[3][4];
+    };
+
+    // @brief Evaluate the edges of the quad at (x, y) from scratch
+    // @note Every lane follows the exact same float ops as Rasterizer::ComputeEdge(), so coverage
+    // doesn't depend on which path is compiled.
+    void EvalEdges(const QuadSetup& s, int x, int y, QuadEdges& out)
+    {
+        const Vec3f *edges[3][2] = {{&s.v1, &s.v2}, {&s.v2, &s.v0}, {&s.v0, &s.v1}};
+#if defined(QR_SIMD_SSE)
+        const __m128 px = _mm_setr_ps((float)x, (float)(x + 1), (float)x, (float)(x + 1));
+        const __m128 py = _mm_setr_ps((float)y, (float)y, (float)(y + 1), (float)(y + 1));
+        for (int i = 0; i < 3; ++i)
+        {
+            const Vec3f& a = *edges[i][0];
+            const Vec3f& b = *edges[i][1];
+            _mm_store_ps(out.e[i], _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(px, _mm_set1_ps(a.x)), _mm_set1_ps(b.y - a.y)),
+                _mm_mul_ps(_mm_sub_ps(py, _mm_set1_ps(a.y)), _mm_set1_ps(b.x - a.x))));
+        }
+#else
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+                out.e[i][lane] = Edge(*edges[i][0], *edges[i][1], (float)(x + (lane & 1)), (float)(y + (lane >> 1)));
+        }
+#endif
+    }
+
+    // @brief Move the edges of a quad to the next quad on the right. Cheaper than EvalEdges(), but
+    // the rounding accumulates, so only for quads known to be covered.
+    void StepEdges(const QuadSetup& s, QuadEdges& edges)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+                edges.e[i][lane] += s.stepX[i];
+        }
+    }
+
+    // @brief Edge and depth tests of the 4 lanes of the quad at (x, y), the depth of the lanes that
+    // pass is written to zBuffer unless kWriteDepth is false.
+    // @param kTestEdges false if the quad is known to be inside the tri and the bounding box, then
+    // the edge values are only used for interpolation
+    // @return false if no lane passes, quad is only valid otherwise
+    template<bool kTestEdges, bool kWriteDepth>
+    bool CoverQuad(const QuadSetup& s, const QuadEdges& edges, float *zBuffer, int w, int x, int y, Quad& quad)
+    {
+        // Pixels of the quad outside of the bounding box may be off screen
+        int boxMask = 0xf;
+        if (kTestEdges)
+        {
+            if (x < s.minX) boxMask &= ~0x5;
+            if (x + 1 > s.maxX) boxMask &= ~0xa;
+            if (y < s.minY) boxMask &= ~0x3;
+            if (y + 1 > s.maxY) boxMask &= ~0xc;
+        }
+
+        int coverMask;
+#if defined(QR_SIMD_SSE)
+        __m128 e12 = _mm_load_ps(edges.e[0]);
+        __m128 e20 = _mm_load_ps(edges.e[1]);
+        __m128 e01 = _mm_load_ps(edges.e[2]);
+        coverMask = boxMask;
+        if (kTestEdges)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            __m128 outside = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(e01, zero), _mm_cmplt_ps(e12, zero)), _mm_cmplt_ps(e20, zero));
+            coverMask &= ~_mm_movemask_ps(outside);
+            if (coverMask == 0)
+                return false;
+        }
+
+        const __m128 invArea = _mm_set1_ps(s.invArea);
+        __m128 t0 = _mm_mul_ps(e12, invArea);
+        __m128 t1 = _mm_mul_ps(e20, invArea);
+        __m128 t2 = _mm_mul_ps(e01, invArea);
+        __m128 w0 = _mm_set1_ps(s.oneOverW0), w1 = _mm_set1_ps(s.oneOverW1), w2 = _mm_set1_ps(s.oneOverW2);
+        __m128 oneOverW = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t0, w0), _mm_mul_ps(t1, w1)), _mm_mul_ps(t2, w2));
+        _mm_store_ps(quad.oneOverW, oneOverW);
+#else
+        float t[3][4];
+        coverMask = kTestEdges ? 0 : boxMask;
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            float e12 = edges.e[0][lane];
+            float e20 = edges.e[1][lane];
+            float e01 = edges.e[2][lane];
+            if (kTestEdges && !(e01 < 0.0f || e12 < 0.0f || e20 < 0.0f))
+                coverMask |= 1 << lane;
+
+            t[0][lane] = e12 * s.invArea;
+            t[1][lane] = e20 * s.invArea;
+            t[2][lane] = e01 * s.invArea;
+            quad.oneOverW[lane] = t[0][lane] * s.oneOverW0 + t[1][lane] * s.oneOverW1 + t[2][lane] * s.oneOverW2;
+        }
+        coverMask &= boxMask;
+        if (coverMask == 0)
+            return false;
+#endif
+
+        // @note If z < zBuffer, the triangle is closer, and update new zBuffer.
+        // Instead, since we use oneOverZ, it's actually inverse, and zBuffer filled
+        // with 0 actually represent the furthest (infinitely)
+        const int row0 = x + y * w;
+        const int row1 = row0 + w;
+        quad.index[0] = row0;
+        quad.index[1] = row0 + 1;
+        quad.index[2] = row1;
+        quad.index[3] = row1 + 1;
+#if defined(QR_SIMD_SSE)
+        // The 2 rows of the quad are each 2 contiguous floats, but they're only all on screen when
+        // the whole quad is inside the bounding box
+        if (boxMask == 0xf)
+        {
+            __m128 z = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(zBuffer + row0)), (const __m64 *)(zBuffer + row1));
+            __m128 pass = _mm_cmpgt_ps(oneOverW, z);
+            quad.mask = _mm_movemask_ps(pass) & coverMask;
+            if (quad.mask == 0)
+                return false;
+
+            if (kWriteDepth)
+            {
+                pass = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_setr_epi32(1, 2, 4, 8), _mm_set1_epi32(quad.mask)), _mm_setzero_si128()));
+                z = _mm_or_ps(_mm_and_ps(pass, oneOverW), _mm_andnot_ps(pass, z));
+                _mm_storel_pi((__m64 *)(zBuffer + row0), z);
+                _mm_storeh_pi((__m64 *)(zBuffer + row1), z);
+            }
+        }
+        else
+#endif
+        {
+            quad.mask = 0;
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if ((coverMask >> lane) & 1 && quad.oneOverW[lane] > zBuffer[quad.index[lane]])
+                {
+                    if (kWriteDepth)
+                        zBuffer[quad.index[lane]] = quad.oneOverW[lane];
+                    quad.mask |= 1 << lane;
+                }
+            }
+        }
+        if (quad.mask == 0)
+            return false;
+
+#if defined(QR_SIMD_SSE)
+        __m128 clipW = _mm_div_ps(_mm_set1_ps(1.0f), oneOverW);
+        _mm_store_ps(quad.b[0], _mm_mul_ps(_mm_mul_ps(w0, t0), clipW));
+        _mm_store_ps(quad.b[1], _mm_mul_ps(_mm_mul_ps(w1, t1), clipW));
+        _mm_store_ps(quad.b[2], _mm_mul_ps(_mm_mul_ps(w2, t2), clipW));
+#else
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            float clipW = 1.0f / quad.oneOverW[lane];
+            quad.b[0][lane] = s.oneOverW0 * t[0][lane] * clipW;
+            quad.b[1][lane] = s.oneOverW1 * t[1][lane] * clipW;
+            quad.b[2][lane] = s.oneOverW2 * t[2][lane] * clipW;
+        }
+#endif
+        return true;
+    }
+
+    // @brief Change of each edge value and of 1/w from the pixel center to each sample, computed
+    // once per tri
+    struct SampleSetup
+    {
+        int count;
+        float edgeOffset[8][3];
+        float depthOffset[8];
+    };
+
+    void SetupSamples(const QuadSetup& s, const MultisampleBuffer& buffer, SampleSetup& out)
+    {
+        const Vec3f *edges[3][2] = {{&s.v1, &s.v2}, {&s.v2, &s.v0}, {&s.v0, &s.v1}};
+        const float oneOverW[3] = {s.oneOverW0, s.oneOverW1, s.oneOverW2};
+        out.count = buffer.GetSampleCount();
+        for (int k = 0; k < out.count; ++k)
+        {
+            const Vec2f offset = buffer.GetSampleOffset(k);
+            out.depthOffset[k] = 0.0f;
+            for (int i = 0; i < 3; ++i)
+            {
+                const Vec3f& a = *edges[i][0];
+                const Vec3f& b = *edges[i][1];
+                out.edgeOffset[k][i] = offset.x * (b.y - a.y) - offset.y * (b.x - a.x);
+                out.depthOffset[k] += out.edgeOffset[k][i] * s.invArea * oneOverW[i];
+            }
+        }
+    }
+
+    // @brief CoverQuad() at every sample of the lanes. The lanes with at least 1 sample that passes
+    // are live, and are interpolated at their center like single sampled quads. 1/w is linear in
+    // raster space, so the depth of each sample is an offset of the center's.
+    template<bool kTestEdges>
+    bool CoverQuadSamples(const QuadSetup& s, const SampleSetup& samples, const QuadEdges& edges, MultisampleBuffer& buffer, int w, int x, int y, Quad& quad)
+    {
+        int boxMask = 0xf;
+        if (kTestEdges)
+        {
+            if (x < s.minX) boxMask &= ~0x5;
+            if (x + 1 > s.maxX) boxMask &= ~0xa;
+            if (y < s.minY) boxMask &= ~0x3;
+            if (y + 1 > s.maxY) boxMask &= ~0xc;
+        }
+
+        const int row0 = x + y * w;
+        const int row1 = row0 + w;
+        quad.index[0] = row0;
+        quad.index[1] = row0 + 1;
+        quad.index[2] = row1;
+        quad.index[3] = row1 + 1;
+
+#if defined(QR_SIMD_SSE)
+        const __m128 invArea = _mm_set1_ps(s.invArea);
+        const __m128 t0 = _mm_mul_ps(_mm_load_ps(edges.e[0]), invArea);
+        const __m128 t1 = _mm_mul_ps(_mm_load_ps(edges.e[1]), invArea);
+        const __m128 t2 = _mm_mul_ps(_mm_load_ps(edges.e[2]), invArea);
+        const __m128 w0 = _mm_set1_ps(s.oneOverW0), w1 = _mm_set1_ps(s.oneOverW1), w2 = _mm_set1_ps(s.oneOverW2);
+        const __m128 oneOverW = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t0, w0), _mm_mul_ps(t1, w1)), _mm_mul_ps(t2, w2));
+        _mm_store_ps(quad.oneOverW, oneOverW);
+#else
+        float t[3][4];
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            for (int i = 0; i < 3; ++i)
+                t[i][lane] = edges.e[i][lane] * s.invArea;
+            quad.oneOverW[lane] = t[0][lane] * s.oneOverW0 + t[1][lane] * s.oneOverW1 + t[2][lane] * s.oneOverW2;
+        }
+#endif
+
+        quad.mask = 0;
+        for (int k = 0; k < samples.count; ++k)
+        {
+            float *zBuffer = buffer.GetDepth(k);
+            int coverMask = boxMask;
+            int passMask = 0;
+#if defined(QR_SIMD_SSE)
+            if (kTestEdges)
+            {
+                const __m128 zero = _mm_setzero_ps();
+                __m128 outside = _mm_cmplt_ps(_mm_add_ps(_mm_load_ps(edges.e[0]), _mm_set1_ps(samples.edgeOffset[k][0])), zero);
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(_mm_load_ps(edges.e[1]), _mm_set1_ps(samples.edgeOffset[k][1])), zero));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(_mm_load_ps(edges.e[2]), _mm_set1_ps(samples.edgeOffset[k][2])), zero));
+                coverMask &= ~_mm_movemask_ps(outside);
+                if (coverMask == 0)
+                    continue;
+            }
+
+            const __m128 depth = _mm_add_ps(oneOverW, _mm_set1_ps(samples.depthOffset[k]));
+            if (boxMask == 0xf)
+            {
+                __m128 z = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(zBuffer + row0)), (const __m64 *)(zBuffer + row1));
+                passMask = _mm_movemask_ps(_mm_cmpgt_ps(depth, z)) & coverMask;
+                if (passMask == 0)
+                    continue;
+
+                __m128 pass = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_setr_epi32(1, 2, 4, 8), _mm_set1_epi32(passMask)), _mm_setzero_si128()));
+                z = _mm_or_ps(_mm_and_ps(pass, depth), _mm_andnot_ps(pass, z));
+                _mm_storel_pi((__m64 *)(zBuffer + row0), z);
+                _mm_storeh_pi((__m64 *)(zBuffer + row1), z);
+            }
+            else
+            {
+                alignas(16) float sampleDepth[4];
+                _mm_store_ps(sampleDepth, depth);
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    if ((coverMask >> lane) & 1 && sampleDepth[lane] > zBuffer[quad.index[lane]])
+                    {
+                        zBuffer[quad.index[lane]] = sampleDepth[lane];
+                        passMask |= 1 << lane;
+                    }
+                }
+            }
+#else
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (!((coverMask >> lane) & 1))
+                    continue;
+                if (kTestEdges && (edges.e[0][lane] + samples.edgeOffset[k][0] < 0.0f || edges.e[1][lane] + samples.edgeOffset[k][1] < 0.0f ||
+                    edges.e[2][lane] + samples.edgeOffset[k][2] < 0.0f))
+                {
+                    continue;
+                }
+                const float sampleDepth = quad.oneOverW[lane] + samples.depthOffset[k];
+                if (sampleDepth > zBuffer[quad.index[lane]])
+                {
+                    zBuffer[quad.index[lane]] = sampleDepth;
+                    passMask |= 1 << lane;
+                }
+            }
+#endif
+            for (int lane = 0; lane < 4; ++lane)
+                quad.samples[lane] |= (uint8_t)(((passMask >> lane) & 1) << k);
+            quad.mask |= passMask;
+        }
+        if (quad.mask == 0)
+            return false;
+
+        // Lanes whose center is outside of the tri extrapolate a little, like a GPU without centroid
+        // sampling
+#if defined(QR_SIMD_SSE)
+        __m128 clipW = _mm_div_ps(_mm_set1_ps(1.0f), oneOverW);
+        _mm_store_ps(quad.b[0], _mm_mul_ps(_mm_mul_ps(w0, t0), clipW));
+        _mm_store_ps(quad.b[1], _mm_mul_ps(_mm_mul_ps(w1, t1), clipW));
+        _mm_store_ps(quad.b[2], _mm_mul_ps(_mm_mul_ps(w2, t2), clipW));
+#else
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            float clipW = 1.0f / quad.oneOverW[lane];
+            quad.b[0][lane] = s.oneOverW0 * t[0][lane] * clipW;
+            quad.b[1][lane] = s.oneOverW1 * t[1][lane] * clipW;
+            quad.b[2][lane] = s.oneOverW2 * t[2][lane] * clipW;
+        }
+#endif
+        return true;
+    }
+
+    // @brief How the traversals test a quad, at the pixel centers against a z-buffer or at the
+    // samples of a MultisampleBuffer. Test<false>() is for quads known to be inside the tri and the
+    // bounding box. Transparent draws use PixelCover<false>, they're tested against the z-buffer
+    // but leave it as it is.
+    template<bool kWriteDepth>
+    struct PixelCover
+    {
+        float *zBuffer;
+        int w;
+
+        template<bool kTestEdges>
+        bool Test(const QuadSetup& s, const QuadEdges& edges, int x, int y, Quad& quad) const
+        {
+            return CoverQuad<kTestEdges, kWriteDepth>(s, edges, zBuffer, w, x, y, quad);
+        }
+    };
+
+    struct SampleCover
+    {
+        const SampleSetup& samples;
+        MultisampleBuffer& buffer;
+        int w;
+
+        template<bool kTestEdges>
+        bool Test(const QuadSetup& s, const QuadEdges& edges, int x, int y, Quad& quad) const
+        {
+            return CoverQuadSamples<kTestEdges>(s, samples, edges, buffer, w, x, y, quad);
+        }
+    };
+
+    // @brief Visit every quad of the bounding box
+    template<typename Cover, typename ShadeFn>
+    void TraverseBoundingBox(const QuadSetup& s, const Cover& cover, ShadeFn&& shade)
+    {
+        // Quads are aligned to even pixels, so that neighbouring tris share the same quads
+        for (int y = s.minY & ~1; y <= s.maxY; y += 2)
+        {
+            for (int x = s.minX & ~1; x <= s.maxX; x += 2)
+            {
+                QuadEdges edges;
+                EvalEdges(s, x, y, edges);
+                Quad quad;
+                if (cover.template Test<true>(s, edges, x, y, quad))
+                    shade(quad);
+            }
+        }
+    }
+
+    // @brief Two level traversal. The edge functions are linear, so their values at the 4 corner
+    // pixels of an 8x8 block bound every pixel inside it:
+    // - all corners outside of the same edge, the block is skipped
+    // - all corners inside of every edge (and the block inside of the bounding box), the quads are
+    // filled without edge tests
+    // - otherwise, the quads are edge tested as usual
+    // Thin or large tris skip most of their bounding box this way. When multisampled, the corners are
+    // moved out by the reach of the samples.
+    template<typename Cover, typename ShadeFn>
+    void TraverseBlocks(const QuadSetup& s, const Cover& cover, ShadeFn&& shade)
+    {
+        constexpr int kBlockSize = 8;
+        const Vec3f *edges[3][2] = {{&s.v1, &s.v2}, {&s.v2, &s.v0}, {&s.v0, &s.v1}};
+
+        for (int by = s.minY & ~(kBlockSize - 1); by <= s.maxY; by += kBlockSize)
+        {
+            for (int bx = s.minX & ~(kBlockSize - 1); bx <= s.maxX; bx += kBlockSize)
+            {
+                float x0 = (float)bx - s.sampleReach, x1 = (float)(bx + kBlockSize - 1) + s.sampleReach;
+                float y0 = (float)by - s.sampleReach, y1 = (float)(by + kBlockSize - 1) + s.sampleReach;
+
+                bool isOutside = false;
+                bool isInside = true;
+                for (const auto& edge : edges)
+                {
+                    float e[4] = {Edge(*edge[0], *edge[1], x0, y0), Edge(*edge[0], *edge[1], x1, y0),
+                        Edge(*edge[0], *edge[1], x0, y1), Edge(*edge[0], *edge[1], x1, y1)};
+                    int outCnt = (e[0] < 0.0f) + (e[1] < 0.0f) + (e[2] < 0.0f) + (e[3] < 0.0f);
+                    isOutside |= (outCnt == 4);
+                    isInside &= (outCnt == 0);
+                }
+                if (isOutside)
+                    continue;
+                isInside &= (bx >= s.minX && bx + kBlockSize - 1 <= s.maxX && by >= s.minY && by + kBlockSize - 1 <= s.maxY);
+
+                for (int y = std::max(by, s.minY & ~1); y < by + kBlockSize && y <= s.maxY; y += 2)
+                {
+                    for (int x = std::max(bx, s.minX & ~1); x < bx + kBlockSize && x <= s.maxX; x += 2)
+                    {
+                        QuadEdges edges;
+                        EvalEdges(s, x, y, edges);
+                        Quad quad;
+                        bool isLive = isInside ? cover.template Test<false>(s, edges, x, y, quad) : cover.template Test<true>(s, edges, x, y, quad);
+                        if (isLive)
+                            shade(quad);
+                    }
+                }
+            }
+        }
+    }
+
+    // @brief Range of x where row y is inside of every edge, empty if outLeft > outRight
+    // @note In double, so that the span stays within a fraction of a pixel of what the edge
+    // tests give even for almost horizontal edges
+    void RowSpan(const QuadSetup& s, int y, double& outLeft, double& outRight)
+    {
+        const Vec3f *edges[3][2] = {{&s.v1, &s.v2}, {&s.v2, &s.v0}, {&s.v0, &s.v1}};
+        outLeft = (double)s.minX;
+        outRight = (double)s.maxX;
+        for (const auto& edge : edges)
+        {
+            const Vec3f& a = *edge[0];
+            const Vec3f& b = *edge[1];
+            // Edge(a, b, x, y) = (x - a.x) * dy - (y - a.y) * dx >= 0
+            double dy = (double)b.y - a.y;
+            double dx = (double)b.x - a.x;
+            double offset = ((double)y - a.y) * dx;
+            if (dy > 0.0)
+                outLeft = std::max(outLeft, a.x + offset / dy);
+            else if (dy < 0.0)
+                outRight = std::min(outRight, a.x + offset / dy);
+            else if (offset > 0.0)
+                outLeft = std::numeric_limits<double>::infinity();
+        }
+    }
+
+    // @brief Scanline traversal. For each pair of rows, the range covered by the tri is found from
+    // where each edge crosses the rows, like the edge walk of a span rasterizer. The quads well
+    // inside of both spans are filled while stepping the edge values incrementally, only the
+    // quads at both ends are edge tested.
+    // @note The incremental edge values round differently than EvalEdges(), so interpolated
+    // values can differ slightly from the other traversals, coverage doesn't.
+    template<typename Cover, typename ShadeFn>
+    void TraverseSpans(const QuadSetup& s, const Cover& cover, ShadeFn&& shade)
+    {
+        for (int y = s.minY & ~1; y <= s.maxY; y += 2)
+        {
+            double left[2], right[2];
+            bool isFillable = true;
+            double outerLeft = std::numeric_limits<double>::infinity();
+            double outerRight = -std::numeric_limits<double>::infinity();
+            for (int row = 0; row < 2; ++row)
+            {
+                RowSpan(s, y + row, left[row], right[row]);
+                bool isRowInBox = (y + row >= s.minY && y + row <= s.maxY);
+                isFillable &= isRowInBox && left[row] <= right[row];
+
+                // A margin of 1 pixel, in case the edge tests disagree with the span at its ends
+                if (isRowInBox && left[row] <= right[row] + 1.0)
+                {
+                    outerLeft = std::min(outerLeft, std::min(left[row], right[row]) - 1.0);
+                    outerRight = std::max(outerRight, std::max(left[row], right[row]) + 1.0);
+                }
+            }
+            if (outerLeft > outerRight)
+                continue;
+
+            int x0 = std::max(s.minX, (int)std::floor(outerLeft)) & ~1;
+            int x1 = std::min(s.maxX, (int)std::ceil(outerRight));
+            int fillLeft = isFillable ? (int)std::ceil(std::max(left[0], left[1])) + 1 : INT_MAX;
+            int fillRight = isFillable ? (int)std::floor(std::min(right[0], right[1])) - 1 : INT_MIN;
+
+            QuadEdges edges;
+            bool isStepping = false;
+            for (int x = x0; x <= x1; x += 2)
+            {
+                Quad quad;
+                bool isLive;
+                if (x >= fillLeft && x + 1 <= fillRight)
+                {
+                    if (isStepping)
+                        StepEdges(s, edges);
+                    else
+                        EvalEdges(s, x, y, edges);
+                    isStepping = true;
+                    isLive = cover.template Test<false>(s, edges, x, y, quad);
+                }
+                else
+                {
+                    EvalEdges(s, x, y, edges);
+                    isStepping = false;
+                    isLive = cover.template Test<true>(s, edges, x, y, quad);
+                }
+                if (isLive)
+                    shade(quad);
+            }
+        }
+    }
+
+    // @brief Traversal for RasterTraversal::kAuto. Small tris don't amortize the setup of blocks or
+    // spans, see the "Close-up triangles" and "Scene traversal" benchmarks.
+    RasterTraversal PickTraversal(const QuadSetup& s)
+    {
+        constexpr int kMinSpanArea = 64;
+        int boxArea = (s.maxX - s.minX + 1) * (s.maxY - s.minY + 1);
+        return boxArea < kMinSpanArea ? RasterTraversal::kBoundingBox : RasterTraversal::kSpans;
+    }
+
+    // @brief Pick the mip level from the uv derivatives of a quad, the level whose texels are
+    // closest to 1 pixel in size.
+    int SelectMip(const QTexture& texture, const Vec2f& ddx, const Vec2f& ddy)
+    {
+        float w = (float)texture.GetW(), h = (float)texture.GetH();
+        float dx = (ddx.x * w) * (ddx.x * w) + (ddx.y * h) * (ddx.y * h);
+        float dy = (ddy.x * w) * (ddy.x * w) + (ddy.y * h) * (ddy.y * h);
+        float rhoSqr = std::max(dx, dy);
+
+        // Helper lanes near the horizon can extrapolate to garbage, treat it as magnification
+        if (!(rhoSqr > 1.0f) || !std::isfinite(rhoSqr))
+            return 0;
+        int level = (int)(0.5f * std::log2(rhoSqr) + 0.5f);
+        return std::min(level, texture.GetMipCount() - 1);
+    }
+
+    // @brief Fetches the texels of an RGBA32 level, (x, y) is always in range
+    struct TexelFetch
+    {
+        const uint32_t *texels;
+        int texW;
+        uint32_t operator()(int x, int y) const { return texels[x + y * texW]; }
+    };
+
+    // @brief See Rasterizer::SampleNearest() and Rasterizer::SampleBilinear4(). The texels are
+    // read through fetch(x, y), so that compressed textures share the filtering.
+    template <typename Fetch>
+    uint32_t SampleNearestWith(Fetch fetch, int texW, int texH, const Vec2f& uv)
+    {
+        // Clamp to edge, uv of some meshes (e.g. teapot.obj) are outside of [0, 1]
+        int uvX = std::max(0, std::min(texW - 1, (int)(uv.x * texW + 0.5f)));
+        int uvY = std::max(0, std::min(texH - 1, (int)(uv.y * texH + 0.5f)));
+        return fetch(uvX, uvY);
+    }
+
+    template <typename Fetch>
+    void SampleBilinear4With(Fetch fetch, int texW, int texH, const Vec2f (&uvs)[4], uint32_t (&outTexels)[4])
+    {
+        // Texel coords in 8.8 fixed point, clamped to the centers of the edge texels. Clamping first
+        // also keeps NaNs out (max returns its second operand then), and truncation is a floor.
+        const float maxX = (texW - 1) * 256.0f;
+        const float maxY = (texH - 1) * 256.0f;
+        alignas(16) int x0[4], x1[4], y0[4], y1[4];
+#if defined(QR_SIMD_SSE)
+        const __m128 zero = _mm_setzero_ps();
+        __m128 u = _mm_setr_ps(uvs[0].x, uvs[1].x, uvs[2].x, uvs[3].x);
+        __m128 v = _mm_setr_ps(uvs[0].y, uvs[1].y, uvs[2].y, uvs[3].y);
+        __m128i x = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(u, _mm_set1_ps(texW * 256.0f)), zero), _mm_set1_ps(maxX)));
+        __m128i y = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(v, _mm_set1_ps(texH * 256.0f)), zero), _mm_set1_ps(maxY)));
+        const __m128i fracMask = _mm_set1_epi32(0xff);
+        __m128i weightX = _mm_and_si128(x, fracMask);
+        __m128i weightY = _mm_and_si128(y, fracMask);
+        __m128i left = _mm_srai_epi32(x, 8);
+        __m128i bottom = _mm_srai_epi32(y, 8);
+
+        // The next texel, unless it's the edge (the compare is -1 when true)
+        _mm_store_si128((__m128i *)x0, left);
+        _mm_store_si128((__m128i *)x1, _mm_sub_epi32(left, _mm_cmplt_epi32(left, _mm_set1_epi32(texW - 1))));
+        _mm_store_si128((__m128i *)y0, bottom);
+        _mm_store_si128((__m128i *)y1, _mm_sub_epi32(bottom, _mm_cmplt_epi32(bottom, _mm_set1_epi32(texH - 1))));
+
+        // No gather in SSE2, the 16 texels are fetched one by one
+        __m128i t00 = _mm_setr_epi32((int)fetch(x0[0], y0[0]), (int)fetch(x0[1], y0[1]), (int)fetch(x0[2], y0[2]), (int)fetch(x0[3], y0[3]));
+        __m128i t10 = _mm_setr_epi32((int)fetch(x1[0], y0[0]), (int)fetch(x1[1], y0[1]), (int)fetch(x1[2], y0[2]), (int)fetch(x1[3], y0[3]));
+        __m128i t01 = _mm_setr_epi32((int)fetch(x0[0], y1[0]), (int)fetch(x0[1], y1[1]), (int)fetch(x0[2], y1[2]), (int)fetch(x0[3], y1[3]));
+        __m128i t11 = _mm_setr_epi32((int)fetch(x1[0], y1[0]), (int)fetch(x1[1], y1[1]), (int)fetch(x1[2], y1[2]), (int)fetch(x1[3], y1[3]));
+
+        // Weights repeated over the 4 channels of each lane, lanes 0-1 in lo and 2-3 in hi
+        weightX = _mm_or_si128(weightX, _mm_slli_epi32(weightX, 16));
+        weightY = _mm_or_si128(weightY, _mm_slli_epi32(weightY, 16));
+        const __m128i wxLo = _mm_unpacklo_epi32(weightX, weightX), wxHi = _mm_unpackhi_epi32(weightX, weightX);
+        const __m128i wyLo = _mm_unpacklo_epi32(weightY, weightY), wyHi = _mm_unpackhi_epi32(weightY, weightY);
+
+        // (a * (256 - w) + b * w + 128) >> 8 is at most 65408, it fits the unsigned 16 bit lanes
+        const __m128i one = _mm_set1_epi16(256);
+        const __m128i half = _mm_set1_epi16(128);
+        auto lerp = [&one, &half](__m128i a, __m128i b, __m128i w)
+        {
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(one, w)), _mm_mullo_epi16(b, w));
+            return _mm_srli_epi16(_mm_add_epi16(sum, half), 8);
+        };
+        const __m128i zeroi = _mm_setzero_si128();
+        __m128i lo = lerp(lerp(_mm_unpacklo_epi8(t00, zeroi), _mm_unpacklo_epi8(t10, zeroi), wxLo),
+            lerp(_mm_unpacklo_epi8(t01, zeroi), _mm_unpacklo_epi8(t11, zeroi), wxLo), wyLo);
+        __m128i hi = lerp(lerp(_mm_unpackhi_epi8(t00, zeroi), _mm_unpackhi_epi8(t10, zeroi), wxHi),
+            lerp(_mm_unpackhi_epi8(t01, zeroi), _mm_unpackhi_epi8(t11, zeroi), wxHi), wyHi);
+        _mm_storeu_si128((__m128i *)outTexels, _mm_packus_epi16(lo, hi));
+#else
+        int fx[4], fy[4];
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            int x = (int)std::min(std::max(0.0f, uvs[lane].x * texW * 256.0f), maxX);
+            int y = (int)std::min(std::max(0.0f, uvs[lane].y * texH * 256.0f), maxY);
+            fx[lane] = x & 0xff;
+            fy[lane] = y & 0xff;
+            x0[lane] = x >> 8;
+            y0[lane] = y >> 8;
+            x1[lane] = std::min(x0[lane] + 1, texW - 1);
+            y1[lane] = std::min(y0[lane] + 1, texH - 1);
+        }
+
+        auto lerp = [](uint32_t a, uint32_t b, int w)
+        {
+            uint32_t result = 0;
+            for (int k = 0; k < 32; k += 8)
+            {
+                uint32_t c = (((a >> k) & 0xff) * (256 - w) + ((b >> k) & 0xff) * w + 128) >> 8;
+                result |= c << k;
+            }
+            return result;
+        };
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            uint32_t bottom = lerp(fetch(x0[lane], y0[lane]), fetch(x1[lane], y0[lane]), fx[lane]);
+            uint32_t top = lerp(fetch(x0[lane], y1[lane]), fetch(x1[lane], y1[lane]), fx[lane]);
+            outTexels[lane] = lerp(bottom, top, fy[lane]);
+        }
+#endif
+    }
+}
+
+inline void Rasterizer::WritePixel(uint32_t *pixels, int index, uint32_t color, int sampleMask, float oneOverW)
+{
+    if (m_oit)
+        m_oit->Accumulate(index, color, m_opacity, oneOverW);
+    else if (m_msaa)
+        m_msaa->Write(pixels, index, color, sampleMask);
+    else
+        pixels[index] = color;
+}
+
+// @brief Fragment stages. Shade() is called for each quad with at least 1 live lane, the z-buffer
+// is already updated for those lanes.
+struct Rasterizer::DepthFragment
+{
+    static constexpr bool kNeedsTexture = false;
+
+    static void Shade(Rasterizer& r, const DrawContext& ctx, const Triangle&, const Quad& quad)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (!quad.IsLive(lane))
+                continue;
+            uint8_t c = r.ClampChannel(quad.oneOverW[lane]);
+            r.WritePixel(ctx.pixels, quad.index[lane], r.ToColor(c, c, c, 255), quad.samples[lane], quad.oneOverW[lane]);
+        }
+    }
+};
+
+// @brief Shadow maps, see RasterizeDepth(). The depth test is all there is.
+struct Rasterizer::DepthOnlyFragment
+{
+    static constexpr bool kNeedsTexture = false;
+
+    static void Shade(Rasterizer&, const DrawContext&, const Triangle&, const Quad&) {}
+};
+
+struct Rasterizer::ColorFragment
+{
+    static constexpr bool kNeedsTexture = false;
+
+    static void Shade(Rasterizer& r, const DrawContext& ctx, const Triangle& tri, const Quad& quad)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (!quad.IsLive(lane))
+                continue;
+            Vec3f color = quad.Interpolate(tri.colors, lane);
+            r.WritePixel(ctx.pixels, quad.index[lane], r.ToColor(r.ClampChannel(color.r), r.ClampChannel(color.g), r.ClampChannel(color.b), 255), quad.samples[lane], quad.oneOverW[lane]);
+        }
+    }
+};
+
+struct Rasterizer::TexturedFragment
+{
+    static constexpr bool kNeedsTexture = true;
+
+    // @brief Fetch the RGBA32 texel of each live lane, from the mip level that matches the uv
+    // derivatives of the quad
+    // @todo It seems that we don't have to worry about gamma correction?
+    static void Sample(Rasterizer& r, const DrawContext& ctx, const Triangle& tri, const Quad& quad, uint32_t (&outTexels)[4])
+    {
+        QTexture::MipLevel mip = ctx.texture->GetMip(SelectMip(*ctx.texture, quad.Ddx(tri.texCoords), quad.Ddy(tri.texCoords)));
+        if (mip.blocks)
+        {
+            const TextureFormat format = ctx.texture->GetFormat();
+            auto fetch = [&r, &mip, format](int x, int y) { return r.FetchBlockTexel(mip.blocks, format, mip.w, x, y); };
+            Filter(r, tri, quad, fetch, mip.w, mip.h, outTexels);
+        }
+        else
+            Filter(r, tri, quad, TexelFetch{mip.texels, mip.w}, mip.w, mip.h, outTexels);
+    }
+
+    template <typename Fetch>
+    static void Filter(const Rasterizer& r, const Triangle& tri, const Quad& quad, Fetch fetch, int texW, int texH, uint32_t (&outTexels)[4])
+    {
+        if (r.m_filter == TextureFilter::kBilinear)
+        {
+            // Dead lanes can extrapolate to anything, they fetch texel (0, 0) instead
+            Vec2f uvs[4];
+            for (int lane = 0; lane < 4; ++lane)
+                uvs[lane] = quad.IsLive(lane) ? quad.Interpolate(tri.texCoords, lane) : Vec2f{0.0f, 0.0f};
+            SampleBilinear4With(fetch, texW, texH, uvs, outTexels);
+            return;
+        }
+
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (quad.IsLive(lane))
+                outTexels[lane] = SampleNearestWith(fetch, texW, texH, quad.Interpolate(tri.texCoords, lane));
+        }
+    }
+
+    // @brief texel times color, clamped like ClampChannel() and packed back to RGBA32. The alpha of
+    // the texel is kept.
+    static uint32_t Modulate(uint32_t texel, const Vec3f& color)
+    {
+#if defined(QR_SIMD_SSE)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)texel), zero), zero);
+        __m128 c = _mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_setr_ps(color.r, color.g, color.b, 1.0f));
+        c = _mm_max_ps(_mm_add_ps(_mm_min_ps(c, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)), _mm_setzero_ps());
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(c), zero);
+        return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(packed, zero));
+#else
+        const float factors[4] = {color.r, color.g, color.b, 1.0f};
+        uint32_t result = 0;
+        for (int k = 0; k < 4; ++k)
+        {
+            float c = (float)((texel >> (k * 8)) & 0xff) * factors[k];
+            result |= (uint32_t)std::max(std::min(c, 255.0f) + 0.5f, 0.0f) << (k * 8);
+        }
+        return result;
+#endif
+    }
+
+    static void Shade(Rasterizer& r, const DrawContext& ctx, const Triangle& tri, const Quad& quad)
+    {
+        uint32_t texels[4];
+        Sample(r, ctx, tri, quad, texels);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (!quad.IsLive(lane))
+                continue;
+            r.WritePixel(ctx.pixels, quad.index[lane], Modulate(texels[lane], quad.Interpolate(tri.colors, lane)), quad.samples[lane], quad.oneOverW[lane]);
+        }
+    }
+};
+
+struct Rasterizer::LitColorFragment
+{
+    static constexpr bool kNeedsTexture = false;
+
+    static void Shade(Rasterizer& r, const DrawContext& ctx, const Triangle& tri, const Quad& quad)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (!quad.IsLive(lane))
+                continue;
+            r.StagePhongPixel(ctx.pixels, quad.index[lane], quad.samples[lane], quad.oneOverW[lane], quad.Interpolate(tri.colors, lane), 255,
+                quad.Interpolate(tri.viewPos, lane), quad.Interpolate(tri.normals, lane));
+        }
+    }
+};
+
+struct Rasterizer::LitTexturedFragment
+{
+    static constexpr bool kNeedsTexture = true;
+
+    // @note The colors of a textured tri are the tint, the texel times the tint is the surface color
+    static void Shade(Rasterizer& r, const DrawContext& ctx, const Triangle& tri, const Quad& quad)
+    {
+        uint32_t texels[4];
+        TexturedFragment::Sample(r, ctx, tri, quad, texels);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (!quad.IsLive(lane))
+                continue;
+            uint8_t red, green, blue, alpha;
+            r.ToComponent(texels[lane], red, green, blue, alpha);
+            Vec3f texel{(float)red / 255.0f, (float)green / 255.0f, (float)blue / 255.0f};
+            r.StagePhongPixel(ctx.pixels, quad.index[lane], quad.samples[lane], quad.oneOverW[lane], texel * ctx.tint, alpha,
+                quad.Interpolate(tri.viewPos, lane), quad.Interpolate(tri.normals, lane));
+        }
+    }
+};
+
+template<typename VertexStage, typename FragmentStage>
+void Rasterizer::DrawTris(const DrawContext& ctx, const Mat44f& modelViewMat, const Mat44f& projMat)
+{
+    const Model& model = ctx.model;
+    const int w = ctx.w;
+    const int h = ctx.h;
+
+    Mat44f invModelView = Math::Inverse(modelViewMat);
+    Mat44f normalMat = Math::Transpose(invModelView);
+
+    ProcessVerts(model, modelViewMat, projMat, normalMat, VertexStage::kNeedsVertNormals, w, h);
+    if (VertexStage::kNeedsCornerLight && !ctx.nIndices.empty())
+        ShadeCorners(ctx);
+
+    // Multisampled tris can cover samples up to half a pixel away from the pixel centers, transparent
+    // ones only cover pixel centers
+    const float sampleReach = (m_msaa && !m_oit) ? 0.5f : 0.0f;
+
+    // Textured draws are modulated by the texel, otherwise resolve empty colors to white
+    const bool useModelColors = !FragmentStage::kNeedsTexture && !model.colors.empty();
 
-    for (int i = 0; i < model.vertIndices.size(); i += 3)
+    // Clusters are culled as a unit, by their bounds against the frustum and by their normal cone.
+    // Models built by hand without clusters go through all of their tris.
+    Vec4f planes[Plane::kCount];
+    ToObjectSpace(modelViewMat * projMat, planes);
+    Vec3f eye{invModelView(3, 0), invModelView(3, 1), invModelView(3, 2)};
+
+    const int clusterCnt = ctx.clusters.empty() ? 1 : (int)ctx.clusters.size();
+    for (int c = 0; c < clusterCnt; ++c)
     {
-        Vec3f v0 = model.verts[model.vertIndices[i]];
-        Vec3f v1 = model.verts[model.vertIndices[i + 1]];
-        Vec3f v2 = model.verts[model.vertIndices[i + 2]];
-        // Empty, resolve to flat shading
-        Vec3f c0, c1, c2;
-        if (model.colors.empty())
-        {
-            c0 = Vec3f{1.0f, 1.0f, 1.0f};
-            c1 = Vec3f{1.0f, 1.0f, 1.0f};
-            c2 = Vec3f{1.0f, 1.0f, 1.0f};
-        }
-        else
+        int first = 0;
+        int last = (int)ctx.vertIndices.size();
+        if (!ctx.clusters.empty())
         {
-            c0 = model.colors[model.vertIndices[i]];
-            c1 = model.colors[model.vertIndices[i + 1]];
-            c2 = model.colors[model.vertIndices[i + 2]];
+            const Cluster& cluster = ctx.clusters[c];
+            if (IsOutside(cluster.bounds, planes) || IsBackFacing(cluster, eye))
+            {
+                ++m_stats.clustersCulled;
+                continue;
+            }
+            first = cluster.firstIndex;
+            last = cluster.firstIndex + cluster.indexCount;
         }
 
-
-        // Back face culling in cam space
-        Vec3f surfNormal = Math::Normal(Math::Cross(v2 - v0, v1 - v0));
-        if (Math::Dot(v0, surfNormal) > 0.0f)
-            continue;
-
-        // Flat shading. @note z-axis isn't inverted here
-        Vec3f lightDir = Math::Normal(Vec3f{0.0f, -1.0f, -1.0f});
-        // @note Since it survives back face culling, surfNormal should be (+)
-        float dp = Math::Dot(lightDir, surfNormal);
-        c0 *= -dp;
-        c1 *= -dp;
-        c2 *= -dp;
-
-        // To clip space. @note z-axis is inverted here to range [0, w];
-        std::vector<float> wCoords = {-v0.z, -v1.z, -v2.z};
-        v0 = Math::MultiplyVecMat(v0, projMat);
-        v1 = Math::MultiplyVecMat(v1, projMat);
-        v2 = Math::MultiplyVecMat(v2, projMat);
-
-        // Clipping
-        enum Plane
-        {
-            kNear,
-            kTop,
-            kRight,
-            kBottom,
-            kLeft,
-            kCount
-        };
-        std::deque<Triangle> clippedTris;
-        // No uv, so set to 0
-        clippedTris.push_back(Triangle(v0, v1, v2, Vec2f(0.0f), Vec2f(0.0f), Vec2f(0.0f),
-            wCoords[0], wCoords[1], wCoords[2], c0, c1, c2));
-        for (int p = Plane::kNear; p != Plane::kCount; ++p)
+        for (int i = first; i < last; i += 3)
         {
-            size_t oldCnt = clippedTris.size();
-            while (oldCnt-- > 0)
+            int i0 = ctx.vertIndices[i];
+            int i1 = ctx.vertIndices[i + 1];
+            int i2 = ctx.vertIndices[i + 2];
+            ++m_stats.submitted;
+
+            // All 3 verts are outside of the same plane
+            uint8_t orCode = m_outcodes[i0] | m_outcodes[i1] | m_outcodes[i2];
+            if (m_outcodes[i0] & m_outcodes[i1] & m_outcodes[i2])
+            {
+                ++m_stats.outsideFrustum;
+                continue;
+            }
+
+            // Back face culling from the winding on screen, which only needs the signed area
+            if (orCode == 0)
             {
-                Triangle tri = clippedTris.front();
-                clippedTris.pop_front();
-                std::vector<Triangle> newTris;
-                switch (p)
+                Vec3f r0 = ToVec3(m_rasterPos.Get(i0));
+                Vec3f r1 = ToVec3(m_rasterPos.Get(i1));
+                Vec3f r2 = ToVec3(m_rasterPos.Get(i2));
+                if (ComputeEdge(r0, r1, r2) <= 0.0f)
                 {
-                case Plane::kNear:
+                    ++m_stats.backFacing;
+                    continue;
+                }
+
+                // Pixel centers are at integer coords, so a tri whose bounding box has none of them
+                // (nor any sample) can't cover any pixel. Dense meshes at a distance are mostly made
+                // of those.
+                if ((std::ceil(Helper::Min3(r0.x, r1.x, r2.x) - sampleReach) > std::floor(Helper::Max3(r0.x, r1.x, r2.x) + sampleReach) ||
+                    std::ceil(Helper::Min3(r0.y, r1.y, r2.y) - sampleReach) > std::floor(Helper::Max3(r0.y, r1.y, r2.y) + sampleReach)))
                 {
-                    newTris = ClipTriangleAgainstPlane({0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.5f}, tri);
-                    break;
+                    ++m_stats.noSamples;
+                    continue;
                 }
-                case Plane::kTop:
+            }
+            else
+            {
+                if (HomogeneousArea(m_clipPos.Get(i0), m_clipPos.Get(i1), m_clipPos.Get(i2)) <= 0.0f)
                 {
-                    newTris = ClipTriangleAgainstPlane({0.0f, -1.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
+                    ++m_stats.backFacing;
+                    continue;
                 }
-                case Plane::kRight:
+                ++m_stats.clipped;
+            }
+
+            const Vec3f& p0 = model.verts[i0];
+            const Vec3f& p1 = model.verts[i1];
+            const Vec3f& p2 = model.verts[i2];
+            Vec3f surfNormal = Math::Cross(p2 - p0, p1 - p0);
+
+            Triangle inTri{orCode ? m_clipPos.Get(i0) : m_rasterPos.Get(i0),
+                orCode ? m_clipPos.Get(i1) : m_rasterPos.Get(i1),
+                orCode ? m_clipPos.Get(i2) : m_rasterPos.Get(i2),
+                Vec2f(0.0f), Vec2f(0.0f), Vec2f(0.0f)};
+            if (FragmentStage::kNeedsTexture)
+            {
+                for (int k = 0; k < 3; ++k)
+                    inTri.texCoords[k] = model.texCoords[ctx.uvIndices[i + k]];
+            }
+
+            Vec3f base[3] = {ctx.tint, ctx.tint, ctx.tint};
+            if (useModelColors)
+            {
+                base[0] = model.colors[i0] * ctx.tint;
+                base[1] = model.colors[i1] * ctx.tint;
+                base[2] = model.colors[i2] * ctx.tint;
+            }
+
+            // @note Since it survives back face culling, surfNormal should be (+)
+            Vec3f viewPos[3] = {ToVec3(m_viewPos.Get(i0)), ToVec3(m_viewPos.Get(i1)), ToVec3(m_viewPos.Get(i2))};
+            Vec3f faceNormal = ToVec3(Math::MultiplyVecMat(Vec4f{surfNormal.x, surfNormal.y, surfNormal.z, 0.0f}, normalMat));
+            VertexStage::Shade(*this, ctx, i, faceNormal, viewPos, base, inTri);
+
+            m_clippedTris.clear();
+            if (orCode == 0)
+                m_clippedTris.push_back(inTri);
+            else
+                ClipAndProject(inTri, orCode, w, h, m_clippedTris);
+
+            for (const Triangle& tri : m_clippedTris)
+            {
+                // Already in raster space
+                Vec3f v0 = ToVec3(tri.verts[0]);
+                Vec3f v1 = ToVec3(tri.verts[1]);
+                Vec3f v2 = ToVec3(tri.verts[2]);
+
+                QuadSetup setup;
+                setup.v0 = v0;
+                setup.v1 = v1;
+                setup.v2 = v2;
+                float area = ComputeEdge(v0, v1, v2);
+                if (Helper::IsEqual(area, 0.0f))
+                    continue;
+                ++m_stats.rasterized;
+                setup.invArea = 1.0f / area;
+                setup.stepX[0] = 2.0f * (v2.y - v1.y);
+                setup.stepX[1] = 2.0f * (v0.y - v2.y);
+                setup.stepX[2] = 2.0f * (v1.y - v0.y);
+                setup.oneOverW0 = tri.verts[0].w;
+                setup.oneOverW1 = tri.verts[1].w;
+                setup.oneOverW2 = tri.verts[2].w;
+                setup.minX = std::max(0, (int)(Helper::Min3(v0.x, v1.x, v2.x) - sampleReach));
+                setup.minY = std::max(0, (int)(Helper::Min3(v0.y, v1.y, v2.y) - sampleReach));
+                setup.maxX = std::min(w - 1, (int)(Helper::Max3(v0.x, v1.x, v2.x) + sampleReach));
+                setup.maxY = std::min(h - 1, (int)(Helper::Max3(v0.y, v1.y, v2.y) + sampleReach));
+                setup.sampleReach = sampleReach;
+
+                // Counted in a local, a member would be written back for every quad
+                int shaded = 0;
+                const bool countPixels = m_countPixels;
+                auto shade = [this, &ctx, &tri, &shaded, countPixels](const Quad& quad)
                 {
-                    newTris = ClipTriangleAgainstPlane({-1.0f, 0.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
+                    if (countPixels)
+                        shaded += (quad.mask & 1) + ((quad.mask >> 1) & 1) + ((quad.mask >> 2) & 1) + (quad.mask >> 3);
+                    FragmentStage::Shade(*this, ctx, tri, quad);
+                };
+                RasterTraversal traversal = m_traversal;
+                if (traversal == RasterTraversal::kAuto)
+                    traversal = PickTraversal(setup);
+                if (m_oit)
+                {
+                    PixelCover<false> cover{m_msaa ? m_msaa->GetDepth(0) : ctx.zBuffer, w};
+                    switch (traversal)
+                    {
+                    case RasterTraversal::kBoundingBox: { TraverseBoundingBox(setup, cover, shade); break; }
+                    case RasterTraversal::kBlocks: { TraverseBlocks(setup, cover, shade); break; }
+                    default: { TraverseSpans(setup, cover, shade); break; }
+                    }
                 }
-                case Plane::kBottom:
+                else if (m_msaa)
                 {
-                    newTris = ClipTriangleAgainstPlane({0.0f, 1.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
+                    SampleSetup samples;
+                    SetupSamples(setup, *m_msaa, samples);
+                    SampleCover cover{samples, *m_msaa, w};
+                    if (traversal == RasterTraversal::kBoundingBox)
+                        TraverseBoundingBox(setup, cover, shade);
+                    else
+                        TraverseBlocks(setup, cover, shade);
                 }
-                case Plane::kLeft:
+                else
                 {
-                    newTris = ClipTriangleAgainstPlane({1.0f, 0.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
+                    PixelCover<true> cover{ctx.zBuffer, w};
+                    switch (traversal)
+                    {
+                    case RasterTraversal::kBoundingBox: { TraverseBoundingBox(setup, cover, shade); break; }
+                    case RasterTraversal::kBlocks: { TraverseBlocks(setup, cover, shade); break; }
+                    default: { TraverseSpans(setup, cover, shade); break; }
+                    }
                 }
-                }   // End switch
+                m_stats.pixelsShaded += shaded;
 
-                for (auto &newTri : newTris)
-                    clippedTris.push_back(std::move(newTri));
+            }   // End of insidePts
 
-            }   // End while
+        }   // End of vertIndices
+    }   // End of clusters
 
-        }
+    FlushPhongPixels(ctx.pixels);
+}
 
-        for (int j = 0; j < clippedTris.size(); ++j)
+void Rasterizer::DrawEdges(const DrawContext& ctx, const Mat44f& modelViewMat, const Mat44f& projMat)
+{
+    const int w = ctx.w;
+    const int h = ctx.h;
+    ProcessVerts(ctx.model, modelViewMat, projMat, Mat44f{}, false, w, h);
+
+    // Which tris face the camera, culled like in DrawTris(). The tris of a culled cluster don't,
+    // whichever way they face.
+    Vec4f planes[Plane::kCount];
+    ToObjectSpace(modelViewMat * projMat, planes);
+    Mat44f invModelView = Math::Inverse(modelViewMat);
+    Vec3f eye{invModelView(3, 0), invModelView(3, 1), invModelView(3, 2)};
+    m_triFacing.assign(ctx.vertIndices.size() / 3, 0);
+
+    const int clusterCnt = ctx.clusters.empty() ? 1 : (int)ctx.clusters.size();
+    for (int c = 0; c < clusterCnt; ++c)
+    {
+        int first = 0;
+        int last = (int)ctx.vertIndices.size();
+        if (!ctx.clusters.empty())
         {
-            // Perspective divide to NDC space
-            v0 = clippedTris[j].verts[0] / clippedTris[j].wCoords[0];
-            v1 = clippedTris[j].verts[1] / clippedTris[j].wCoords[1];
-            v2 = clippedTris[j].verts[2] / clippedTris[j].wCoords[2];
-            c0 = clippedTris[j].colors[0];
-            c1 = clippedTris[j].colors[1];
-            c2 = clippedTris[j].colors[2];
+            const Cluster& cluster = ctx.clusters[c];
+            if (IsOutside(cluster.bounds, planes) || IsBackFacing(cluster, eye))
+            {
+                ++m_stats.clustersCulled;
+                continue;
+            }
+            first = cluster.firstIndex;
+            last = cluster.firstIndex + cluster.indexCount;
+        }
 
-            // To raster space
-            v0.x = (v0.x + 1.0f) * w / 2;
-            v0.y = (v0.y + 1.0f) * h / 2;
-            v1.x = (v1.x + 1.0f) * w / 2;
-            v1.y = (v1.y + 1.0f) * h / 2;
-            v2.x = (v2.x + 1.0f) * w / 2;
-            v2.y = (v2.y + 1.0f) * h / 2;
+        for (int i = first; i < last; i += 3)
+        {
+            int i0 = ctx.vertIndices[i];
+            int i1 = ctx.vertIndices[i + 1];
+            int i2 = ctx.vertIndices[i + 2];
+            ++m_stats.submitted;
 
-            if (mode == QRendererMode::kWireframe)
+            uint8_t orCode = m_outcodes[i0] | m_outcodes[i1] | m_outcodes[i2];
+            if (m_outcodes[i0] & m_outcodes[i1] & m_outcodes[i2])
             {
-                DrawLine(pixels, ToColor(255, 255, 255, 255), w, (int)v0.x, (int)v1.x, (int)v0.y, (int)v1.y);
-                DrawLine(pixels, ToColor(255, 255, 255, 255), w, (int)v1.x, (int)v2.x, (int)v1.y, (int)v2.y);
-                DrawLine(pixels, ToColor(255, 255, 255, 255), w, (int)v2.x, (int)v0.x, (int)v2.y, (int)v0.y);
+                ++m_stats.outsideFrustum;
+                continue;
             }
-            else
+            const float area = (orCode == 0) ?
+                ComputeEdge(ToVec3(m_rasterPos.Get(i0)), ToVec3(m_rasterPos.Get(i1)), ToVec3(m_rasterPos.Get(i2))) :
+                HomogeneousArea(m_clipPos.Get(i0), m_clipPos.Get(i1), m_clipPos.Get(i2));
+            if (area <= 0.0f)
             {
-                float oneOverW0 = 1.0f / clippedTris[j].wCoords[0];
-                float oneOverW1 = 1.0f / clippedTris[j].wCoords[1];
-                float oneOverW2 = 1.0f / clippedTris[j].wCoords[2];
+                ++m_stats.backFacing;
+                continue;
+            }
+            if (orCode)
+                ++m_stats.clipped;
+            m_triFacing[i / 3] = 1;
+        }
+    }
 
-                float areaOfParallelogram = ComputeEdge(v0, v1, v2);
-                if (Helper::IsEqual(areaOfParallelogram, 0.0f))
-                    continue;
-                int bbMinX = (int)Helper::Min3(v0.x, v1.x, v2.x);
-                int bbMaxX = (int)Helper::Max3(v0.x, v1.x, v2.x);
-                int bbMinY = (int)Helper::Min3(v0.y, v1.y, v2.y);
-                int bbMaxY = (int)Helper::Max3(v0.y, v1.y, v2.y);
+    // The lines that cross a clipping plane are cut in clip space, then projected like
+    // ClipAndProject() does. DrawLine() clips the rest to the viewport.
+    const uint32_t color = ToColor(255, 255, 255, 255);
+    float *depth = m_lineDepthTest ? (m_msaa ? m_msaa->GetDepth(0) : ctx.zBuffer) : nullptr;
+    const float halfW = w / 2.0f;
+    const float halfH = h / 2.0f;
+    auto drawEdge = [this, &ctx, color, depth, w, h, halfW, halfH](int i0, int i1)
+    {
+        if (m_outcodes[i0] & m_outcodes[i1])
+            return;
+        const uint8_t orCode = m_outcodes[i0] | m_outcodes[i1];
+        Vec4f p0 = orCode ? m_clipPos.Get(i0) : m_rasterPos.Get(i0);
+        Vec4f p1 = orCode ? m_clipPos.Get(i1) : m_rasterPos.Get(i1);
+        if (orCode)
+        {
+            if (!ClipLine(orCode, p0, p1))
+                return;
+            for (Vec4f *v : {&p0, &p1})
+            {
+                float oneOverW = 1.0f / v->w;
+                v->x = (v->x * oneOverW + 1.0f) * halfW;
+                v->y = (v->y * oneOverW + 1.0f) * halfH;
+                v->z = v->z * oneOverW;
+                v->w = oneOverW;
+            }
+        }
+        ++m_stats.linesDrawn;
+        DrawLine(ctx.pixels, depth, color, w, h, p0, p1);
+    };
 
-                bbMinX = std::max(0, bbMinX);
-                bbMinY = std::max(0, bbMinY);
-                bbMaxX = std::min(w - 1, bbMaxX);
-                bbMaxY = std::min(h - 1, bbMaxY);
+    // Models built by hand have no edge list, each of their tris draws its own edges
+    if (ctx.edges.empty())
+    {
+        for (int t = 0; t < (int)m_triFacing.size(); ++t)
+        {
+            if (!m_triFacing[t])
+                continue;
+            const int *tri = &ctx.vertIndices[t * 3];
+            drawEdge(tri[0], tri[1]);
+            drawEdge(tri[1], tri[2]);
+            drawEdge(tri[2], tri[0]);
+        }
+        return;
+    }
 
-                for (int y = bbMinY; y <= bbMaxY; ++y)
-                {
-                    for (int x = bbMinX; x <= bbMaxX; ++x)
-                    {
-                        Vec3f pt{(float)x, (float)y, 0.0f};
-
-                        // Inside-outside test
-                        float e12 = ComputeEdge(v1, v2, pt);
-                        float e20 = ComputeEdge(v2, v0, pt);
-                        float e01 = ComputeEdge(v0, v1, pt);
-                        if (e01 < 0.0f || e12 < 0.0f || e20 < 0.0f)
-                            continue;
-
-                        assert(!Helper::IsEqual(areaOfParallelogram, 0.0f));
-                        float t0 = e12 / areaOfParallelogram;
-                        float t1 = e20 / areaOfParallelogram;
-                        float t2 = e01 / areaOfParallelogram;
-                        float oneOverW = t0 * oneOverW0 + t1 * oneOverW1 + t2 * oneOverW2;
-                        Vec3f color = (1.0f / oneOverW) * (c0 * oneOverW0 * t0 + c1 * oneOverW1 * t1 + c2 * oneOverW2 * t2);
-
-                        uint8_t r = ClampChannel(color.r);
-                        uint8_t g = ClampChannel(color.g);
-                        uint8_t b = ClampChannel(color.b);
-
-                        // @note If z < zBuffer, the triangle is closer, and update new zBuffer.
-                        // Instead, since we use oneOverZ, it's actually inverse, and zBuffer filled
-                        // with 0 actually represent the furthest (infinitely)
-                        if (oneOverW > zBuffer[x + y * w])
-                        {
-                            if (mode == QRendererMode::kZBuffer)
-                            {
-                                uint8_t c = ClampChannel(oneOverW);
-                                pixels[x + y * w] = ToColor(c, c, c, 255);
-                                zBuffer[x + y * w] = oneOverW;
-                            }
-                            else
-                            {
-                                pixels[x + y * w] = ToColor(r, g, b, 255);
-                                zBuffer[x + y * w] = oneOverW;
-                            }
-                        }
-                    }
-                }
-            }
+    // A shared edge is drawn once, as long as one of its tris faces the camera
+    for (const auto& edge : ctx.edges)
+    {
+        if (m_triFacing[edge.tri0] || (edge.tri1 >= 0 && m_triFacing[edge.tri1]))
+            drawEdge(edge.v0, edge.v1);
+    }
+}
 
-        }   // End of insidePts
+void Rasterizer::Draw(const DrawContext& ctx, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode)
+{
+    const bool isTextured = (ctx.texture != nullptr);
+    switch (mode)
+    {
+    case QRendererMode::kNone:
+    {
+        if (isTextured) { DrawTris<FlatVertex, TexturedFragment>(ctx, modelViewMat, projMat); }
+        else { DrawTris<FlatVertex, ColorFragment>(ctx, modelViewMat, projMat); }
+        break;
+    }
+    case QRendererMode::kWireframe:
+    {
+        DrawEdges(ctx, modelViewMat, projMat);
+        break;
+    }
+    case QRendererMode::kZBuffer:
+    {
+        DrawTris<UnlitVertex, DepthFragment>(ctx, modelViewMat, projMat);
+        break;
+    }
+    case QRendererMode::kGouraud:
+    {
+        if (isTextured) { DrawTris<GouraudVertex, TexturedFragment>(ctx, modelViewMat, projMat); }
+        else { DrawTris<GouraudVertex, ColorFragment>(ctx, modelViewMat, projMat); }
+        break;
+    }
+    case QRendererMode::kPhong:
+    {
+        if (isTextured) { DrawTris<PhongVertex, LitTexturedFragment>(ctx, modelViewMat, projMat); }
+        else { DrawTris<PhongVertex, LitColorFragment>(ctx, modelViewMat, projMat); }
+        break;
+    }
+    }
+}
 
-    }   // End of vertIndices
+void Rasterizer::Rasterize(uint32_t *pixels, float *zBuffer, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode, int lod)
+{
+    RasterizeInstance(pixels, zBuffer, nullptr, w, h, model, modelViewMat, projMat, mode, Vec3f{1.0f, 1.0f, 1.0f}, lod);
 }
 
-void Rasterizer::Rasterize(uint32_t *pixels, float *zBuffer, QTexture *texture, int w, int h, const Model& model, const Mat44f& projMat, QRendererMode mode)
+void Rasterizer::Rasterize(uint32_t *pixels, float *zBuffer, QTexture *texture, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode, int lod)
 {
+    assert(texture && "Uh oh, texture is empty!");
+
     texture->LockTexture();
+    RasterizeInstance(pixels, zBuffer, texture, w, h, model, modelViewMat, projMat, mode, Vec3f{1.0f, 1.0f, 1.0f}, lod);
+    texture->UnlockTexture();
+}
+
+void Rasterizer::RasterizeInstance(uint32_t *pixels, float *zBuffer, const QTexture *texture, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat, QRendererMode mode, const Vec3f& tint, int lod)
+{
     assert(!model.verts.empty() && "Uh oh, model is empty!");
-    assert(texture && "Uh oh, texture is empty!");
+    assert(lod >= 0 && lod <= (int)model.lods.size() && "Uh oh, lod is out of range!");
 
-    for (int i = 0; i < model.vertIndices.size(); i += 3)
+    if (texture && texture->GetFormat() != TextureFormat::kRGBA32)
     {
-        Vec3f v0 = model.verts[model.vertIndices[i]];
-        Vec3f v1 = model.verts[model.vertIndices[i + 1]];
-        Vec3f v2 = model.verts[model.vertIndices[i + 2]];
+        for (DecodedBlock& cached : m_blockCache)
+            cached.block = nullptr;
+    }
 
-        Vec2f uv0 = model.texCoords[model.uvIndices[i]];
-        Vec2f uv1 = model.texCoords[model.uvIndices[i + 1]];
-        Vec2f uv2 = model.texCoords[model.uvIndices[i + 2]];
+    if (lod == 0)
+    {
+        DrawContext ctx{pixels, zBuffer, w, h, model, model.vertIndices, model.uvIndices, model.nIndices, model.clusters, model.edges, texture, tint};
+        Draw(ctx, modelViewMat, projMat, mode);
+    }
+    else
+    {
+        const Lod& level = model.lods[lod - 1];
+        DrawContext ctx{pixels, zBuffer, w, h, model, level.vertIndices, level.uvIndices, level.nIndices, level.clusters, level.edges, texture, tint};
+        Draw(ctx, modelViewMat, projMat, mode);
+    }
+}
 
-        // Back face culling in cam space
-        Vec3f surfNormal = Math::Normal(Math::Cross(v2 - v0, v1 - v0));
-        if (Math::Dot(v0, surfNormal) > 0.0f)
-            continue;
+void Rasterizer::RasterizeDepth(float *zBuffer, int w, int h, const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat)
+{
+    assert(!model.verts.empty() && "Uh oh, model is empty!");
 
-        // Flat shading. @note z-axis isn't inverted until perspective divide! 
-        Vec3f lightDir = Math::Normal(Vec3f{0.0f, -1.0f, -1.0f});
-        // @note Since it survives back face culling, surfNormal should be (+)
-        float dp = Math::Dot(lightDir, surfNormal);
-
-        // To clip space
-        std::vector<float> wCoords = {-v0.z, -v1.z, -v2.z};
-        v0 = Math::MultiplyVecMat(v0, projMat);
-        v1 = Math::MultiplyVecMat(v1, projMat);
-        v2 = Math::MultiplyVecMat(v2, projMat);
-
-        // Clipping
-        enum Plane
-        {
-            kNear,
-            kTop,
-            kRight,
-            kBottom,
-            kLeft,
-            kCount
-        };
-        std::deque<Triangle> clippedTris;
-        clippedTris.push_back(Triangle(v0, v1, v2, uv0, uv1, uv2, wCoords[0], wCoords[1], wCoords[2]));
-        for (int p = Plane::kNear; p != Plane::kCount; ++p)
-        {
-            size_t oldCnt = clippedTris.size();
-            while (oldCnt-- > 0)
-            {
-                Triangle tri = clippedTris.front();
-                clippedTris.pop_front();
-                std::vector<Triangle> newTris;
-                switch (p)
-                {
-                case Plane::kNear:
-                {
-                    newTris = ClipTriangleAgainstPlane({0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.5f}, tri);
-                    break;
-                }
-                case Plane::kTop:
-                {
-                    newTris = ClipTriangleAgainstPlane({0.0f, -1.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
-                }
-                case Plane::kRight:
-                {
-                    newTris = ClipTriangleAgainstPlane({-1.0f, 0.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
-                }
-                case Plane::kBottom:
-                {
-                    newTris = ClipTriangleAgainstPlane({0.0f, 1.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
-                }
-                case Plane::kLeft:
-                {
-                    newTris = ClipTriangleAgainstPlane({1.0f, 0.0f, 1.0f}, Vec3f(0.0f), tri);
-                    break;
-                }
-                }   // End switch
+    MultisampleBuffer *msaa = m_msaa;
+    TransparencyBuffer *oit = m_oit;
+    const RasterStats stats = m_stats;
+    m_msaa = nullptr;
+    m_oit = nullptr;
+    if (model.clusters.empty() || !IsOutsideFrustum(model.bounds, modelViewMat * projMat))
+    {
+        DrawContext ctx{nullptr, zBuffer, w, h, model, model.vertIndices, model.uvIndices, model.nIndices, model.clusters, model.edges, nullptr, Vec3f{1.0f, 1.0f, 1.0f}};
+        DrawTris<UnlitVertex, DepthOnlyFragment>(ctx, modelViewMat, projMat);
+    }
+    m_msaa = msaa;
+    m_oit = oit;
+    m_stats = stats;
+}
 
-                for (auto &newTri : newTris)
-                    clippedTris.push_back(std::move(newTri));
+void Rasterizer::SetLights(const std::vector<Light>& lights, const Mat44f& viewMat)
+{
+    m_lights.Upload(lights, viewMat);
+}
 
-            }   // End while
+void Rasterizer::SetTraversal(RasterTraversal traversal) { m_traversal = traversal; }
 
-        }
-    
-        for (int j = 0; j < clippedTris.size(); ++j)
-        {
-            // Perspective divide to NDC space
-            v0 = clippedTris[j].verts[0] / clippedTris[j].wCoords[0];
-            v1 = clippedTris[j].verts[1] / clippedTris[j].wCoords[1];
-            v2 = clippedTris[j].verts[2] / clippedTris[j].wCoords[2];
+void Rasterizer::SetTextureFilter(TextureFilter filter) { m_filter = filter; }
 
-            // @note Texture wrap?
-#if 0
-            uv0 = Vec2f{fmod(clippedTris[j].texCoords[0].e[0], 1.0f), fmod(clippedTris[j].texCoords[0].e[1], 1.0f)};
-            uv1 = Vec2f{fmod(clippedTris[j].texCoords[1].e[0], 1.0f), fmod(clippedTris[j].texCoords[1].e[1], 1.0f)};
-            uv2 = Vec2f{fmod(clippedTris[j].texCoords[2].e[0], 1.0f), fmod(clippedTris[j].texCoords[2].e[1], 1.0f)};
-#endif
-            uv0 = clippedTris[j].texCoords[0];
-            uv1 = clippedTris[j].texCoords[1];
-            uv2 = clippedTris[j].texCoords[2];
-
-            // To raster space
-            v0.x = (v0.x + 1.0f) * w / 2;
-            v0.y = (v0.y + 1.0f) * h / 2;
-            v1.x = (v1.x + 1.0f) * w / 2;
-            v1.y = (v1.y + 1.0f) * h / 2;
-            v2.x = (v2.x + 1.0f) * w / 2;
-            v2.y = (v2.y + 1.0f) * h / 2;
-
-            if (mode == QRendererMode::kWireframe)
-            {
-                DrawLine(pixels, ToColor(255, 255, 255, 255), w, (int)v0.x, (int)v1.x, (int)v0.y, (int)v1.y);
-                DrawLine(pixels, ToColor(255, 255, 255, 255), w, (int)v1.x, (int)v2.x, (int)v1.y, (int)v2.y);
-                DrawLine(pixels, ToColor(255, 255, 255, 255), w, (int)v2.x, (int)v0.x, (int)v2.y, (int)v0.y);
-            }
-            else
-            {
-                float oneOverW0 = 1.0f / clippedTris[j].wCoords[0];
-                float oneOverW1 = 1.0f / clippedTris[j].wCoords[1];
-                float oneOverW2 = 1.0f / clippedTris[j].wCoords[2];
+void Rasterizer::SetPixelCounting(bool enable) { m_countPixels = enable; }
 
-                float areaOfParallelogram = ComputeEdge(v0, v1, v2);
-                if (Helper::IsEqual(areaOfParallelogram, 0.0f))
-                    continue;
-                int bbMinX = (int)Helper::Min3(v0.x, v1.x, v2.x);
-                int bbMaxX = (int)Helper::Max3(v0.x, v1.x, v2.x);
-                int bbMinY = (int)Helper::Min3(v0.y, v1.y, v2.y);
-                int bbMaxY = (int)Helper::Max3(v0.y, v1.y, v2.y);
+void Rasterizer::SetMultisampleBuffer(MultisampleBuffer *buffer) { m_msaa = buffer; }
 
-                bbMinX = std::max(0, bbMinX);
-                bbMinY = std::max(0, bbMinY);
-                bbMaxX = std::min(w - 1, bbMaxX);
-                bbMaxY = std::min(h - 1, bbMaxY);
+void Rasterizer::SetShadowMap(const ShadowMap *shadows) { m_shadows = shadows; }
 
-                for (int y = bbMinY; y <= bbMaxY; ++y)
-                {
-                    for (int x = bbMinX; x <= bbMaxX; ++x)
-                    {
-                        Vec3f pt{(float)x, (float)y, 0.0f};
-
-                        // Inside-outside test
-                        float e12 = ComputeEdge(v1, v2, pt);
-                        float e20 = ComputeEdge(v2, v0, pt);
-                        float e01 = ComputeEdge(v0, v1, pt);
-                        if (e01 < 0.0f || e12 < 0.0f || e20 < 0.0f)
-                            continue;
-
-                        assert(!Helper::IsEqual(areaOfParallelogram, 0.0f));
-                        float t0 = e12 / areaOfParallelogram;
-                        float t1 = e20 / areaOfParallelogram;
-                        float t2 = e01 / areaOfParallelogram;
-                        float oneOverW = t0 * oneOverW0 + t1 * oneOverW1 + t2 * oneOverW2;
-                        Vec2f uv = (1.0f / oneOverW) * (uv0 * oneOverW0 * t0 + uv1 * oneOverW1 * t1 + uv2 * oneOverW2 * t2);
-
-                        int uvX = std::min(texture->GetW() - 1, (int)(uv.x * texture->GetW() + 0.5f));
-                        int uvY = std::min(texture->GetH() - 1, (int)(uv.y * texture->GetH() + 0.5f));
-                        uint32_t myColor = texture->GetTexels()[uvX + uvY * texture->GetW()];
-                        // @note If z < zBuffer, the triangle is closer, and update new zBuffer.
-                        // Instead, since we use oneOverZ, it's actually inverse, and zBuffer filled
-                        // with 0 actually represent the furthest (infinitely)
-                        if (oneOverW > zBuffer[x + y * w])
-                        {
-                            if (mode == QRendererMode::kZBuffer)
-                            {
-                                uint8_t c = ClampChannel(oneOverW);
-                                pixels[x + y * w] = ToColor(c, c, c, 255);
-                                zBuffer[x + y * w] = oneOverW;
-                            }
-                            else
-                            {
-                                uint8_t r, g, b, a;
-                                ToComponent(myColor, r, g, b, a);
-
-                                // Change to range 0-1 to perform calculations, and change back to
-                                // 0-255 for outputs. This somehow avoid white triangles around the
-                                // model
-                                r = ClampChannel(((float)r / 255.0f) * -dp);
-                                g = ClampChannel(((float)g / 255.0f) * -dp);
-                                b = ClampChannel(((float)b / 255.0f) * -dp);
-                                a = ClampChannel(((float)a / 255.0f) * -dp);
-
-                                // @todo It seems that we don't have to worry about gamma correction?
-                                //pixels[x + y * w] = ToColor(DecodeGamma(r) * -dp, DecodeGamma(g) * -dp, DecodeGamma(b) * -dp, DecodeGamma(a) * -dp);
-                                pixels[x + y * w] = ToColor(r, g, b, a);
-                                //pixels[x + y * w] = myColor;
-                                zBuffer[x + y * w] = oneOverW;
-                            }
-                        }
-                    }
-                }
-            }
+void Rasterizer::SetTransparency(TransparencyBuffer *buffer, float opacity)
+{
+    m_oit = buffer;
+    m_opacity = opacity;
+}
 
-        }   // End of insidePts
+void Rasterizer::SetLineDepthTest(bool enable) { m_lineDepthTest = enable; }
 
-    }   // End of vertIndices
+bool Rasterizer::IsOutsideFrustum(const Bounds& bounds, const Mat44f& mvp)
+{
+    Vec4f planes[Plane::kCount];
+    ToObjectSpace(mvp, planes);
+    if (!IsOutside(bounds, planes))
+        return false;
 
-    texture->UnlockTexture();
+    ++m_stats.modelsCulled;
+    return true;
+}
+
+void Rasterizer::ClearOccluders() { m_occluders.Clear(); }
+
+void Rasterizer::RasterizeOccluder(const Model& model, const Mat44f& mvp) { m_occluders.Rasterize(model, mvp); }
+
+bool Rasterizer::IsOccluded(const Bounds& bounds, const Mat44f& mvp)
+{
+    if (!m_occluders.IsOccluded(bounds, mvp))
+        return false;
+
+    ++m_stats.modelsOccluded;
+    return true;
+}
+
+const RasterStats& Rasterizer::GetStats() const { return m_stats; }
+
+void Rasterizer::ResetStats() { m_stats = RasterStats{}; }
+
+void Rasterizer::AddStats(const RasterStats& stats)
+{
+    m_stats.modelsCulled += stats.modelsCulled;
+    m_stats.modelsOccluded += stats.modelsOccluded;
+    m_stats.clustersCulled += stats.clustersCulled;
+    m_stats.submitted += stats.submitted;
+    m_stats.outsideFrustum += stats.outsideFrustum;
+    m_stats.backFacing += stats.backFacing;
+    m_stats.noSamples += stats.noSamples;
+    m_stats.clipped += stats.clipped;
+    m_stats.rasterized += stats.rasterized;
+    m_stats.pixelsShaded += stats.pixelsShaded;
+    m_stats.blocksDecoded += stats.blocksDecoded;
+    m_stats.linesDrawn += stats.linesDrawn;
 }
 
 
+
 unsigned char Rasterizer::DecodeGamma(int value)
 {
     return g_gammaDecodedTable[value];
@@ -436,8 +1560,83 @@ uint8_t Rasterizer::ClampChannel(float channel)
     return (uint8_t)std::max(0.0f, std::min(1.0f, channel) * 255.0f + 0.5f);
 }
 
-void Rasterizer::DrawLine(uint32_t* pixels, uint32_t color, int w, int x0, int x1, int y0, int y1)
+namespace
+{
+    // @brief Lines are depth tested with their 1/w scaled up by this, so that they win against the
+    // tris they're the edges of, whose pixel centers are up to half a pixel off the line. Surfaces at
+    // grazing angles change depth quickly across that half pixel, hence the few %.
+    constexpr float kLineDepthBias = 1.0f + 1.0f / 32.0f;
+
+    // @brief Lines with rows at least that long on average are written a row at a time
+    constexpr int kMinLineSpan = 4;
+
+    // @brief Write count pixels of a row of a line from pixels[0]. With depth, only those nearer
+    // than depth are written, 1/w starts at oneOverW and moves by step per pixel.
+    void WriteLineSpan(uint32_t *pixels, const float *depth, int count, uint32_t color, float oneOverW, float step)
+    {
+        int i = 0;
+#if defined(QR_SIMD_SSE)
+        const __m128i color4 = _mm_set1_epi32((int)color);
+        if (!depth)
+        {
+            for (; i + 4 <= count; i += 4)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), color4);
+        }
+        else
+        {
+            // Same float ops per pixel as the scalar loop below
+            const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+            const __m128 start = _mm_set1_ps(oneOverW);
+            const __m128 step4 = _mm_set1_ps(step);
+            const __m128 bias = _mm_set1_ps(kLineDepthBias);
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 z = _mm_add_ps(start, _mm_mul_ps(step4, _mm_add_ps(_mm_set1_ps((float)i), lanes)));
+                __m128i isNearer = _mm_castps_si128(_mm_cmpge_ps(_mm_mul_ps(z, bias), _mm_loadu_ps(depth + i)));
+                __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i),
+                    _mm_or_si128(_mm_and_si128(isNearer, color4), _mm_andnot_si128(isNearer, old)));
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            if (!depth || (oneOverW + step * (float)i) * kLineDepthBias >= depth[i])
+                pixels[i] = color;
+        }
+    }
+}
+
+void Rasterizer::DrawLine(uint32_t *pixels, float *zBuffer, uint32_t color, int w, int h, const Vec4f& p0, const Vec4f& p1)
 {
+    // Liang-Barsky against [0, w - 1] x [0, h - 1], the part of the line where p * t <= q for each
+    // side. The ends are rounded to the nearest pixel center and clamped, so they stay in the buffer.
+    const float dx = p1.x - p0.x;
+    const float dy = p1.y - p0.y;
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    auto clip = [&t0, &t1](float p, float q)
+    {
+        if (p == 0.0f)
+            return q >= 0.0f;
+        if (p < 0.0f)
+            t0 = std::max(t0, q / p);
+        else
+            t1 = std::min(t1, q / p);
+        return t0 <= t1;
+    };
+    if (!clip(-dx, p0.x) || !clip(dx, (float)(w - 1) - p0.x) || !clip(-dy, p0.y) || !clip(dy, (float)(h - 1) - p0.y))
+        return;
+
+    // Ends that aren't clipped are kept exactly, a + (b - a) * 1 may not round to b
+    auto lerp = [t0, t1](float a, float b, bool isEnd) { return isEnd ? ((t1 < 1.0f) ? a + (b - a) * t1 : b) : ((t0 > 0.0f) ? a + (b - a) * t0 : a); };
+    int x0 = std::max(0, std::min(w - 1, (int)(lerp(p0.x, p1.x, false) + 0.5f)));
+    int y0 = std::max(0, std::min(h - 1, (int)(lerp(p0.y, p1.y, false) + 0.5f)));
+    int x1 = std::max(0, std::min(w - 1, (int)(lerp(p0.x, p1.x, true) + 0.5f)));
+    int y1 = std::max(0, std::min(h - 1, (int)(lerp(p0.y, p1.y, true) + 0.5f)));
+    float z0 = lerp(p0.w, p1.w, false);
+    float z1 = lerp(p0.w, p1.w, true);
+
     bool isSteep = false;
     if (std::abs(y1 - y0) > std::abs(x1 - x0))
     {
@@ -450,30 +1649,53 @@ void Rasterizer::DrawLine(uint32_t* pixels, uint32_t color, int w, int x0, int x
     {
         std::swap(x0, x1);
         std::swap(y0, y1);
+        std::swap(z0, z1);
     }
 
-    int dx = x1 - x0;
-    int dy = y1 - y0;
+    int dxInt = x1 - x0;
+    int dyInt = y1 - y0;
     int yDir = 1;
-    if (dy < 0)
+    if (dyInt < 0)
     {
-        dy = -dy;
+        dyInt = -dyInt;
         yDir = -1;
     }
-    int e2 = 2 * dy - dx;
+    const float zStep = (dxInt > 0) ? (z1 - z0) / dxInt : 0.0f;
+
+    // The error is tested after each pixel and before it's stepped, so that the line ends at y1
+    int e2 = 2 * dyInt - dxInt;
     int y = y0;
+
+    // Mostly horizontal lines step through rows of kMinLineSpan pixels or more, which are contiguous
+    // in memory. Each row is written at once, its length is solved from the error rather than
+    // walked. e2 <= 0 at the start of each row since the line is that shallow.
+    if (!isSteep && dyInt * kMinLineSpan <= dxInt)
+    {
+        for (int x = x0; x <= x1;)
+        {
+            // The row ends at the first pixel after which e2 > 0
+            const int rowLength = (dyInt == 0) ? x1 + 1 - x : std::min(x1 + 1 - x, -e2 / (2 * dyInt) + 2);
+            const int i = x + y * w;
+            WriteLineSpan(pixels + i, zBuffer ? zBuffer + i : nullptr, rowLength, color, z0 + zStep * (float)(x - x0), zStep);
+            x += rowLength;
+            e2 += 2 * dyInt * rowLength - 2 * dxInt;
+            y += yDir;
+        }
+        return;
+    }
+
     for (int x = x0; x <= x1; ++x)
     {
-        if (isSteep) { pixels[y + x * w] = color; }
-        else { pixels[x + y * w] = color; }
-        e2 += 2 * dy;
+        const int i = isSteep ? y + x * w : x + y * w;
+        if (!zBuffer || (z0 + zStep * (float)(x - x0)) * kLineDepthBias >= zBuffer[i])
+            pixels[i] = color;
         if (e2 > 0)
         {
-            e2 -= 2 * dx;
+            e2 -= 2 * dxInt;
             y += yDir;
         }
+        e2 += 2 * dyInt;
     }
-
 }
 
 void Rasterizer::TestDrawLine(uint32_t * pixels, int scrW, int scrH)
@@ -496,13 +1718,15 @@ void Rasterizer::TestDrawLine(uint32_t * pixels, int scrW, int scrH)
         float newEndP[2]{endP[0] * rotMat[0] + endP[1] * rotMat[2], endP[0] * rotMat[1] + endP[1] * rotMat[3]};
         int x1 = (int)endP[0] + x0;
         int y1 = (int)endP[1] + y0;
+        const Vec4f p0{(float)x0, (float)y0, 0.0f, 1.0f};
+        const Vec4f p1{(float)x1, (float)y1, 0.0f, 1.0f};
         if (x1 - x0 == 0 || y1 - y0 == 0)
         {
-            DrawLine(pixels, red, scrW, x0, x1, y0, y1);
+            DrawLine(pixels, nullptr, red, scrW, scrH, p0, p1);
         }
         else
         {
-            DrawLine(pixels, green, scrW, x0, x1, y0, y1);
+            DrawLine(pixels, nullptr, green, scrW, scrH, p0, p1);
         }
 
         endP[0] = newEndP[0];
@@ -511,143 +1735,238 @@ void Rasterizer::TestDrawLine(uint32_t * pixels, int scrW, int scrH)
 
 }
 
+uint32_t Rasterizer::SampleNearest(const uint32_t *texels, int texW, int texH, const Vec2f& uv)
+{
+    return SampleNearestWith(TexelFetch{texels, texW}, texW, texH, uv);
+}
+
+void Rasterizer::SampleBilinear4(const uint32_t *texels, int texW, int texH, const Vec2f (&uvs)[4], uint32_t (&outTexels)[4])
+{
+    SampleBilinear4With(TexelFetch{texels, texW}, texW, texH, uvs, outTexels);
+}
+
+uint32_t Rasterizer::FetchBlockTexel(const uint8_t *blocks, TextureFormat format, int texW, int x, int y)
+{
+    const int bx = x >> 2, by = y >> 2;
+    const size_t blockSize = (format == TextureFormat::kBC1) ? 8 : 16;
+    const uint8_t *block = blocks + ((size_t)bx + (size_t)by * ((texW + 3) >> 2)) * blockSize;
+    DecodedBlock& cached = m_blockCache[(bx & 7) | ((by & 7) << 3)];
+    if (cached.block != block)
+    {
+        BlockCompression::DecodeBlock(format, block, cached.texels);
+        cached.block = block;
+        ++m_stats.blocksDecoded;
+    }
+    return cached.texels[(x & 3) | ((y & 3) << 2)];
+}
+
 float Rasterizer::ComputeEdge(const Vec3f& a, const Vec3f& b, const Vec3f& c)
 {
     float result = (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
     return result;
 }
 
-std::vector<Triangle> Rasterizer::ClipTriangleAgainstPlane(Vec3f planeN, Vec3f planePt, const Triangle& inTri)
+void Rasterizer::ProcessVerts(const Model& model, const Mat44f& modelViewMat, const Mat44f& projMat,
+    const Mat44f& normalMat, bool needVertNormals, int w, int h)
 {
-    planeN = Math::Normal(planeN);
-    std::vector<Triangle> result;
-
-    std::vector<Point> insidePts;
-    std::vector<Point> outsidePts;
-    insidePts.reserve(6);     // At most 2 new tris are created
-    outsidePts.reserve(3);    // At most the whole tri is clipped
-
-    float planeD = Math::Dot(planeN, planePt);
-    float d0 = Math::Dot(planeN, inTri.verts[0]);
-    float d1 = Math::Dot(planeN, inTri.verts[1]);
-    float d2 = Math::Dot(planeN, inTri.verts[2]);
-    if (d0 >= planeD)
-        insidePts.emplace_back(inTri.verts[0], inTri.texCoords[0], inTri.wCoords[0], inTri.colors[0]);
-    else
-        outsidePts.emplace_back(inTri.verts[0], inTri.texCoords[0], inTri.wCoords[0], inTri.colors[0]);
-
-    if (d1 >= planeD)
-        insidePts.emplace_back(inTri.verts[1], inTri.texCoords[1], inTri.wCoords[1], inTri.colors[1]);
-    else
-        outsidePts.emplace_back(inTri.verts[1], inTri.texCoords[1], inTri.wCoords[1], inTri.colors[1]);
+    Math::ToSoA(model.verts, m_objectPos);
+    Math::TransformPositions(m_objectPos, modelViewMat * projMat, m_clipPos);
+    Math::TransformPositions(m_objectPos, modelViewMat, m_viewPos);
+    if (needVertNormals && !model.nIndices.empty())
+    {
+        Math::ToSoA(model.normals, m_objectNormals);
+        Math::TransformDirections(m_objectNormals, normalMat, m_viewNormals);
+    }
 
-    if (d2 >= planeD)
-        insidePts.emplace_back(inTri.verts[2], inTri.texCoords[2], inTri.wCoords[2], inTri.colors[2]);
-    else
-        outsidePts.emplace_back(inTri.verts[2], inTri.texCoords[2], inTri.wCoords[2], inTri.colors[2]);
+    // @note Verts that are outside of the near plane get garbage here, but they're never used
+    // since their triangles go through ClipAndProject() instead.
+    m_rasterPos = m_clipPos;
+    Math::PerspectiveDivide(m_rasterPos);
+    Math::ViewportTransform(m_rasterPos, w, h);
 
-    // Triangle is outside
-    if (insidePts.size() == 0)
-        return result;
-    if (insidePts.size() == 3)
+    m_outcodes.resize(m_clipPos.Size());
+    for (size_t i = 0; i < m_clipPos.Size(); ++i)
     {
-        result.push_back(inTri);
-        return result;
+        Vec4f v = m_clipPos.Get(i);
+        uint8_t outcode = 0;
+        for (int p = Plane::kNear; p != Plane::kCount; ++p)
+        {
+            if (Math::Dot(g_clipPlanes[p], v) < 0.0f)
+                outcode |= (1 << p);
+        }
+        m_outcodes[i] = outcode;
     }
+}
 
-    if (insidePts.size() == 1 && outsidePts.size() == 2)
+void Rasterizer::ClipAndProject(const Triangle& tri, uint8_t clipMask, int w, int h, std::vector<Triangle>& outTris)
+{
+    std::vector<Triangle>& tris = m_clipScratch;
+    tris.assign(1, tri);
+    for (int p = Plane::kNear; p != Plane::kCount; ++p)
     {
-        debugColor = Vec3f{1.0f, 0.0f, 0.0f};
-
-        float tb, ta;
-        // Assuming v0 v1 v2, outsidePt = v0 v1 are clipped, insidePt = v2, a is intersection in
-        // ray v0v2, b is intersection in ray v1v2
-        Vec3f a = IntersectRayPlane(outsidePts[0].pos, insidePts[0].pos, planeD, planeN, &ta);  // v0v2
-        Vec3f b = IntersectRayPlane(outsidePts[1].pos, insidePts[0].pos, planeD, planeN, &tb);  // v1v2
-
-        float aW = Helper::Interpolate<float, float>(outsidePts[0].wCoord, insidePts[0].wCoord, ta);
-        float bW = Helper::Interpolate<float, float>(outsidePts[1].wCoord, insidePts[0].wCoord, tb);
-
-        Vec2f aTex = Helper::Interpolate<Vec2f, float>(outsidePts[0].texCoord, insidePts[0].texCoord, ta);
-        Vec2f bTex = Helper::Interpolate<Vec2f, float>(outsidePts[1].texCoord, insidePts[0].texCoord, tb);
+        if (!(clipMask & (1 << p)))
+            continue;
 
-        Vec3f aColor = Helper::Interpolate<Vec3f, float>(outsidePts[0].color, insidePts[0].color, ta);
-        Vec3f bColor = Helper::Interpolate<Vec3f, float>(outsidePts[1].color, insidePts[0].color, tb);
-        
-        // New tri is v2ab
-        Vec3f n = Math::Cross(b - insidePts[0].pos, a - insidePts[0].pos);
-        if (Math::Dot(insidePts[0].pos, n) <= 0.0f)
-        {
-            result.push_back(Triangle{insidePts[0].pos, b, a,
-                insidePts[0].texCoord, bTex, aTex,
-                insidePts[0].wCoord, bW, aW,
-                insidePts[0].color, bColor, aColor});
-        }
-        else
+        size_t oldCnt = tris.size();
+        for (size_t j = 0; j < oldCnt; ++j)
         {
-            result.push_back(Triangle{insidePts[0].pos, a, b,
-                insidePts[0].texCoord, aTex, bTex,
-                insidePts[0].wCoord, aW, bW,
-                insidePts[0].color, aColor, bColor});
+            for (auto& newTri : ClipTriangleAgainstPlane(g_clipPlanes[p], tris[j]))
+                tris.push_back(std::move(newTri));
         }
+        tris.erase(tris.begin(), tris.begin() + oldCnt);
     }
 
-    if (outsidePts.size() == 1 && insidePts.size() == 2)
+    // Perspective divide to NDC space, then to raster space. Same math as the batched path.
+    const float halfW = w / 2.0f;
+    const float halfH = h / 2.0f;
+    for (Triangle& newTri : tris)
     {
-        debugColor = Vec3f{0.0f, 1.0f, 0.0f};
+        for (Vec4f& v : newTri.verts)
+        {
+            float oneOverW = 1.0f / v.w;
+            v.x = (v.x * oneOverW + 1.0f) * halfW;
+            v.y = (v.y * oneOverW + 1.0f) * halfH;
+            v.z = v.z * oneOverW;
+            v.w = oneOverW;
+        }
+        outTris.push_back(std::move(newTri));
+    }
+}
 
-        // Assuming v0 v1 v2, outsidePt = v2 is clipped, insidePt = v0 v1, a is intersection in ray
-        // v2v0, b is intersection in ray v2v1
-        float ta, tb;
-        Vec3f a = IntersectRayPlane(outsidePts[0].pos, insidePts[0].pos, planeD, planeN, &ta);  // v2v0
-        Vec3f b = IntersectRayPlane(outsidePts[0].pos, insidePts[1].pos, planeD, planeN, &tb);  // v2v1
+std::vector<Triangle> Rasterizer::ClipTriangleAgainstPlane(const Vec4f& plane, const Triangle& inTri)
+{
+    std::vector<Triangle> result;
 
-        float aW = Helper::Interpolate<float, float>(outsidePts[0].wCoord, insidePts[0].wCoord, ta);
-        float bW = Helper::Interpolate<float, float>(outsidePts[0].wCoord, insidePts[1].wCoord, tb);
+    float d[3];
+    int insideCnt = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        d[k] = Math::Dot(plane, inTri.verts[k]);
+        if (d[k] >= 0.0f)
+            ++insideCnt;
+    }
 
-        Vec2f aTex = Helper::Interpolate<Vec2f, float>(outsidePts[0].texCoord, insidePts[0].texCoord, ta);
-        Vec2f bTex = Helper::Interpolate<Vec2f, float>(outsidePts[0].texCoord, insidePts[1].texCoord, tb);
+    // Triangle is outside
+    if (insideCnt == 0)
+        return result;
+    if (insideCnt == 3)
+    {
+        result.push_back(inTri);
+        return result;
+    }
 
-        Vec3f aColor = Helper::Interpolate<Vec3f, float>(outsidePts[0].color, insidePts[0].color, ta);
-        Vec3f bColor = Helper::Interpolate<Vec3f, float>(outsidePts[0].color, insidePts[1].color, tb);
+    // Walk the edges in order, keeping inside pts and adding an intersection pt whenever an edge
+    // crosses the plane. The polygon then has the same winding order as inTri.
+    // 1 pt is inside -> 3 pts, 2 pts are inside -> 4 pts
+    Point poly[4];
+    int cnt = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        int next = (k + 1) % 3;
+        if (d[k] >= 0.0f)
+        {
+            poly[cnt] = Point{inTri.verts[k], inTri.texCoords[k], inTri.colors[k]};
+            poly[cnt].normal = inTri.normals[k];
+            poly[cnt++].viewPos = inTri.viewPos[k];
+        }
 
-        Vec3f n = Math::Cross(insidePts[1].pos - insidePts[0].pos, a - insidePts[0].pos);
-        if (Math::Dot(insidePts[0].pos, n) <= 0.0f)
+        if ((d[k] >= 0.0f) != (d[next] >= 0.0f))
         {
-            result.push_back(Triangle{insidePts[0].pos, insidePts[1].pos, a,
-                insidePts[0].texCoord, insidePts[1].texCoord, aTex,
-                insidePts[0].wCoord, insidePts[1].wCoord, aW,
-                insidePts[0].color, insidePts[1].color, aColor});
-            result.push_back(Triangle{insidePts[1].pos, b, a,
-                insidePts[1].texCoord, bTex, aTex,
-                insidePts[1].wCoord, bW, aW,
-                insidePts[1].color, bColor, aColor});
+            float t = d[k] / (d[k] - d[next]);
+            poly[cnt] = Point{
+                Helper::Interpolate<Vec4f, float>(inTri.verts[k], inTri.verts[next], t),
+                Helper::Interpolate<Vec2f, float>(inTri.texCoords[k], inTri.texCoords[next], t),
+                Helper::Interpolate<Vec3f, float>(inTri.colors[k], inTri.colors[next], t)};
+            poly[cnt].normal = Helper::Interpolate<Vec3f, float>(inTri.normals[k], inTri.normals[next], t);
+            poly[cnt++].viewPos = Helper::Interpolate<Vec3f, float>(inTri.viewPos[k], inTri.viewPos[next], t);
         }
-        else
+    }
+
+    // Fan the polygon into tris
+    for (int k = 1; k + 1 < cnt; ++k)
+    {
+        const Point *pts[3] = {&poly[0], &poly[k], &poly[k + 1]};
+        Triangle newTri{pts[0]->pos, pts[1]->pos, pts[2]->pos,
+            pts[0]->texCoord, pts[1]->texCoord, pts[2]->texCoord,
+            pts[0]->color, pts[1]->color, pts[2]->color};
+        for (int j = 0; j < 3; ++j)
         {
-            result.push_back(Triangle{insidePts[0].pos, a, insidePts[1].pos,
-                insidePts[0].texCoord, aTex, insidePts[1].texCoord,
-                insidePts[0].wCoord, aW, insidePts[1].wCoord,
-                insidePts[0].color, aColor, insidePts[1].color});
-            result.push_back(Triangle{insidePts[1].pos, a, b,
-                insidePts[1].texCoord, aTex, bTex,
-                insidePts[1].wCoord, aW, bW,
-                insidePts[1].color, aColor, bColor});
+            newTri.normals[j] = pts[j]->normal;
+            newTri.viewPos[j] = pts[j]->viewPos;
         }
-   }
+        result.push_back(newTri);
+    }
 
     // 1 new tri or 2 new tri
     assert(result.size() == 1 || result.size() == 2);
     return result;
 }
 
-Vec3f Rasterizer::IntersectRayPlane(const Vec3f& p0, const Vec3f& p1, float planeD, const Vec3f& planeN, float *outT)
+void Rasterizer::ShadeCorners(const DrawContext& ctx)
+{
+    const size_t cornerCnt = ctx.vertIndices.size();
+    m_cornerLight.resize(cornerCnt);
+    for (size_t i = 0; i < cornerCnt; i += ShadeBatch::kSize)
+    {
+        int cnt = (int)std::min<size_t>(ShadeBatch::kSize, cornerCnt - i);
+        for (int k = 0; k < cnt; ++k)
+        {
+            int vertIndex = ctx.vertIndices[i + k];
+            int nIndex = ctx.nIndices[i + k];
+            m_phongBatch.px[k] = m_viewPos.x[vertIndex];
+            m_phongBatch.py[k] = m_viewPos.y[vertIndex];
+            m_phongBatch.pz[k] = m_viewPos.z[vertIndex];
+            m_phongBatch.nx[k] = m_viewNormals.x[nIndex];
+            m_phongBatch.ny[k] = m_viewNormals.y[nIndex];
+            m_phongBatch.nz[k] = m_viewNormals.z[nIndex];
+        }
+        m_lights.Shade(m_phongBatch, cnt);
+        for (int k = 0; k < cnt; ++k)
+            m_cornerLight[i + k] = Vec3f{m_phongBatch.r[k], m_phongBatch.g[k], m_phongBatch.b[k]};
+    }
+}
+
+void Rasterizer::StagePhongPixel(uint32_t *pixels, int index, int sampleMask, float oneOverW, const Vec3f& base, uint8_t alpha, const Vec3f& pos, const Vec3f& normal)
+{
+    int k = m_phongCnt++;
+    m_phongPixels[k] = index;
+    m_phongSamples[k] = sampleMask;
+    m_phongDepth[k] = oneOverW;
+    m_phongBase[k] = base;
+    m_phongAlpha[k] = alpha;
+    m_phongBatch.px[k] = pos.x;
+    m_phongBatch.py[k] = pos.y;
+    m_phongBatch.pz[k] = pos.z;
+    m_phongBatch.nx[k] = normal.x;
+    m_phongBatch.ny[k] = normal.y;
+    m_phongBatch.nz[k] = normal.z;
+
+    if (m_phongCnt == ShadeBatch::kSize)
+        FlushPhongPixels(pixels);
+}
+
+void Rasterizer::FlushPhongPixels(uint32_t *pixels)
 {
-    Vec3f lineDir = p1 - p0;
-    float t = (planeD - Math::Dot(p0, planeN)) / Math::Dot(lineDir, planeN);
-    if (outT)
-        *outT = t;
-    Vec3f intersectPt = p0 + t * lineDir;
-    return intersectPt;
+    if (m_phongCnt == 0)
+        return;
+
+    // Looked up from the same camera space position and normal as the lighting
+    const bool useShadows = m_shadows && m_lights.HasShadowLight();
+    if (useShadows)
+    {
+        for (int k = 0; k < m_phongCnt; ++k)
+        {
+            m_phongBatch.shadow[k] = m_shadows->Lookup(Vec3f{m_phongBatch.px[k], m_phongBatch.py[k], m_phongBatch.pz[k]},
+                Vec3f{m_phongBatch.nx[k], m_phongBatch.ny[k], m_phongBatch.nz[k]});
+        }
+    }
+    m_lights.Shade(m_phongBatch, m_phongCnt, useShadows);
+
+    // @note In staging order, so if a later pixel passed the depth test at the same index, it wins
+    for (int k = 0; k < m_phongCnt; ++k)
+    {
+        Vec3f color = m_phongBase[k] * Vec3f{m_phongBatch.r[k], m_phongBatch.g[k], m_phongBatch.b[k]};
+        WritePixel(pixels, m_phongPixels[k], ToColor(ClampChannel(color.r), ClampChannel(color.g), ClampChannel(color.b), m_phongAlpha[k]), m_phongSamples[k], m_phongDepth[k]);
+    }
+    m_phongCnt = 0;
 }
-    
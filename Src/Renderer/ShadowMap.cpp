@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "Renderer/ShadowMap.h"
+
+namespace
+{
+    // @brief Distance of the light from the center of a cascade, in radii of its sphere. The
+    // further, the more parallel the light, and the less precise the depth.
+    constexpr float kLightDistance = 16.0f;
+
+    // @brief Blend between logarithmic (1) and uniform (0) splits of the view range
+    constexpr float kSplitBlend = 0.75f;
+
+    // @brief The centers of the cascades snap to a grid of radius / kSnapSteps
+    constexpr float kSnapSteps = 8.0f;
+
+    // @brief Against shadow acne, in texels at the center of the cascade
+    constexpr float kDepthBias = 1.5f;
+    constexpr float kNormalOffset = 1.0f;
+}
+
+void ShadowMap::Init(const ShadowSettings& settings)
+{
+    assert(settings.cascadeCount >= 1 && settings.cascadeCount <= kMaxCascades && "Uh oh, cascade count is out of range!");
+    assert(settings.resolution > 0 && "Uh oh, shadow map resolution has to be positive!");
+    m_settings = settings;
+    m_isFitted = false;
+    m_depth.assign((size_t)settings.resolution * settings.resolution * settings.cascadeCount, 0.0f);
+}
+
+const ShadowSettings& ShadowMap::GetSettings() const { return m_settings; }
+
+int ShadowMap::Fit(const Vec3f& lightDir, const Mat44f& viewMat, const Mat44f& projMat)
+{
+    // Frustum of the camera, see Math::InitPersp(). The near plane is where clip z is 0.
+    const float tanX = 1.0f / projMat(0, 0);
+    const float tanY = 1.0f / projMat(1, 1);
+    const float tanSqr = tanX * tanX + tanY * tanY;
+    const float n = projMat(3, 2) / projMat(2, 2);
+    const float f = std::max(n * 1.01f, m_settings.maxDistance);
+
+    const Mat44f invView = Math::Inverse(viewMat);
+    const Vec3f dir = Math::Normal(lightDir);
+    const Vec3f up = (std::abs(dir.y) > 0.99f) ? Vec3f{1.0f, 0.0f, 0.0f} : Vec3f{0.0f, 1.0f, 0.0f};
+
+    int changed = 0;
+    float splitNear = n;
+    const int cascadeCnt = m_settings.cascadeCount;
+    for (int c = 0; c < cascadeCnt; ++c)
+    {
+        Cascade& cascade = m_cascades[c];
+        const float t = (float)(c + 1) / cascadeCnt;
+        const float splitFar = kSplitBlend * n * std::pow(f / n, t) + (1.0f - kSplitBlend) * (n + (f - n) * t);
+
+        // Bounding sphere of the split, on the view axis where it's as far from the near corners as
+        // from the far ones. It only depends on the projection, not on where the camera looks.
+        const float centerDepth = std::min(0.5f * (1.0f + tanSqr) * (splitNear + splitFar), splitFar);
+        float radius = std::max(std::sqrt(tanSqr * splitFar * splitFar + (splitFar - centerDepth) * (splitFar - centerDepth)),
+            std::sqrt(tanSqr * splitNear * splitNear + (centerDepth - splitNear) * (centerDepth - splitNear)));
+
+        // Snapping moves the center by less than a step
+        const float step = radius / kSnapSteps;
+        radius += step;
+        const Vec4f viewCenter = Math::MultiplyVecMat(Vec4f{0.0f, 0.0f, -centerDepth, 1.0f}, invView);
+        const Vec3f center{std::round(viewCenter.x / step) * step, std::round(viewCenter.y / step) * step, std::round(viewCenter.z / step) * step};
+
+        if (!m_isFitted || dir != m_lightDir || center != cascade.center || radius != cascade.radius)
+        {
+            const float distance = kLightDistance * radius;
+            const float halfFov = std::asin(radius / distance);
+            cascade.center = center;
+            cascade.radius = radius;
+            cascade.texelSize = 2.0f * distance * std::tan(halfFov) / m_settings.resolution;
+            cascade.lightView = Math::InitLookAt(center - dir * distance, center, up);
+
+            // There's no far plane, the near one keeps the casters up to 15 radii towards the light
+            cascade.lightProj = Math::InitPersp(2.0f * halfFov, 1.0f, distance * 0.05f, distance + radius);
+            changed |= 1 << c;
+        }
+        cascade.splitFar = splitFar;
+        cascade.viewToLight = invView * cascade.lightView * cascade.lightProj;
+        splitNear = splitFar;
+    }
+    m_lightDir = dir;
+    m_isFitted = true;
+    return changed;
+}
+
+const Mat44f& ShadowMap::GetLightView(int c) const { return m_cascades[c].lightView; }
+
+const Mat44f& ShadowMap::GetLightProj(int c) const { return m_cascades[c].lightProj; }
+
+float *ShadowMap::GetDepth(int c)
+{
+    assert(c >= 0 && c < m_settings.cascadeCount && "Uh oh, cascade is out of range!");
+    return m_depth.data() + (size_t)c * m_settings.resolution * m_settings.resolution;
+}
+
+void ShadowMap::Clear(int cascadeMask)
+{
+    const size_t planeSize = (size_t)m_settings.resolution * m_settings.resolution;
+    for (int c = 0; c < m_settings.cascadeCount; ++c)
+    {
+        if ((cascadeMask >> c) & 1)
+            std::fill(m_depth.begin() + c * planeSize, m_depth.begin() + (c + 1) * planeSize, 0.0f);
+    }
+}
+
+float ShadowMap::Lookup(const Vec3f& viewPos, const Vec3f& normal) const
+{
+    int c = 0;
+    while (c < m_settings.cascadeCount && -viewPos.z > m_cascades[c].splitFar)
+        ++c;
+    if (c == m_settings.cascadeCount)
+        return 1.0f;
+    const Cascade& cascade = m_cascades[c];
+
+    Vec3f pos = viewPos;
+    const float normalLength = Math::Length(normal);
+    if (normalLength > 0.0f)
+        pos += normal * (kNormalOffset * cascade.texelSize / normalLength);
+    const Vec4f clip = Math::MultiplyVecMat(Vec4f{pos.x, pos.y, pos.z, 1.0f}, cascade.viewToLight);
+    if (!(clip.w > 0.0f))
+        return 1.0f;
+
+    // Same raster space as the rasterizer, texel centers are at integer coords
+    const int res = m_settings.resolution;
+    const float invW = 1.0f / clip.w;
+    const int x = (int)std::floor((clip.x * invW + 1.0f) * 0.5f * res + 0.5f);
+    const int y = (int)std::floor((clip.y * invW + 1.0f) * 0.5f * res + 0.5f);
+
+    // The depth is 1/w of the nearest caster, the point is behind it if depth * (w - bias) > 1
+    const float *depth = m_depth.data() + (size_t)c * res * res;
+    const float biasedW = clip.w - kDepthBias * cascade.texelSize;
+    auto isLit = [depth, res, biasedW](int tx, int ty)
+    {
+        tx = std::max(0, std::min(res - 1, tx));
+        ty = std::max(0, std::min(res - 1, ty));
+        return !(depth[tx + ty * res] * biasedW > 1.0f);
+    };
+
+    if (m_settings.filter == ShadowFilter::kHard)
+        return isLit(x, y) ? 1.0f : 0.0f;
+
+    int litCnt = 0;
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+            litCnt += isLit(x + dx, y + dy);
+    }
+    return litCnt * (1.0f / 9.0f);
+}
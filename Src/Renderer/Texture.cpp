@@ -1,19 +1,36 @@
 #include "SDL.h"
 #include "SDL_image.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
 #include "Renderer/Texture.h"
+#include "Renderer/TextureCache.h"
+
+namespace
+{
+    // @brief Source of the use stamps of every texture
+    std::atomic<uint64_t> g_useClock{0};
+
+    // @return The image in RGBA32, nullptr if it couldn't be loaded
+    std::unique_ptr<SDL_Surface, SDL_Deleter> LoadSurface(const std::string& filePath)
+    {
+        std::unique_ptr<SDL_Surface, SDL_Deleter> tempSurf{IMG_Load(filePath.c_str())};
+        if (!tempSurf)
+            return nullptr;
+        return std::unique_ptr<SDL_Surface, SDL_Deleter>{SDL_ConvertSurfaceFormat(tempSurf.get(), SDL_PIXELFORMAT_RGBA32, 0)};
+    }
+}
 
 void QTexture::Init(const std::string& filePath, SDL_Renderer *renderer)
 {
-    std::unique_ptr<SDL_Surface, SDL_Deleter> tempSurf{IMG_Load(filePath.c_str())};
-    if (!tempSurf) { assert(1 == 0 && "Uh oh, cannot load img file."); }
-    std::unique_ptr<SDL_Surface, SDL_Deleter> formattedSurf{SDL_ConvertSurfaceFormat(tempSurf.get(), SDL_PIXELFORMAT_RGBA32, 0)};
-    if (!formattedSurf) { assert(1 == 0 && "Uh oh, cannot format surface."); }
+    std::unique_ptr<SDL_Surface, SDL_Deleter> formattedSurf = LoadSurface(filePath);
+    if (!formattedSurf) { assert(1 == 0 && "Uh oh, cannot load img file."); }
 
     m_w = formattedSurf->w;
     m_h = formattedSurf->h;
@@ -27,12 +44,217 @@ void QTexture::Init(const std::string& filePath, SDL_Renderer *renderer)
     // @note Do I need to copy color key?
     SDL_UnlockTexture(m_texture.get());
     m_texels = nullptr;
+
+    BuildMips((const uint32_t *)formattedSurf->pixels);
+}
+
+void QTexture::Init(int w, int h, std::vector<uint32_t> texels)
+{
+    assert(texels.size() == (size_t)w * h && "Uh oh, texel count doesn't match the size.");
+    m_w = w;
+    m_h = h;
+    m_pitch = w * (int)sizeof(uint32_t);
+    m_cpuTexels = std::move(texels);
+    m_baseTexels = m_cpuTexels.data();
+    m_texture.reset();
+    m_texels = nullptr;
+
+    BuildMips(m_cpuTexels.data());
+}
+
+bool QTexture::LoadImage(const std::string& filePath, int& outW, int& outH, std::vector<uint32_t>& outTexels)
+{
+    std::unique_ptr<SDL_Surface, SDL_Deleter> formattedSurf = LoadSurface(filePath);
+    if (!formattedSurf)
+        return false;
+
+    outW = formattedSurf->w;
+    outH = formattedSurf->h;
+    outTexels.resize((size_t)outW * outH);
+    for (int y = 0; y < outH; ++y)
+        memcpy(outTexels.data() + (size_t)y * outW, (const uint8_t *)formattedSurf->pixels + (size_t)y * formattedSurf->pitch, outW * sizeof(uint32_t));
+    return true;
+}
+
+void QTexture::BuildMips(const uint32_t *texels)
+{
+    // Reserve every level up front, so that the pointers in m_mips stay valid
+    size_t total = 0;
+    for (int w = m_w, h = m_h; w > 1 || h > 1; )
+    {
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+        total += (size_t)w * h;
+    }
+    m_mipTexels.assign(total, 0);
+    m_mips.clear();
+
+    const uint32_t *src = texels;
+    int srcW = m_w, srcH = m_h;
+    uint32_t *dst = m_mipTexels.data();
+    while (srcW > 1 || srcH > 1)
+    {
+        int dstW = std::max(1, srcW / 2);
+        int dstH = std::max(1, srcH / 2);
+        for (int y = 0; y < dstH; ++y)
+        {
+            // Odd sizes drop the last row/column, clamp so 1 texel wide levels still work
+            int y0 = std::min(y * 2, srcH - 1), y1 = std::min(y * 2 + 1, srcH - 1);
+            for (int x = 0; x < dstW; ++x)
+            {
+                int x0 = std::min(x * 2, srcW - 1), x1 = std::min(x * 2 + 1, srcW - 1);
+                uint32_t t[4] = {src[x0 + y0 * srcW], src[x1 + y0 * srcW], src[x0 + y1 * srcW], src[x1 + y1 * srcW]};
+
+                // Average each 8-bit channel, rounded
+                uint32_t result = 0;
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    uint32_t sum = 2;
+                    for (uint32_t texel : t)
+                        sum += (texel >> shift) & 0xff;
+                    result |= (sum / 4) << shift;
+                }
+                dst[x + y * dstW] = result;
+            }
+        }
+
+        m_mips.push_back(MipLevel{dst, dstW, dstH});
+        src = dst;
+        srcW = dstW;
+        srcH = dstH;
+        dst += (size_t)dstW * dstH;
+    }
+}
+
+void QTexture::Init(int w, int h, TextureFormat format, std::shared_ptr<uint8_t> storage, uint8_t *levels)
+{
+    m_w = w;
+    m_h = h;
+    m_pitch = w * (int)sizeof(uint32_t);
+    m_texture.reset();
+    m_texels = nullptr;
+    std::vector<uint32_t>().swap(m_cpuTexels);
+    std::vector<uint32_t>().swap(m_mipTexels);
+    std::vector<uint8_t>().swap(m_packed);
+    m_storage = std::move(storage);
+    m_format = format;
+    UsePackedLevels(levels);
+}
+
+void QTexture::Compress(TextureFormat format)
+{
+    assert(format != TextureFormat::kRGBA32 && "Uh oh, can't decompress a texture!");
+    assert(m_format == TextureFormat::kRGBA32 && "Uh oh, texture is already compressed!");
+    assert(m_texels == nullptr && "Uh oh, can't compress a locked texture!");
+
+    size_t total = BlockCompression::GetImageSize(format, m_w, m_h);
+    for (const MipLevel& mip : m_mips)
+        total += BlockCompression::GetImageSize(format, mip.w, mip.h);
+    std::vector<uint8_t> packed(total);
+
+    LockTexture();
+    BlockCompression::EncodeImage(format, m_texels, m_w, m_h, packed.data());
+    UnlockTexture();
+    uint8_t *dst = packed.data() + BlockCompression::GetImageSize(format, m_w, m_h);
+    for (const MipLevel& mip : m_mips)
+    {
+        BlockCompression::EncodeImage(format, mip.texels, mip.w, mip.h, dst);
+        dst += BlockCompression::GetImageSize(format, mip.w, mip.h);
+    }
+
+    m_format = format;
+    ReleaseStorage();
+    m_packed.swap(packed);
+    UsePackedLevels(m_packed.data());
+}
+
+TextureFormat QTexture::GetFormat() const { return m_format; }
+
+size_t QTexture::GetByteSize() const
+{
+    size_t total = BlockCompression::GetImageSize(m_format, m_w, m_h);
+    for (const MipLevel& mip : m_mips)
+        total += BlockCompression::GetImageSize(m_format, mip.w, mip.h);
+    return total;
+}
+
+bool QTexture::DropTopMip()
+{
+    assert(m_texels == nullptr && "Uh oh, can't drop a mip of a locked texture!");
+    if (m_mips.empty())
+        return false;
+
+    // Levels 1 and up are copied out before their storage is released
+    size_t total = 0;
+    for (const MipLevel& mip : m_mips)
+        total += BlockCompression::GetImageSize(m_format, mip.w, mip.h);
+    std::vector<uint8_t> packed(total);
+    uint8_t *dst = packed.data();
+    for (const MipLevel& mip : m_mips)
+    {
+        const size_t size = BlockCompression::GetImageSize(m_format, mip.w, mip.h);
+        memcpy(dst, mip.blocks ? (const void *)mip.blocks : (const void *)mip.texels, size);
+        dst += size;
+    }
+
+    m_w = m_mips.front().w;
+    m_h = m_mips.front().h;
+    m_pitch = m_w * (int)sizeof(uint32_t);
+    ReleaseStorage();
+    m_packed.swap(packed);
+    UsePackedLevels(m_packed.data());
+    return true;
+}
+
+void QTexture::ReleaseStorage()
+{
+    m_texture.reset();
+    std::vector<uint32_t>().swap(m_cpuTexels);
+    std::vector<uint32_t>().swap(m_mipTexels);
+    std::vector<uint8_t>().swap(m_packed);
+    m_storage.reset();
+}
+
+void QTexture::UsePackedLevels(uint8_t *levels)
+{
+    if (m_format == TextureFormat::kRGBA32)
+    {
+        m_baseTexels = reinterpret_cast<uint32_t *>(levels);
+        m_baseBlocks = nullptr;
+    }
+    else
+    {
+        m_baseTexels = nullptr;
+        m_baseBlocks = levels;
+    }
+
+    m_mips.clear();
+    const uint8_t *level = levels + BlockCompression::GetImageSize(m_format, m_w, m_h);
+    for (int w = m_w, h = m_h; w > 1 || h > 1; )
+    {
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+        if (m_format == TextureFormat::kRGBA32)
+            m_mips.push_back(MipLevel{reinterpret_cast<const uint32_t *>(level), w, h});
+        else
+            m_mips.push_back(MipLevel{nullptr, w, h, level});
+        level += BlockCompression::GetImageSize(m_format, w, h);
+    }
 }
 
+uint64_t QTexture::GetLastUse() const { return m_lastUse.load(std::memory_order_relaxed); }
+
+void QTexture::Touch() { m_lastUse.store(++g_useClock, std::memory_order_relaxed); }
+
 void QTexture::LockTexture()
 {
+    Touch();
+    if (m_format != TextureFormat::kRGBA32)
+        return;
     if (m_texels != nullptr)
         std::cerr << "Texture has already been locked!\n";
+    else if (!m_texture)
+        m_texels = m_baseTexels;
     else
     {
         if (SDL_LockTexture(m_texture.get(), nullptr, &(void*)m_texels, &m_pitch) != 0)
@@ -42,11 +264,14 @@ void QTexture::LockTexture()
 
 void QTexture::UnlockTexture()
 {
+    if (m_format != TextureFormat::kRGBA32)
+        return;
     if (m_texels == nullptr)
         std::cerr << "Texture has already been unlocked!\n";
     else
     {
-        SDL_UnlockTexture(m_texture.get());
+        if (m_texture)
+            SDL_UnlockTexture(m_texture.get());
         m_texels = nullptr;
     }
 }
@@ -57,36 +282,100 @@ int QTexture::GetPitch() const { return m_pitch; }
 
 const uint32_t *QTexture::GetTexels() const { return m_texels; }
 
+int QTexture::GetMipCount() const { return 1 + (int)m_mips.size(); }
+
+QTexture::MipLevel QTexture::GetMip(int level) const
+{
+    assert(level >= 0 && level < GetMipCount() && "Uh oh, mip level is out of range!");
+    if (level == 0)
+        return MipLevel{m_texels, m_w, m_h, m_baseBlocks};
+    return m_mips[level - 1];
+}
+
+bool TextureHandle::IsValid() const { return m_future.valid(); }
+
+bool TextureHandle::IsReady() const
+{
+    return m_future.valid() && m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void TextureHandle::Wait() const
+{
+    if (m_future.valid())
+        m_future.wait();
+}
+
+std::shared_ptr<QTexture> TextureHandle::Get() const
+{
+    if (!m_future.valid())
+        return nullptr;
+    if (!IsReady() || !m_future.get())
+        return m_placeholder;
+    return m_future.get();
+}
+
 TextureManager& TextureManager::Instance()
 {
     static TextureManager textureManager{};
     return textureManager;
 }
 
+TextureManager::~TextureManager()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopping = true;
+    }
+    m_loadQueued.notify_all();
+    for (std::thread& loader : m_loaders)
+        loader.join();
+}
+
 // @todo Recover from exceptions, e.g., img fails to load
-std::shared_ptr<QTexture> TextureManager::Load(const std::string& filePath, SDL_Renderer* renderer)
+std::shared_ptr<QTexture> TextureManager::Load(const std::string& filePath, SDL_Renderer* renderer, TextureFormat format)
 {
     if (filePath.empty()) { assert(1 == 0 && "Filename can't be empty!"); }
 
     // If already loaded, simply return the texture to be shared and re-used
+    std::unique_lock<std::mutex> lock{m_mutex};
     auto texIt = loadedTexs.find(filePath);
-    if (texIt != loadedTexs.end()) { return texIt->second;  }
+    if (texIt != loadedTexs.end())
+    {
+        texIt->second->Touch();
+        return texIt->second;
+    }
+
+    // If it's loading, wait for it rather than decoding it twice. If that load failed, try again.
+    auto pendingIt = pendingTexs.find(filePath);
+    TextureHandle pending = (pendingIt != pendingTexs.end()) ? pendingIt->second : TextureHandle{};
+    lock.unlock();
+    if (pending.IsValid())
+    {
+        pending.Wait();
+        if (pending.m_future.get()) { return pending.m_future.get(); }
+    }
 
     // Else, load the texture
     QTexture* newTexture = new QTexture{};
     newTexture->Init(filePath, renderer);
+    if (format != TextureFormat::kRGBA32)
+        newTexture->Compress(format);
     std::shared_ptr<QTexture> newTextureHandle{newTexture};
 
-    // Now, cache it so it can be re-used in the future
-    loadedTexs.insert(std::make_pair(filePath, newTextureHandle));
-
-    return newTextureHandle;
+    // Now, cache it so it can be re-used in the future. Another thread may have loaded it in the
+    // meantime, the first one is kept then.
+    newTexture->Touch();
+    lock.lock();
+    std::shared_ptr<QTexture> loaded = loadedTexs.insert(std::make_pair(filePath, newTextureHandle)).first->second;
+    EvictUnreferenced();
+    return loaded;
 }
 
 void TextureManager::Unload(const std::string& filePath)
 {
     if (filePath.empty()) { assert(1 == 0 && "Filename can't be empty!"); }
 
+    std::lock_guard<std::mutex> lock{m_mutex};
     auto unloadedTexIt = loadedTexs.find(filePath);
     if (unloadedTexIt == loadedTexs.end()) { assert(1 == 0 && "Can't find texture!"); }
 
@@ -95,8 +384,230 @@ void TextureManager::Unload(const std::string& filePath)
 
 void TextureManager::UnloadAll()
 {
+    std::lock_guard<std::mutex> lock{m_mutex};
     if (loadedTexs.empty()) { return; }
 
     loadedTexs.clear();
 }
 
+TextureHandle TextureManager::LoadAsync(const std::string& filePath, TextureFormat format)
+{
+    if (filePath.empty()) { assert(1 == 0 && "Filename can't be empty!"); }
+
+    std::shared_ptr<QTexture> placeholder = GetPlaceholder();
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto pendingIt = pendingTexs.find(filePath);
+    if (pendingIt != pendingTexs.end()) { return pendingIt->second; }
+
+    auto promise = std::make_shared<std::promise<std::shared_ptr<QTexture>>>();
+    TextureHandle handle;
+    handle.m_future = promise->get_future().share();
+    handle.m_placeholder = placeholder;
+
+    // Already loaded, the handle is ready at once
+    auto texIt = loadedTexs.find(filePath);
+    if (texIt != loadedTexs.end())
+    {
+        texIt->second->Touch();
+        promise->set_value(texIt->second);
+        return handle;
+    }
+
+    pendingTexs.insert(std::make_pair(filePath, handle));
+    const bool diskCache = m_diskCache;
+    m_loads.push_back([this, filePath, format, diskCache, promise]()
+    {
+        std::shared_ptr<QTexture> texture;
+        int w, h;
+        std::vector<uint32_t> texels;
+        if (diskCache)
+            texture = TextureCache::LoadImage(filePath, format);
+        else if (QTexture::LoadImage(filePath, w, h, texels))
+        {
+            texture = std::make_shared<QTexture>();
+            texture->Init(w, h, std::move(texels));
+            if (format != TextureFormat::kRGBA32)
+                texture->Compress(format);
+        }
+
+        if (texture)
+            texture->Touch();
+        else
+            std::cerr << "Failed to load texture " << filePath << "!\n";
+
+        // A failed load isn't cached, the next call tries again
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (texture)
+                loadedTexs.insert(std::make_pair(filePath, texture));
+            pendingTexs.erase(filePath);
+            EvictUnreferenced();
+        }
+        promise->set_value(texture);
+    });
+
+    if (m_loaders.empty())
+    {
+        int count = m_loaderThreads;
+        if (count <= 0)
+            count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+        for (int k = 0; k < count; ++k)
+            m_loaders.emplace_back(&TextureManager::LoaderLoop, this);
+    }
+    m_loadQueued.notify_one();
+    return handle;
+}
+
+void TextureManager::WaitForLoads()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_loadsDone.wait(lock, [this]() { return m_busyLoaders == 0 && m_loads.empty(); });
+}
+
+std::shared_ptr<QTexture> TextureManager::GetPlaceholder()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (!m_placeholder)
+    {
+        m_placeholder = std::make_shared<QTexture>();
+        m_placeholder->Init(1, 1, std::vector<uint32_t>{0xffffffff});
+    }
+    return m_placeholder;
+}
+
+void TextureManager::SetLoaderThreads(int count)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_loaderThreads = count;
+}
+
+void TextureManager::SetDiskCache(bool enable)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_diskCache = enable;
+}
+
+void TextureManager::LoaderLoop()
+{
+    // The queue is drained before stopping, so that no handle waits forever
+    std::unique_lock<std::mutex> lock{m_mutex};
+    while (true)
+    {
+        m_loadQueued.wait(lock, [this]() { return m_stopping || !m_loads.empty(); });
+        if (m_loads.empty())
+            return;
+        std::function<void()> load = std::move(m_loads.front());
+        m_loads.pop_front();
+        ++m_busyLoaders;
+        lock.unlock();
+        load();
+
+        // The job holds the promise, and the promise a reference to the texture
+        load = nullptr;
+        lock.lock();
+        if (--m_busyLoaders == 0 && m_loads.empty())
+            m_loadsDone.notify_all();
+    }
+}
+
+void TextureManager::SetMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_budget = bytes;
+    EvictUnreferenced();
+}
+
+void TextureManager::SetMipEviction(bool enable)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_mipEviction = enable;
+}
+
+void TextureManager::Trim()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    EvictUnreferenced();
+    if (m_mipEviction)
+        DropMips();
+}
+
+std::vector<TextureManager::TextureUsage> TextureManager::GetUsage()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    std::vector<TextureUsage> usage;
+    usage.reserve(loadedTexs.size());
+    for (const auto& loaded : loadedTexs)
+    {
+        const QTexture& texture = *loaded.second;
+        usage.push_back(TextureUsage{loaded.first, texture.GetByteSize(), texture.GetW(), texture.GetH(),
+            loaded.second.use_count() - 1, texture.GetLastUse()});
+    }
+    return usage;
+}
+
+size_t TextureManager::GetResidentBytes()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return CountResidentBytes();
+}
+
+size_t TextureManager::CountResidentBytes() const
+{
+    size_t total = 0;
+    for (const auto& loaded : loadedTexs)
+        total += loaded.second->GetByteSize();
+    return total;
+}
+
+void TextureManager::EvictUnreferenced()
+{
+    if (m_budget == 0)
+        return;
+
+    size_t resident = CountResidentBytes();
+    while (resident > m_budget)
+    {
+        // Only the map holds an unreferenced texture, so erasing it frees it
+        auto lru = loadedTexs.end();
+        for (auto it = loadedTexs.begin(); it != loadedTexs.end(); ++it)
+        {
+            if (it->second.use_count() == 1 && (lru == loadedTexs.end() || it->second->GetLastUse() < lru->second->GetLastUse()))
+                lru = it;
+        }
+        if (lru == loadedTexs.end())
+            return;
+        resident -= lru->second->GetByteSize();
+        loadedTexs.erase(lru);
+    }
+}
+
+void TextureManager::DropMips()
+{
+    if (m_budget == 0)
+        return;
+
+    std::vector<QTexture *> byLastUse;
+    for (const auto& loaded : loadedTexs)
+        byLastUse.push_back(loaded.second.get());
+    std::sort(byLastUse.begin(), byLastUse.end(), [](const QTexture *a, const QTexture *b) { return a->GetLastUse() < b->GetLastUse(); });
+
+    // One level per texture per round, least recently used first, so that no texture ends up
+    // much blurrier than the others
+    size_t resident = CountResidentBytes();
+    bool dropped = true;
+    while (resident > m_budget && dropped)
+    {
+        dropped = false;
+        for (QTexture *texture : byLastUse)
+        {
+            if (resident <= m_budget)
+                break;
+            const size_t before = texture->GetByteSize();
+            if (texture->DropTopMip())
+            {
+                resident -= before - texture->GetByteSize();
+                dropped = true;
+            }
+        }
+    }
+}
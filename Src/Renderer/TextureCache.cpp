@@ -0,0 +1,177 @@
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "Renderer/Texture.h"
+#include "Renderer/TextureCache.h"
+#include "Utils/FileStat.h"
+
+namespace
+{
+    constexpr uint32_t kMagic = 0x58455451;     // "QTEX"
+    constexpr uint32_t kVersion = 1;
+
+    // @brief Identifies what a cache file was built from, followed by every mip level packed back to
+    // back. The size is a multiple of 8, so the mapped texels stay aligned.
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        int32_t format;
+        int32_t w;
+        int32_t h;
+        int32_t mipCount;
+    };
+
+    static_assert(sizeof(Header) % 8 == 0, "Texels follow the header and must stay aligned");
+
+    // @brief Map a whole file copy-on-write, writes to the pages stay private to the process
+    // @return nullptr if the file couldn't be mapped, the mapping is undone with the last reference
+    std::shared_ptr<uint8_t> MapFile(const std::string& filePath, uint64_t& outSize)
+    {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return nullptr;
+        LARGE_INTEGER size;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+            return nullptr;
+        void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view)
+            return nullptr;
+        outSize = (uint64_t)size.QuadPart;
+        return std::shared_ptr<uint8_t>{static_cast<uint8_t *>(view), [](uint8_t *p) { UnmapViewOfFile(p); }};
+#else
+        int fd = open(filePath.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        void *view = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            view = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED)
+            return nullptr;
+        const size_t size = (size_t)st.st_size;
+        outSize = (uint64_t)size;
+        return std::shared_ptr<uint8_t>{static_cast<uint8_t *>(view), [size](uint8_t *p) { munmap(p, size); }};
+#endif
+    }
+
+    // @return Bytes of every level from w x h down to 1x1, and their count
+    uint64_t GetLevelsSize(TextureFormat format, int w, int h, int& outMipCount)
+    {
+        uint64_t total = BlockCompression::GetImageSize(format, w, h);
+        outMipCount = 1;
+        while (w > 1 || h > 1)
+        {
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+            total += BlockCompression::GetImageSize(format, w, h);
+            ++outMipCount;
+        }
+        return total;
+    }
+}
+
+namespace TextureCache
+{
+    bool Save(const std::string& cachePath, QTexture& texture, const std::string& sourcePath)
+    {
+        Header header{kMagic, kVersion, 0, 0, (int32_t)texture.GetFormat(), texture.GetW(), texture.GetH(),
+            texture.GetMipCount()};
+        if (!Helper::StatSource(sourcePath, header.sourceSize, header.sourceTime))
+            return false;
+
+        std::ofstream ofs{cachePath, std::ios::binary | std::ios::trunc};
+        if (!ofs)
+            return false;
+
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        texture.LockTexture();
+        for (int level = 0; level < texture.GetMipCount(); ++level)
+        {
+            QTexture::MipLevel mip = texture.GetMip(level);
+            if (mip.blocks)
+            {
+                ofs.write(reinterpret_cast<const char*>(mip.blocks), BlockCompression::GetImageSize(texture.GetFormat(), mip.w, mip.h));
+                continue;
+            }
+
+            // Level 0 of an SDL_Texture may have a padded pitch
+            const int pitch = level == 0 ? texture.GetPitch() : mip.w * (int)sizeof(uint32_t);
+            for (int y = 0; y < mip.h; ++y)
+            {
+                const char *row = reinterpret_cast<const char*>(mip.texels) + (size_t)y * pitch;
+                ofs.write(row, mip.w * sizeof(uint32_t));
+            }
+        }
+        texture.UnlockTexture();
+        return (bool)ofs;
+    }
+
+    bool Load(const std::string& cachePath, const std::string& sourcePath, TextureFormat format, QTexture& outTexture)
+    {
+        Header expected{kMagic, kVersion, 0, 0, (int32_t)format, 0, 0, 0};
+        if (!Helper::StatSource(sourcePath, expected.sourceSize, expected.sourceTime))
+            return false;
+
+        uint64_t fileSize = 0;
+        std::shared_ptr<uint8_t> file = MapFile(cachePath, fileSize);
+        if (!file || fileSize < sizeof(Header))
+            return false;
+
+        Header header;
+        memcpy(&header, file.get(), sizeof(header));
+        if (header.magic != expected.magic || header.version != expected.version ||
+            header.sourceSize != expected.sourceSize || header.sourceTime != expected.sourceTime ||
+            header.format != expected.format || header.w <= 0 || header.h <= 0)
+        {
+            return false;
+        }
+
+        // Guards the mapping against a corrupt or truncated file
+        int mipCount = 0;
+        if (GetLevelsSize(format, header.w, header.h, mipCount) != fileSize - sizeof(Header) || mipCount != header.mipCount)
+            return false;
+
+        outTexture.Init(header.w, header.h, format, file, file.get() + sizeof(Header));
+        return true;
+    }
+
+    std::shared_ptr<QTexture> LoadImage(const std::string& imagePath, TextureFormat format)
+    {
+        const std::string cachePath = imagePath + ".qtex";
+        auto texture = std::make_shared<QTexture>();
+        if (Load(cachePath, imagePath, format, *texture))
+            return texture;
+
+        int w, h;
+        std::vector<uint32_t> texels;
+        if (!QTexture::LoadImage(imagePath, w, h, texels))
+            return nullptr;
+        texture->Init(w, h, std::move(texels));
+        if (format != TextureFormat::kRGBA32)
+            texture->Compress(format);
+        Save(cachePath, *texture, imagePath);
+        return texture;
+    }
+}
@@ -0,0 +1,42 @@
+#include <algorithm>
+
+#include "Renderer/TransparencyBuffer.h"
+
+void TransparencyBuffer::Init(int w, int h)
+{
+    m_pixelCnt = w * h;
+    m_accum.assign(m_pixelCnt, Vec4f{});
+    m_revealage.assign(m_pixelCnt, 1.0f);
+}
+
+void TransparencyBuffer::Clear()
+{
+    std::fill(m_accum.begin(), m_accum.end(), Vec4f{});
+    std::fill(m_revealage.begin(), m_revealage.end(), 1.0f);
+}
+
+void TransparencyBuffer::Resolve(uint32_t *pixels)
+{
+    for (int i = 0; i < m_pixelCnt; ++i)
+    {
+        Vec4f& accum = m_accum[i];
+        if (accum.a == 0.0f)
+            continue;
+
+        // The weights cancel out in the average, what's left is how much each layer covers
+        const float revealage = m_revealage[i];
+        const float invWeight = 1.0f / accum.a;
+        const float average[3] = {accum.r * invWeight, accum.g * invWeight, accum.b * invWeight};
+        uint32_t result = 0xff000000u;
+        for (int c = 0; c < 3; ++c)
+        {
+            float behind = (float)((pixels[i] >> (c * 8)) & 0xff);
+            float blended = std::min(1.0f, average[c]) * 255.0f * (1.0f - revealage) + behind * revealage;
+            result |= (uint32_t)(blended + 0.5f) << (c * 8);
+        }
+        pixels[i] = result;
+
+        accum = Vec4f{};
+        m_revealage[i] = 1.0f;
+    }
+}
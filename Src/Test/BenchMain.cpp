@@ -0,0 +1,674 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Math/Vector.h"
+#include "Math/Matrix.h"
+#include "Math/Batch.h"
+#include "Renderer/Light.h"
+#include "Renderer/Model.h"
+#include "Renderer/OBJLoader.h"
+#include "Renderer/QRenderer.h"
+#include "Renderer/Rasterizer.h"
+#include "Renderer/ShadowMap.h"
+#include "Renderer/Texture.h"
+#include "Renderer/TextureCache.h"
+#include "Renderer/Triangle.h"
+
+// @note Run with "BenchMain --reporter xml --out bench.xml" (or the RunBenchmarks target) to get
+// machine-readable results, so that each kernel optimization can be compared in isolation.
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Math benchmarks
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("Vector-matrix multiplication", "[benchmark][Math]")
+{
+    constexpr float pi = 3.14159265358979f;
+    Mat44f m = Math::InitRotation(pi / 3.0f, pi / 4.0f, pi / 6.0f) * Math::InitTranslation(1.0f, 2.0f, 3.0f);
+    Vec3f v3{1.0f, 2.0f, 3.0f};
+    Vec4f v4{1.0f, 2.0f, 3.0f, 1.0f};
+
+    BENCHMARK("MultiplyVecMat Vec3f x Mat44f") { return Math::MultiplyVecMat(v3, m); };
+    BENCHMARK("MultiplyVecMat Vec4f x Mat44f") { return Math::MultiplyVecMat(v4, m); };
+
+    std::vector<Vec3f> verts(1024, v3);
+    BENCHMARK("MultiplyVecMat 1024 Vec3f")
+    {
+        for (auto& v : verts)
+            v = Math::MultiplyVecMat(v, m);
+        return verts[0];
+    };
+
+    Math::SoAPositions soa, transformed;
+    Math::ToSoA(verts, soa);
+    BENCHMARK("TransformPositions 1024 SoA")
+    {
+        Math::TransformPositions(soa, m, transformed);
+        return transformed.x[0];
+    };
+    BENCHMARK("PerspectiveDivide + ViewportTransform 1024 SoA")
+    {
+        Math::PerspectiveDivide(transformed);
+        Math::ViewportTransform(transformed, 800, 600);
+        return transformed.x[0];
+    };
+}
+
+TEST_CASE("Matrix operations", "[benchmark][Math]")
+{
+    Mat44f m{
+        5.0f, 3.0f, 1.0f, 0.0f,
+        1.0f, 0.0f, -2.0f, 0.0f,
+        1.0f, 2.0f, 5.0f, 0.0f,
+        1.0f, 1.0f, 1.0f, 1.0f, };
+
+    BENCHMARK("Inverse Mat44f") { return Math::Inverse(m); };
+    BENCHMARK("Mat44f * Mat44f") { return m * m; };
+    BENCHMARK("Transpose Mat44f") { return Math::Transpose(m); };
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Clipping benchmarks
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("Clip triangle against near plane", "[benchmark][Clipping]")
+{
+    Rasterizer rasterizer;
+    // z >= 0 is inside, verts are in homogeneous clip space
+    Vec4f plane{0.0f, 0.0f, 1.0f, 0.0f};
+    Vec2f uv{0.0f};
+
+    Triangle allInside{{-1.0f, -1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 1.0f, 1.0f}, {1.0f, -1.0f, 1.0f, 1.0f}, uv, uv, uv};
+    Triangle oneInside{{-1.0f, -1.0f, -1.0f, 1.0f}, {0.0f, 1.0f, 1.0f, 1.0f}, {1.0f, -1.0f, -1.0f, 1.0f}, uv, uv, uv};
+    Triangle twoInside{{-1.0f, -1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, -1.0f, 1.0f}, {1.0f, -1.0f, 1.0f, 1.0f}, uv, uv, uv};
+    Triangle allOutside{{-1.0f, -1.0f, -1.0f, 1.0f}, {0.0f, 1.0f, -1.0f, 1.0f}, {1.0f, -1.0f, -1.0f, 1.0f}, uv, uv, uv};
+
+    REQUIRE(rasterizer.ClipTriangleAgainstPlane(plane, allInside).size() == 1);
+    REQUIRE(rasterizer.ClipTriangleAgainstPlane(plane, oneInside).size() == 1);
+    REQUIRE(rasterizer.ClipTriangleAgainstPlane(plane, twoInside).size() == 2);
+    REQUIRE(rasterizer.ClipTriangleAgainstPlane(plane, allOutside).empty());
+
+    BENCHMARK("3 pts inside") { return rasterizer.ClipTriangleAgainstPlane(plane, allInside); };
+    BENCHMARK("1 pt inside, 2 pts outside") { return rasterizer.ClipTriangleAgainstPlane(plane, oneInside); };
+    BENCHMARK("2 pts inside, 1 pt outside") { return rasterizer.ClipTriangleAgainstPlane(plane, twoInside); };
+    BENCHMARK("3 pts outside") { return rasterizer.ClipTriangleAgainstPlane(plane, allOutside); };
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Raster benchmarks
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("Edge function loops", "[benchmark][Raster]")
+{
+    Rasterizer rasterizer;
+    // CW triangle in raster space, covers about half of its bounding box
+    Vec3f v0{0.0f, 0.0f, 0.0f};
+    Vec3f v1{32.0f, 255.0f, 0.0f};
+    Vec3f v2{255.0f, 0.0f, 0.0f};
+
+    BENCHMARK("ComputeEdge over a 256x256 bounding box")
+    {
+        int covered = 0;
+        for (int y = 0; y < 256; ++y)
+        {
+            for (int x = 0; x < 256; ++x)
+            {
+                Vec3f pt{(float)x, (float)y, 0.0f};
+                float e12 = rasterizer.ComputeEdge(v1, v2, pt);
+                float e20 = rasterizer.ComputeEdge(v2, v0, pt);
+                float e01 = rasterizer.ComputeEdge(v0, v1, pt);
+                if (e01 >= 0.0f && e12 >= 0.0f && e20 >= 0.0f)
+                    ++covered;
+            }
+        }
+        return covered;
+    };
+}
+
+TEST_CASE("Close-up triangles", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+
+    // A few tris covering most of the screen, so the traversal dominates rather than the verts.
+    // The cube is rotated so that its faces are split along thin diagonals.
+    Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+    Model cube{OBJ::LoadFileData("Assets/Cube.obj")};
+    Mat44f cubeMat = Math::InitRotation(0.0f, 0.3f, 0.2f);
+    const RasterTraversal traversals[] = {RasterTraversal::kBoundingBox, RasterTraversal::kBlocks, RasterTraversal::kSpans, RasterTraversal::kAuto};
+    const char *names[] = {"bounding box", "8x8 blocks", "spans", "auto"};
+
+    for (int i = 0; i < 4; ++i)
+    {
+        renderer.SetRasterTraversal(traversals[i]);
+        renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.5f, 0.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+        BENCHMARK(std::string{"plane.obj, "} + names[i])
+        {
+            renderer.ClearBuffers();
+            renderer.Render(plane, Mat44f{}, QRendererMode::kNone);
+            return renderer.GetPixels()[0];
+        };
+
+        renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 0.0f, 1.8f}, Vec3f{0.0f, 0.0f, 0.0f}));
+        BENCHMARK(std::string{"Cube.obj, "} + names[i])
+        {
+            renderer.ClearBuffers();
+            renderer.Render(cube, cubeMat, QRendererMode::kNone);
+            return renderer.GetPixels()[0];
+        };
+    }
+    renderer.ClearBuffers();
+    BENCHMARK("ClearBuffers only (baseline)") { renderer.ClearBuffers(); return renderer.GetPixels()[0]; };
+}
+
+TEST_CASE("Scene traversal", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.0f, 2.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // Dense meshes at a usual distance, most tris only cover a few quads
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+    Mat44f teapotMat = Math::InitScale(0.5f, 0.5f, 0.5f);
+    const RasterTraversal traversals[] = {RasterTraversal::kBoundingBox, RasterTraversal::kBlocks, RasterTraversal::kSpans, RasterTraversal::kAuto};
+    const char *names[] = {"bounding box", "8x8 blocks", "spans", "auto"};
+
+    for (int i = 0; i < 4; ++i)
+    {
+        renderer.SetRasterTraversal(traversals[i]);
+        BENCHMARK(std::string{"suzanne.obj, "} + names[i])
+        {
+            renderer.ClearBuffers();
+            renderer.Render(suzanne, Mat44f{}, QRendererMode::kNone);
+            return renderer.GetPixels()[0];
+        };
+        BENCHMARK(std::string{"teapot.obj, "} + names[i])
+        {
+            renderer.ClearBuffers();
+            renderer.Render(teapot, teapotMat, QRendererMode::kNone);
+            return renderer.GetPixels()[0];
+        };
+    }
+}
+
+TEST_CASE("Multisampling", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.0f, 2.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // A frame is cleared, drawn and resolved, against supersampling which would be 4x the pixels
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+    for (int samples : {1, 2, 4, 8})
+    {
+        renderer.SetMultisampling(samples);
+        BENCHMARK("suzanne.obj, " + std::to_string(samples) + " samples, Phong")
+        {
+            renderer.ClearBuffers();
+            renderer.Render(suzanne, Mat44f{}, QRendererMode::kPhong);
+            renderer.Resolve();
+            return renderer.GetPixels()[0];
+        };
+        BENCHMARK("plane.obj, " + std::to_string(samples) + " samples, Phong")
+        {
+            renderer.ClearBuffers();
+            renderer.Render(plane, Mat44f{}, QRendererMode::kPhong);
+            renderer.Resolve();
+            return renderer.GetPixels()[0];
+        };
+    }
+}
+
+TEST_CASE("Transparency", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.0f, 2.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // The same frame with suzanne opaque then transparent, the difference is the accumulation and
+    // the full screen resolve
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+    BENCHMARK("suzanne.obj opaque over plane.obj, Phong")
+    {
+        renderer.ClearBuffers();
+        renderer.Render(plane, Mat44f{}, QRendererMode::kPhong);
+        renderer.Render(suzanne, Mat44f{}, QRendererMode::kPhong);
+        renderer.Resolve();
+        return renderer.GetPixels()[0];
+    };
+    BENCHMARK("suzanne.obj transparent over plane.obj, Phong")
+    {
+        renderer.ClearBuffers();
+        renderer.Render(plane, Mat44f{}, QRendererMode::kPhong);
+        renderer.RenderTransparent(suzanne, Mat44f{}, 0.5f, QRendererMode::kPhong);
+        renderer.Resolve();
+        return renderer.GetPixels()[0];
+    };
+}
+
+TEST_CASE("Shadow maps", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.0f, 2.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+    Light sun;
+    sun.vec = Vec3f{0.3f, -1.0f, -0.2f};
+    sun.castsShadows = true;
+    renderer.SetLights({sun});
+
+    // suzanne shadows the plane, both cast. Cached, only the lookups are left.
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+    auto drawFrame = [&]()
+    {
+        renderer.ClearBuffers();
+        renderer.RenderShadowCaster(plane, Mat44f{});
+        renderer.RenderShadowCaster(suzanne, Mat44f{});
+        renderer.Render(plane, Mat44f{}, QRendererMode::kPhong);
+        renderer.Render(suzanne, Mat44f{}, QRendererMode::kPhong);
+        return renderer.GetPixels()[0];
+    };
+    BENCHMARK("suzanne.obj over plane.obj, Phong, no shadows")
+    {
+        return drawFrame();
+    };
+    renderer.SetShadows(true);
+    BENCHMARK("suzanne.obj over plane.obj, Phong, 3 cascades of 1024^2, PCF")
+    {
+        return drawFrame();
+    };
+    ShadowSettings settings;
+    settings.isCached = true;
+    renderer.SetShadows(true, settings);
+    BENCHMARK("suzanne.obj over plane.obj, Phong, 3 cascades of 1024^2, PCF, cached")
+    {
+        return drawFrame();
+    };
+}
+
+TEST_CASE("Occlusion culling", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 0.0f, 2.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // A wall in front of a grid of teapots, most of which it hides
+    Model cube{OBJ::LoadFileData("Assets/Cube.obj")};
+    Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+    Mat44f wallMat = Math::InitScale(3.0f, 2.0f, 0.1f);
+    std::vector<Mat44f> teapotMats;
+    for (int z = 0; z < 4; ++z)
+    {
+        for (int x = -2; x <= 2; ++x)
+            teapotMats.push_back(Math::InitScale(0.3f, 0.3f, 0.3f) * Math::InitTranslation(x * 1.2f, -0.5f, -2.0f - z * 1.5f));
+    }
+
+    for (bool occlusion : {false, true})
+    {
+        renderer.SetOcclusionCulling(occlusion);
+        BENCHMARK(occlusion ? "20 teapots behind a wall, occlusion culling" : "20 teapots behind a wall")
+        {
+            renderer.ClearBuffers();
+            renderer.RenderOccluder(cube, wallMat);
+            renderer.Render(cube, wallMat, QRendererMode::kNone);
+            for (const Mat44f& teapotMat : teapotMats)
+                renderer.Render(teapot, teapotMat, QRendererMode::kNone);
+            return renderer.GetPixels()[0];
+        };
+    }
+}
+
+TEST_CASE("Instanced draws", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 2.0f, 4.0f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // An 8x8 grid of suzanne.obj
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    std::vector<Instance> instances;
+    for (int z = 0; z < 8; ++z)
+    {
+        for (int x = 0; x < 8; ++x)
+        {
+            Instance instance;
+            instance.modelMat = Math::InitScale(0.3f, 0.3f, 0.3f) * Math::InitTranslation(x * 0.8f - 2.8f, 0.0f, z * -0.8f);
+            instance.color = Vec3f{1.0f, (x + 1) / 8.0f, (z + 1) / 8.0f};
+            instances.push_back(instance);
+        }
+    }
+
+    BENCHMARK("64 suzanne.obj, one Render() each")
+    {
+        renderer.ClearBuffers();
+        for (const Instance& instance : instances)
+            renderer.Render(suzanne, instance.modelMat, QRendererMode::kGouraud);
+        return renderer.GetPixels()[0];
+    };
+    for (int threads : {1, 0})
+    {
+        renderer.SetInstanceThreads(threads);
+        BENCHMARK(threads ? "64 suzanne.obj, RenderInstanced() 1 thread" : "64 suzanne.obj, RenderInstanced()")
+        {
+            renderer.ClearBuffers();
+            renderer.RenderInstanced(suzanne, instances, QRendererMode::kGouraud);
+            return renderer.GetPixels()[0];
+        };
+    }
+
+    // A few small instances far away, where starting threads and going over whole frames cost more
+    // than the draws
+    std::vector<Instance> distant(instances.end() - 8, instances.end());
+    for (int threads : {1, 2})
+    {
+        renderer.SetInstanceThreads(threads);
+        BENCHMARK(threads == 1 ? "8 distant suzanne.obj, RenderInstanced() 1 thread" : "8 distant suzanne.obj, RenderInstanced() 2 threads")
+        {
+            renderer.ClearBuffers();
+            renderer.RenderInstanced(suzanne, distant, QRendererMode::kGouraud);
+            return renderer.GetPixels()[0];
+        };
+    }
+}
+
+TEST_CASE("Command buffer", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 0.0f, 2.0f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // A stack of suzanne.obj submitted back to front, the worst order for the depth test
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    std::vector<Mat44f> modelMats;
+    for (int i = 0; i < 8; ++i)
+        modelMats.push_back(Math::InitTranslation(0.1f * i, 0.0f, -0.5f * (7 - i)));
+
+    BENCHMARK("8 suzanne.obj back to front, Render()")
+    {
+        renderer.ClearBuffers();
+        for (const Mat44f& modelMat : modelMats)
+            renderer.Render(suzanne, modelMat, QRendererMode::kPhong);
+        return renderer.GetPixels()[0];
+    };
+
+    CommandBuffer commands;
+    BENCHMARK("8 suzanne.obj back to front, recorded and executed")
+    {
+        renderer.ClearBuffers();
+        commands.Clear();
+        for (const Mat44f& modelMat : modelMats)
+            commands.Draw(suzanne, modelMat, QRendererMode::kPhong);
+        renderer.Execute(commands);
+        return renderer.GetPixels()[0];
+    };
+}
+
+TEST_CASE("Levels of detail", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 0.0f, 2.0f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // A grid of teapot.obj going into the distance
+    Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+    std::vector<Mat44f> modelMats;
+    for (int z = 0; z < 8; ++z)
+    {
+        for (int x = 0; x < 4; ++x)
+            modelMats.push_back(Math::InitScale(0.3f, 0.3f, 0.3f) * Math::InitTranslation(x * 1.5f - 2.25f, -0.5f, -2.0f - 4.0f * z));
+    }
+
+    BENCHMARK("Build 4 lods of teapot.obj")
+    {
+        Model copy = teapot;
+        copy.BuildLods(4, false);
+        return copy.lods.size();
+    };
+
+    teapot.BuildLods(4, false);
+    auto drawGrid = [&]()
+    {
+        renderer.ClearBuffers();
+        for (const Mat44f& modelMat : modelMats)
+            renderer.Render(teapot, modelMat, QRendererMode::kGouraud);
+        return renderer.GetPixels()[0];
+    };
+
+    renderer.SetLodErrorThreshold(0.0f);
+    BENCHMARK("32 teapot.obj, full detail") { return drawGrid(); };
+    renderer.SetLodErrorThreshold(1.0f);
+    BENCHMARK("32 teapot.obj, lods within 1 pixel") { return drawGrid(); };
+}
+
+TEST_CASE("Bresenham lines", "[benchmark][Raster]")
+{
+    Rasterizer rasterizer;
+    constexpr int w = 800, h = 600;
+    std::vector<uint32_t> pixels(w * h, 0);
+    uint32_t white = 0xffffffff;
+
+    auto at = [](int x, int y) { return Vec4f{(float)x, (float)y, 0.0f, 1.0f}; };
+    BENCHMARK("DrawLine horizontal") { rasterizer.DrawLine(pixels.data(), nullptr, white, w, h, at(0, h / 2), at(w - 1, h / 2)); };
+    BENCHMARK("DrawLine vertical") { rasterizer.DrawLine(pixels.data(), nullptr, white, w, h, at(w / 2, 0), at(w / 2, h - 1)); };
+    BENCHMARK("DrawLine diagonal") { rasterizer.DrawLine(pixels.data(), nullptr, white, w, h, at(0, 0), at(h - 1, h - 1)); };
+    BENCHMARK("DrawLine shallow") { rasterizer.DrawLine(pixels.data(), nullptr, white, w, h, at(0, 0), at(w - 1, h / 4)); };
+
+    // Depth tested against a z-buffer that the line is in front of, then clipped from off screen
+    std::vector<float> zBuffer(w * h, 0.5f);
+    BENCHMARK("DrawLine horizontal, depth tested") { rasterizer.DrawLine(pixels.data(), zBuffer.data(), white, w, h, at(0, h / 2), at(w - 1, h / 2)); };
+    BENCHMARK("DrawLine shallow, clipped") { rasterizer.DrawLine(pixels.data(), nullptr, white, w, h, at(-w, -h / 4), at(2 * w, h / 2)); };
+}
+
+TEST_CASE("Wireframe", "[benchmark][Raster]")
+{
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.0f, 2.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+
+    // Each shared edge is drawn once, the plane has long lines that are clipped to the viewport
+    Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+    Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+    BENCHMARK("teapot.obj wireframe")
+    {
+        renderer.ClearBuffers();
+        renderer.Render(teapot, Mat44f{}, QRendererMode::kWireframe);
+        return renderer.GetPixels()[0];
+    };
+    BENCHMARK("plane.obj wireframe")
+    {
+        renderer.ClearBuffers();
+        renderer.Render(plane, Mat44f{}, QRendererMode::kWireframe);
+        return renderer.GetPixels()[0];
+    };
+    renderer.SetWireframeDepthTest(true);
+    BENCHMARK("teapot.obj wireframe over plane.obj, depth tested")
+    {
+        renderer.ClearBuffers();
+        renderer.Render(plane, Mat44f{}, QRendererMode::kZBuffer);
+        renderer.Render(teapot, Mat44f{}, QRendererMode::kWireframe);
+        return renderer.GetPixels()[0];
+    };
+}
+
+TEST_CASE("Texture sampling", "[benchmark][Texture]")
+{
+    Rasterizer rasterizer;
+    constexpr int texW = 512, texH = 512;
+    std::vector<uint32_t> texels(texW * texH);
+    for (int i = 0; i < texW * texH; ++i)
+        texels[i] = (uint32_t)i * 2654435761u;
+
+    // Walk uv along a diagonal so that fetches aren't all in the same cache line
+    BENCHMARK("SampleNearest 4096 fetches")
+    {
+        uint32_t acc = 0;
+        for (int i = 0; i < 4096; ++i)
+        {
+            float t = (float)i / 4096.0f;
+            acc ^= rasterizer.SampleNearest(texels.data(), texW, texH, Vec2f{t, 1.0f - t});
+        }
+        return acc;
+    };
+
+    // Same walk, 4 lanes a call like a quad
+    BENCHMARK("SampleBilinear4 4096 fetches")
+    {
+        uint32_t acc = 0;
+        uint32_t out[4];
+        for (int i = 0; i < 4096; i += 4)
+        {
+            const float t = (float)i / 4096.0f, dt = 1.0f / 4096.0f;
+            Vec2f uvs[4] = {Vec2f{t, 1.0f - t}, Vec2f{t + dt, 1.0f - t}, Vec2f{t, 1.0f - t - dt}, Vec2f{t + dt, 1.0f - t - dt}};
+            rasterizer.SampleBilinear4(texels.data(), texW, texH, uvs, out);
+            acc ^= out[0] ^ out[1] ^ out[2] ^ out[3];
+        }
+        return acc;
+    };
+
+    // The same texels drawn on a close-up plane, raw and through the decoded block cache
+    constexpr int w = 800, h = 600;
+    QRenderer renderer;
+    REQUIRE(renderer.Init(w, h));
+    renderer.SetProjectionMatrix(Math::InitPersp(3.14159265358979f / 2.0f, (float)w / h, 0.1f, 100.0f));
+    renderer.SetViewMatrix(renderer.LookAt(Vec3f{0.0f, 1.5f, 0.5f}, Vec3f{0.0f, 0.0f, 0.0f}));
+    Model plane{OBJ::LoadFileData("Assets/plane.obj")};
+    const TextureFormat formats[] = {TextureFormat::kRGBA32, TextureFormat::kBC1, TextureFormat::kBC3};
+    const char *names[] = {"RGBA32", "BC1", "BC3"};
+    for (int i = 0; i < 3; ++i)
+    {
+        auto texture = std::make_shared<QTexture>();
+        texture->Init(texW, texH, texels);
+        if (formats[i] != TextureFormat::kRGBA32)
+            texture->Compress(formats[i]);
+        BENCHMARK(std::string{"plane.obj textured, "} + names[i])
+        {
+            renderer.ClearBuffers();
+            renderer.Render(plane, Mat44f{}, texture, QRendererMode::kNone);
+            return renderer.GetPixels()[0];
+        };
+    }
+}
+
+TEST_CASE("Light loop", "[benchmark][Light]")
+{
+    Light bulb;
+    bulb.type = LightType::kPoint;
+    bulb.vec = Vec3f{1.0f, 2.0f, 0.0f};
+    LightBuffer lights;
+    lights.Upload({Light{}, bulb}, Mat44f{});
+
+    ShadeBatch batch;
+    for (int i = 0; i < ShadeBatch::kSize; ++i)
+    {
+        batch.px[i] = (float)i * 0.1f;
+        batch.py[i] = 0.0f;
+        batch.pz[i] = -3.0f;
+        batch.nx[i] = 0.0f;
+        batch.ny[i] = 1.0f;
+        batch.nz[i] = (float)i * 0.1f;
+    }
+
+    BENCHMARK("Shade 8 points, 2 lights") { lights.Shade(batch, ShadeBatch::kSize); return batch.r[0]; };
+    BENCHMARK("Shade 1 point, 2 lights") { return lights.Shade(Vec3f{0.0f, 0.0f, -3.0f}, Vec3f{0.0f, 1.0f, 0.0f}); };
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// OBJ parsing benchmarks
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("Parse OBJ files", "[benchmark][OBJ]")
+{
+    BENCHMARK("Cube.obj") { return OBJ::LoadFileData("Assets/Cube.obj"); };
+    BENCHMARK("plane.obj") { return OBJ::LoadFileData("Assets/plane.obj"); };
+    BENCHMARK("suzanne.obj") { return OBJ::LoadFileData("Assets/suzanne.obj"); };
+    BENCHMARK("teapot.obj") { return OBJ::LoadFileData("Assets/teapot.obj"); };
+}
+
+TEST_CASE("Load textures", "[benchmark][Texture]")
+{
+    // Every JPG in Assets, unloaded each time so that they're decoded again. Load() needs an
+    // SDL_Renderer, the serial baseline does what a loader thread does instead.
+    const std::vector<std::string> paths = {"Assets/bricks.jpg", "Assets/bricks2.jpg", "Assets/checkerboard.jpg", "Assets/texture-test.jpg"};
+    TextureManager& manager = TextureManager::Instance();
+    BENCHMARK("4 JPGs, decoded one after the other")
+    {
+        int w = 0, h = 0;
+        for (const std::string& path : paths)
+        {
+            std::vector<uint32_t> texels;
+            QTexture texture;
+            if (QTexture::LoadImage(path, w, h, texels))
+                texture.Init(w, h, std::move(texels));
+        }
+        return w;
+    };
+
+    BENCHMARK("4 JPGs, LoadAsync() then wait for all")
+    {
+        manager.UnloadAll();
+        std::vector<TextureHandle> handles;
+        for (const std::string& path : paths)
+            handles.push_back(manager.LoadAsync(path));
+        for (const TextureHandle& handle : handles)
+            handle.Wait();
+    };
+    manager.UnloadAll();
+
+    // What the disk cache saves on startup: decoding, mips and compression against mapping the
+    // result. The first run writes the cache files, the timed ones are all hits.
+    BENCHMARK("4 JPGs, decoded and compressed to BC1")
+    {
+        int w = 0, h = 0;
+        for (const std::string& path : paths)
+        {
+            std::vector<uint32_t> texels;
+            QTexture texture;
+            if (QTexture::LoadImage(path, w, h, texels))
+            {
+                texture.Init(w, h, std::move(texels));
+                texture.Compress(TextureFormat::kBC1);
+            }
+        }
+        return w;
+    };
+
+    for (const std::string& path : paths)
+        TextureCache::LoadImage(path, TextureFormat::kBC1);
+    BENCHMARK("4 JPGs, BC1 mapped from the disk cache")
+    {
+        int w = 0;
+        for (const std::string& path : paths)
+        {
+            std::shared_ptr<QTexture> texture = TextureCache::LoadImage(path, TextureFormat::kBC1);
+            w += texture ? texture->GetW() : 0;
+        }
+        return w;
+    };
+    for (const std::string& path : paths)
+        std::remove((path + ".qtex").c_str());
+}
@@ -0,0 +1,1310 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Math/Vector.h"
+#include "Math/Matrix.h"
+#include "Renderer/Light.h"
+#include "Renderer/MeshCache.h"
+#include "Renderer/Model.h"
+#include "Renderer/MultisampleBuffer.h"
+#include "Renderer/OBJLoader.h"
+#include "Renderer/QRenderer.h"
+#include "Renderer/ShadowMap.h"
+#include "Renderer/Texture.h"
+#include "Renderer/TransparencyBuffer.h"
+#include "TestScenes.h"
+
+// @brief Golden-image regression tests. Deterministic scenes built from the Assets meshes are
+// rendered through the headless QRenderer in every QRendererMode, and compared against reference
+// images in QR_GOLDEN_DIR.
+// @note A missing reference image fails the test. Set the environment variable QR_UPDATE_GOLDEN=1 to
+// record the references, after an intended change of output or for a new scene, and commit them. On
+// mismatch, the rendered image and a diff image are written to GoldenDiff/.
+#ifndef QR_GOLDEN_DIR
+#define QR_GOLDEN_DIR "Golden"
+#endif
+
+using namespace TestScenes;
+
+namespace
+{
+    // @brief Max abs difference allowed per channel, and how many pixels may exceed it. The latter
+    // absorbs edge pixels that flip between compilers/instruction sets.
+    constexpr int kChannelTolerance = 8;
+    constexpr float kMaxBadPixelRatio = 0.005f;
+
+    struct Image
+    {
+        int w = 0, h = 0;
+        std::vector<uint8_t> rgb;
+    };
+
+    // @brief Pixel buffer is RGBA32 and y is pointing up, so flip rows to get a top-down image
+    Image ToImage(const std::vector<uint32_t>& pixels, int w, int h)
+    {
+        Image img{w, h, std::vector<uint8_t>(w * h * 3)};
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                uint32_t c = pixels[x + (h - 1 - y) * w];
+                uint8_t *dst = &img.rgb[(x + y * w) * 3];
+                dst[0] = (c >> 0) & 0xff;
+                dst[1] = (c >> 8) & 0xff;
+                dst[2] = (c >> 16) & 0xff;
+            }
+        }
+        return img;
+    }
+
+    // @brief Binary PPM (P6), so reference images can be viewed without extra dependencies
+    bool WritePPM(const std::string& filePath, const Image& img)
+    {
+        std::ofstream ofs{filePath, std::ios::binary};
+        if (!ofs) { return false; }
+        ofs << "P6\n" << img.w << " " << img.h << "\n255\n";
+        ofs.write(reinterpret_cast<const char*>(img.rgb.data()), img.rgb.size());
+        return (bool)ofs;
+    }
+
+    bool ReadPPM(const std::string& filePath, Image& outImg)
+    {
+        std::ifstream ifs{filePath, std::ios::binary};
+        if (!ifs) { return false; }
+        std::string magic;
+        int maxVal = 0;
+        ifs >> magic >> outImg.w >> outImg.h >> maxVal;
+        if (magic != "P6" || maxVal != 255) { return false; }
+        ifs.get();  // Single whitespace before the data
+        outImg.rgb.resize(outImg.w * outImg.h * 3);
+        ifs.read(reinterpret_cast<char*>(outImg.rgb.data()), outImg.rgb.size());
+        return (bool)ifs;
+    }
+
+    // @brief Mismatched pixels are red on top of a dimmed grayscale version of the reference
+    // @return Number of pixels where any channel differs by more than kChannelTolerance
+    int Compare(const Image& actual, const Image& expected, Image& outDiff)
+    {
+        outDiff = Image{actual.w, actual.h, std::vector<uint8_t>(actual.rgb.size())};
+        int badCnt = 0;
+        for (int i = 0; i < actual.w * actual.h; ++i)
+        {
+            const uint8_t *a = &actual.rgb[i * 3];
+            const uint8_t *e = &expected.rgb[i * 3];
+            bool isBad = false;
+            for (int c = 0; c < 3; ++c)
+                isBad |= std::abs((int)a[c] - (int)e[c]) > kChannelTolerance;
+
+            uint8_t *d = &outDiff.rgb[i * 3];
+            if (isBad)
+            {
+                ++badCnt;
+                d[0] = 255; d[1] = 0; d[2] = 0;
+            }
+            else
+            {
+                uint8_t gray = (uint8_t)((e[0] + e[1] + e[2]) / 12);
+                d[0] = gray; d[1] = gray; d[2] = gray;
+            }
+        }
+        return badCnt;
+    }
+
+    void CheckAgainstGolden(const std::string& name, const std::vector<uint32_t>& pixels)
+    {
+        Image actual = ToImage(pixels, kW, kH);
+        std::string refPath = std::string{QR_GOLDEN_DIR} + "/" + name + ".ppm";
+
+        const char *update = std::getenv("QR_UPDATE_GOLDEN");
+        if (update && std::string{update} == "1")
+        {
+            REQUIRE(WritePPM(refPath, actual));
+            WARN("Recorded reference image " << refPath);
+            return;
+        }
+
+        Image expected;
+        if (!ReadPPM(refPath, expected))
+            FAIL("Missing reference image " << refPath << ", run with QR_UPDATE_GOLDEN=1 to record it");
+
+        INFO(name);
+        REQUIRE(expected.w == actual.w);
+        REQUIRE(expected.h == actual.h);
+
+        Image diff;
+        int badCnt = Compare(actual, expected, diff);
+        if (badCnt > (int)(kMaxBadPixelRatio * kW * kH))
+        {
+            WritePPM("GoldenDiff/" + name + ".ppm", actual);
+            WritePPM("GoldenDiff/" + name + "_diff.ppm", diff);
+        }
+        INFO(name << ": " << badCnt << " pixels differ, see GoldenDiff/" << name << "_diff.ppm");
+        CHECK(badCnt <= (int)(kMaxBadPixelRatio * kW * kH));
+    }
+
+    struct ModeInfo
+    {
+        std::string name;
+        QRendererMode mode;
+    };
+
+    std::vector<ModeInfo> GetModes()
+    {
+        return {
+            {"none", QRendererMode::kNone},
+            {"wireframe", QRendererMode::kWireframe},
+            {"zbuffer", QRendererMode::kZBuffer},
+            {"gouraud", QRendererMode::kGouraud},
+            {"phong", QRendererMode::kPhong},
+        };
+    }
+}
+
+TEST_CASE("Render golden scenes", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+
+    // A dimmed default light plus a warm point light, so that both light types are covered
+    Light sun;
+    sun.intensity = 0.7f;
+    Light bulb;
+    bulb.type = LightType::kPoint;
+    bulb.vec = Vec3f{1.5f, 1.5f, 1.0f};
+    bulb.color = Vec3f{1.0f, 0.8f, 0.5f};
+    bulb.range = 5.0f;
+    renderer.SetLights({sun, bulb});
+    std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+
+    for (const Scene& scene : GetScenes())
+    {
+        Model model{OBJ::LoadFileData(scene.filePath)};
+
+        for (const ModeInfo& mode : GetModes())
+        {
+            renderer.ClearBuffers();
+            renderer.Render(model, scene.modelMat, mode.mode);
+            CheckAgainstGolden(scene.name + "_" + mode.name, renderer.GetPixels());
+
+            renderer.ClearBuffers();
+            renderer.Render(model, scene.modelMat, checkerboard, mode.mode);
+            CheckAgainstGolden(scene.name + "_textured_" + mode.name, renderer.GetPixels());
+        }
+    }
+}
+
+TEST_CASE("Raster traversals match", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+    std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+
+    // kBlocks visits the same pixels with the same float ops as kBoundingBox, so there's no
+    // tolerance. kSpans (and kAuto) interpolate incrementally, so they're compared like the golden
+    // images.
+    const RasterTraversal traversals[] = {RasterTraversal::kBlocks, RasterTraversal::kSpans, RasterTraversal::kAuto};
+    for (const Scene& scene : GetScenes())
+    {
+        Model model{OBJ::LoadFileData(scene.filePath)};
+
+        for (const ModeInfo& mode : GetModes())
+        {
+            renderer.SetRasterTraversal(RasterTraversal::kBoundingBox);
+            renderer.ClearBuffers();
+            renderer.Render(model, scene.modelMat, checkerboard, mode.mode);
+            std::vector<uint32_t> expected = renderer.GetPixels();
+
+            for (RasterTraversal traversal : traversals)
+            {
+                INFO(scene.name << "_textured_" << mode.name << " with traversal " << (int)traversal);
+                renderer.SetRasterTraversal(traversal);
+                renderer.ClearBuffers();
+                renderer.Render(model, scene.modelMat, checkerboard, mode.mode);
+                if (traversal == RasterTraversal::kBlocks)
+                {
+                    CHECK(renderer.GetPixels() == expected);
+                }
+                else
+                {
+                    Image diff;
+                    int badCnt = Compare(ToImage(renderer.GetPixels(), kW, kH), ToImage(expected, kW, kH), diff);
+                    CHECK(badCnt <= (int)(kMaxBadPixelRatio * kW * kH));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Culling counts", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+
+    SECTION("Half of a closed convex mesh is back facing")
+    {
+        Model cube{OBJ::LoadFileData("Assets/Cube.obj")};
+        renderer.Render(cube, GetScenes()[0].modelMat, QRendererMode::kNone);
+        const RasterStats& stats = renderer.GetStats();
+        CHECK(stats.submitted == 12);
+        CHECK(stats.backFacing == 6);
+        CHECK(stats.rasterized == 6);
+    }
+
+    SECTION("Tris of a distant mesh cover no pixel center")
+    {
+        Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+        renderer.Render(suzanne, Math::InitTranslation(0.0f, 0.0f, -90.0f), QRendererMode::kNone);
+        const RasterStats& stats = renderer.GetStats();
+        CHECK(stats.noSamples > 0);
+        CHECK(stats.outsideFrustum + stats.backFacing + stats.noSamples + stats.rasterized == stats.submitted);
+
+        renderer.ResetStats();
+        CHECK(renderer.GetStats().submitted == 0);
+    }
+
+    SECTION("Clusters cover every tri once")
+    {
+        Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+        REQUIRE(teapot.clusters.size() > 1);
+        int next = 0;
+        for (const Cluster& cluster : teapot.clusters)
+        {
+            CHECK(cluster.firstIndex == next);
+            CHECK(cluster.indexCount <= 256 * 3);
+            next += cluster.indexCount;
+        }
+        CHECK(next == (int)teapot.vertIndices.size());
+    }
+
+    SECTION("Back facing clusters are culled as a unit")
+    {
+        Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+        renderer.Render(teapot, GetScenes()[3].modelMat, QRendererMode::kNone);
+        const RasterStats& stats = renderer.GetStats();
+        CHECK(stats.clustersCulled > 0);
+        CHECK(stats.submitted < (int)teapot.vertIndices.size() / 3);
+    }
+
+    SECTION("Models outside of the frustum are skipped")
+    {
+        Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+        renderer.Render(suzanne, Math::InitTranslation(0.0f, 0.0f, 10.0f), QRendererMode::kNone);
+        CHECK(renderer.GetStats().modelsCulled == 1);
+        CHECK(renderer.GetStats().submitted == 0);
+    }
+
+    SECTION("Models behind an occluder are skipped, and nothing visible is")
+    {
+        Model cube{OBJ::LoadFileData("Assets/Cube.obj")};
+        Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+        const Mat44f hidden = Math::InitScale(0.4f, 0.4f, 0.4f) * Math::InitTranslation(0.0f, -0.3f, -3.0f);
+        const Mat44f visible = Math::InitScale(0.4f, 0.4f, 0.4f) * Math::InitTranslation(1.6f, 0.0f, -1.0f);
+        auto drawScene = [&]()
+        {
+            renderer.ClearBuffers();
+            renderer.RenderOccluder(cube, GetScenes()[0].modelMat);
+            renderer.Render(cube, GetScenes()[0].modelMat, QRendererMode::kNone);
+            renderer.Render(suzanne, hidden, QRendererMode::kNone);
+            renderer.Render(suzanne, visible, QRendererMode::kNone);
+            return renderer.GetPixels();
+        };
+
+        std::vector<uint32_t> reference = drawScene();
+        CHECK(renderer.GetStats().modelsOccluded == 0);
+
+        renderer.ResetStats();
+        renderer.SetOcclusionCulling(true);
+        CHECK(drawScene() == reference);
+        CHECK(renderer.GetStats().modelsOccluded == 1);
+    }
+
+    SECTION("Models peeking less than a texel past an occluder aren't culled")
+    {
+        // A quad over the left of the buffer, its right edge 0.4 texel past the center of column
+        // 128. Identity mvp, so raster x is (x + 1) * kW / 2 and the depth is 1.
+        constexpr float texel = 2.0f / OcclusionBuffer::kW;
+        const float edge = 0.4f * texel;
+        Model occluder;
+        occluder.verts = {{-1.0f, -1.0f, 0.5f}, {edge, -1.0f, 0.5f}, {edge, 1.0f, 0.5f}, {-1.0f, 1.0f, 0.5f}};
+        occluder.vertIndices = {0, 2, 1, 0, 3, 2};
+        occluder.BuildClusters();
+        OcclusionBuffer buffer;
+        buffer.Rasterize(occluder, Mat44f{});
+
+        // Boxes behind it at depth 1/2: w is doubled, and x and y with it so they stay in place
+        Mat44f behind;
+        behind(0, 0) = 2.0f;
+        behind(1, 1) = 2.0f;
+        behind(3, 3) = 2.0f;
+        auto box = [](float maxX)
+        {
+            Bounds bounds;
+            bounds.min = Vec3f{-0.5f, -0.5f, 0.5f};
+            bounds.max = Vec3f{maxX, 0.5f, 0.5f};
+            return bounds;
+        };
+        CHECK(buffer.IsOccluded(box(-texel), behind));
+
+        // Column 128 spans [127.5, 128.5], the occluder only covers it up to 128.4
+        CHECK_FALSE(buffer.IsOccluded(box(0.45f * texel), behind));
+        CHECK_FALSE(buffer.IsOccluded(box(0.6f * texel), behind));
+    }
+}
+
+TEST_CASE("Instanced draws match one draw per instance", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+    renderer.SetInstanceThreads(4);
+
+    // Rows at increasing depth that overlap on screen, so that the merge order matters
+    Model suzanne{OBJ::LoadFileData("Assets/suzanne.obj")};
+    std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+    std::vector<Instance> instances;
+    for (int z = 0; z < 4; ++z)
+    {
+        for (int x = 0; x < 6; ++x)
+        {
+            Instance instance;
+            instance.modelMat = Math::InitScale(0.3f, 0.3f, 0.3f) * Math::InitTranslation(x * 0.5f - 1.4f, 0.0f, z * -0.4f);
+            instance.textureIndex = (x + z) % 2 ? 0 : -1;
+            instances.push_back(instance);
+        }
+    }
+
+    for (const ModeInfo& mode : GetModes())
+    {
+        renderer.ClearBuffers();
+        renderer.ResetStats();
+        for (const Instance& instance : instances)
+        {
+            if (instance.textureIndex < 0)
+                renderer.Render(suzanne, instance.modelMat, mode.mode);
+            else
+                renderer.Render(suzanne, instance.modelMat, checkerboard, mode.mode);
+        }
+        std::vector<uint32_t> reference = renderer.GetPixels();
+        RasterStats referenceStats = renderer.GetStats();
+
+        renderer.ClearBuffers();
+        renderer.ResetStats();
+        renderer.RenderInstanced(suzanne, instances, {checkerboard}, mode.mode);
+        INFO(mode.name);
+        CHECK(renderer.GetPixels() == reference);
+        CHECK(renderer.GetStats().rasterized == referenceStats.rasterized);
+    }
+
+    SECTION("Workers are reused, and what they drew last time doesn't leak into the next draw")
+    {
+        // Half of the instances moved to one side, and one crossing the near plane, then back
+        std::vector<Instance> moved;
+        for (int i = 0; i < (int)instances.size(); i += 2)
+        {
+            Instance instance = instances[i];
+            instance.modelMat = instance.modelMat * Math::InitTranslation(-0.8f, 0.6f, 0.0f);
+            moved.push_back(instance);
+        }
+        moved[5].modelMat = Math::InitTranslation(0.0f, 1.0f, 1.8f);
+        for (const std::vector<Instance>* draw : {&instances, &moved, &instances})
+        {
+            renderer.ClearBuffers();
+            for (const Instance& instance : *draw)
+            {
+                if (instance.textureIndex < 0)
+                    renderer.Render(suzanne, instance.modelMat, QRendererMode::kPhong);
+                else
+                    renderer.Render(suzanne, instance.modelMat, checkerboard, QRendererMode::kPhong);
+            }
+            std::vector<uint32_t> reference = renderer.GetPixels();
+
+            renderer.ClearBuffers();
+            renderer.RenderInstanced(suzanne, *draw, {checkerboard}, QRendererMode::kPhong);
+            CHECK(renderer.GetPixels() == reference);
+        }
+    }
+
+    SECTION("A texture behind several indices is locked once")
+    {
+        renderer.ClearBuffers();
+        renderer.RenderInstanced(suzanne, instances, {checkerboard}, QRendererMode::kPhong);
+        std::vector<uint32_t> reference = renderer.GetPixels();
+
+        // Locking a texture twice, or unlocking it twice, is reported on stderr
+        for (int i = 0; i < (int)instances.size(); i += 3)
+            instances[i].textureIndex = (instances[i].textureIndex < 0) ? -1 : 1;
+        std::ostringstream errors;
+        std::streambuf *cerrBuf = std::cerr.rdbuf(errors.rdbuf());
+        renderer.ClearBuffers();
+        renderer.RenderInstanced(suzanne, instances, {checkerboard, checkerboard, checkerboard}, QRendererMode::kPhong);
+        std::cerr.rdbuf(cerrBuf);
+        CHECK(renderer.GetPixels() == reference);
+        CHECK(errors.str().empty());
+        CHECK(checkerboard->GetTexels() == nullptr);
+    }
+
+    SECTION("Instance colors tint the surface")
+    {
+        for (Instance& instance : instances)
+        {
+            instance.color = Vec3f{1.0f, 0.0f, 0.0f};
+            instance.textureIndex = -1;
+        }
+        renderer.ClearBuffers();
+        renderer.RenderInstanced(suzanne, instances, QRendererMode::kGouraud);
+        int litCnt = 0, notRedCnt = 0;
+        for (uint32_t pixel : renderer.GetPixels())
+        {
+            litCnt += (pixel & 0xff) ? 1 : 0;
+            notRedCnt += (pixel & 0x00ffff00) ? 1 : 0;
+        }
+        CHECK(litCnt > 0);
+        CHECK(notRedCnt == 0);
+    }
+}
+
+TEST_CASE("Command buffers match inline draws", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+
+    // Every scene, plus a model off screen, recorded back to front with mixed states
+    std::vector<Model> models;
+    for (const Scene& scene : GetScenes())
+        models.push_back(OBJ::LoadFileData(scene.filePath));
+    std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+    const Mat44f offScreen = Math::InitTranslation(0.0f, 0.0f, 10.0f);
+
+    renderer.ResetStats();
+    for (int i = (int)models.size() - 1; i >= 0; --i)
+    {
+        const Mat44f modelMat = GetScenes()[i].modelMat * Math::InitTranslation(0.0f, 0.0f, -1.5f * i);
+        if (i % 2)
+            renderer.Render(models[i], modelMat, checkerboard, QRendererMode::kGouraud);
+        else
+            renderer.Render(models[i], modelMat, QRendererMode::kPhong);
+    }
+    renderer.Render(models[0], offScreen, QRendererMode::kPhong);
+    std::vector<uint32_t> reference = renderer.GetPixels();
+    RasterStats referenceStats = renderer.GetStats();
+
+    CommandBuffer commands;
+    for (int i = (int)models.size() - 1; i >= 0; --i)
+    {
+        const Mat44f modelMat = GetScenes()[i].modelMat * Math::InitTranslation(0.0f, 0.0f, -1.5f * i);
+        if (i % 2)
+            commands.Draw(models[i], modelMat, checkerboard, QRendererMode::kGouraud);
+        else
+            commands.Draw(models[i], modelMat, QRendererMode::kPhong);
+    }
+    commands.Draw(models[0], offScreen, QRendererMode::kPhong);
+    REQUIRE(commands.GetCommands().size() == models.size() + 1);
+
+    renderer.ClearBuffers();
+    renderer.ResetStats();
+    renderer.Execute(commands);
+    CHECK(renderer.GetPixels() == reference);
+    CHECK(renderer.GetStats().modelsCulled == referenceStats.modelsCulled);
+    CHECK(renderer.GetStats().rasterized == referenceStats.rasterized);
+
+    commands.Clear();
+    CHECK(commands.GetCommands().empty());
+}
+
+TEST_CASE("Levels of detail", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+
+    // The teapot's UVs are split on every vert, so it only simplifies when seams can move
+    Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+    teapot.BuildLods(4, false);
+
+    SECTION("Each level has fewer tris and more error")
+    {
+        REQUIRE(teapot.lods.size() == 4);
+        int prevTris = (int)teapot.vertIndices.size() / 3;
+        float prevError = 0.0f;
+        for (const Lod& lod : teapot.lods)
+        {
+            const int tris = (int)lod.vertIndices.size() / 3;
+            CHECK(tris < prevTris);
+            CHECK(lod.error >= prevError);
+            CHECK(lod.nIndices.size() == lod.vertIndices.size());
+            CHECK(lod.clusters.back().firstIndex + lod.clusters.back().indexCount == (int)lod.vertIndices.size());
+            prevTris = tris;
+            prevError = lod.error;
+        }
+    }
+
+    SECTION("Seams are kept")
+    {
+        // A flat grid whose left and right halves are mapped to separate halves of the texture, the
+        // column of verts between them has a different uv on each side
+        constexpr int kCells = 16;
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> texCoords;
+        for (int side = 0; side < 2; ++side)
+        {
+            for (int j = 0; j <= kCells; ++j)
+            {
+                for (int i = 0; i <= kCells; ++i)
+                {
+                    if (side == 0)
+                        verts.push_back(Vec3f{(i - kCells / 2) * 0.25f, 0.0f, j * -0.25f});
+                    texCoords.push_back(Vec2f{side * 0.5f + i / (2.0f * kCells), j / (float)kCells});
+                }
+            }
+        }
+        std::vector<int> vertIndices, uvIndices;
+        for (int j = 0; j < kCells; ++j)
+        {
+            for (int i = 0; i < kCells; ++i)
+            {
+                const int corner = i + j * (kCells + 1);
+                const int uvOffset = (i < kCells / 2) ? 0 : (kCells + 1) * (kCells + 1);
+                for (int k : {0, 1, kCells + 2, 0, kCells + 2, kCells + 1})
+                {
+                    vertIndices.push_back(corner + k);
+                    uvIndices.push_back(corner + k + uvOffset);
+                }
+            }
+        }
+
+        // The seam's verts in each level, and if they kept the uvs of both sides. The verts are
+        // reordered by the constructor, they're found by position.
+        auto checkSeam = [](const Model& grid, const std::vector<int>& levelVertIndices, const std::vector<int>& levelUVIndices,
+            int& outSeamVerts, int& outBothSides)
+        {
+            std::vector<int> sides(grid.verts.size(), 0);
+            for (int i = 0; i < (int)levelVertIndices.size(); ++i)
+            {
+                const float u = grid.texCoords[levelUVIndices[i]].x;
+                sides[levelVertIndices[i]] |= (u == 0.25f) ? 1 : (u == 0.75f) ? 2 : 0;
+            }
+            outSeamVerts = 0;
+            outBothSides = 0;
+            for (int v = 0; v < (int)grid.verts.size(); ++v)
+            {
+                const Vec3f& p = grid.verts[v];
+                if (p.x != 0.0f || p.z == 0.0f || p.z == -0.25f * kCells)
+                    continue;
+                outSeamVerts += sides[v] ? 1 : 0;
+                outBothSides += (sides[v] == 3) ? 1 : 0;
+            }
+        };
+
+        for (bool keepSeams : {true, false})
+        {
+            Model grid{InputWindingOrder::kCW, verts, {}, vertIndices, texCoords, uvIndices};
+            grid.BuildLods(4, keepSeams);
+            REQUIRE(!grid.lods.empty());
+
+            int seamVerts = 0, bothSides = 0;
+            checkSeam(grid, grid.vertIndices, grid.uvIndices, seamVerts, bothSides);
+            REQUIRE(seamVerts == kCells - 1);
+            REQUIRE(bothSides == kCells - 1);
+
+            int fewestSeamVerts = seamVerts;
+            for (const Lod& lod : grid.lods)
+            {
+                INFO("keepSeams " << keepSeams << ", level " << (&lod - grid.lods.data()) + 1);
+                checkSeam(grid, lod.vertIndices, lod.uvIndices, seamVerts, bothSides);
+                if (keepSeams)
+                {
+                    CHECK(seamVerts == kCells - 1);
+                    CHECK(bothSides == kCells - 1);
+                }
+                fewestSeamVerts = std::min(fewestSeamVerts, seamVerts);
+            }
+            if (!keepSeams)
+                CHECK(fewestSeamVerts < kCells - 1);
+        }
+    }
+
+    SECTION("Distant models draw a coarser level")
+    {
+        const Mat44f distant = Math::InitTranslation(0.0f, 0.0f, -40.0f);
+        renderer.SetLodErrorThreshold(0.0f);
+        renderer.Render(teapot, distant, QRendererMode::kNone);
+        const int fullTris = renderer.GetStats().submitted;
+
+        renderer.ResetStats();
+        renderer.SetLodErrorThreshold(1.0f);
+        renderer.Render(teapot, distant, QRendererMode::kNone);
+        const int distantTris = renderer.GetStats().submitted;
+        CHECK(distantTris < fullTris);
+
+        // The same error covers more pixels up close
+        renderer.ResetStats();
+        renderer.Render(teapot, GetScenes()[3].modelMat, QRendererMode::kNone);
+        CHECK(renderer.GetStats().submitted > distantTris);
+    }
+
+    SECTION("The cache round trips, and is rebuilt for other settings")
+    {
+        const std::string cachePath = "LodTest.qmesh";
+        REQUIRE(MeshCache::Save(cachePath, teapot, "Assets/teapot.obj", 4, false));
+
+        Model cached;
+        REQUIRE(MeshCache::Load(cachePath, "Assets/teapot.obj", 4, false, cached));
+        CHECK(cached.vertIndices == teapot.vertIndices);
+        CHECK(cached.uvIndices == teapot.uvIndices);
+        CHECK(cached.clusters.size() == teapot.clusters.size());
+        REQUIRE(cached.lods.size() == teapot.lods.size());
+        for (int i = 0; i < (int)teapot.lods.size(); ++i)
+        {
+            CHECK(cached.lods[i].vertIndices == teapot.lods[i].vertIndices);
+            CHECK(cached.lods[i].error == teapot.lods[i].error);
+        }
+
+        CHECK_FALSE(MeshCache::Load(cachePath, "Assets/teapot.obj", 4, true, cached));
+        CHECK_FALSE(MeshCache::Load(cachePath, "Assets/suzanne.obj", 4, false, cached));
+        std::remove(cachePath.c_str());
+    }
+
+    SECTION("Caches with indices out of range are a miss")
+    {
+        // Written through Save(), the same as a file whose index bytes were corrupted
+        const std::string cachePath = "LodTest.qmesh";
+        REQUIRE(!teapot.lods.empty());
+        std::vector<std::function<void(Model&)>> corruptions{
+            [](Model& m) { m.vertIndices[5] = (int)m.verts.size(); },
+            [](Model& m) { m.uvIndices[7] = -1; },
+            [](Model& m) { m.nIndices.pop_back(); },
+            [](Model& m) { m.clusters.back().indexCount += 3; },
+            [](Model& m) { m.edges[0].tri1 = (int)m.vertIndices.size() / 3; },
+            [](Model& m) { m.lods.back().vertIndices[0] = -2; },
+            [](Model& m) { m.lods[0].edges.back().v1 = (int)m.verts.size(); },
+        };
+        for (int i = 0; i < (int)corruptions.size(); ++i)
+        {
+            INFO("Corruption " << i);
+            Model corrupt = teapot;
+            corruptions[i](corrupt);
+            REQUIRE(MeshCache::Save(cachePath, corrupt, "Assets/teapot.obj", 4, false));
+            Model cached;
+            CHECK_FALSE(MeshCache::Load(cachePath, "Assets/teapot.obj", 4, false, cached));
+            CHECK(cached.verts.empty());
+        }
+        std::remove(cachePath.c_str());
+    }
+
+    SECTION("LoadOBJ() builds the cache on the first load, and the next one is a hit")
+    {
+        const std::string cachePath = "Assets/teapot.obj.qmesh";
+        std::remove(cachePath.c_str());
+        bool isHit = true;
+        const Model built = MeshCache::LoadOBJ("Assets/teapot.obj", 4, false, &isHit);
+        CHECK_FALSE(isHit);
+        CHECK(built.vertIndices == teapot.vertIndices);
+        CHECK(built.lods.size() == teapot.lods.size());
+
+        const Model loaded = MeshCache::LoadOBJ("Assets/teapot.obj", 4, false, &isHit);
+        CHECK(isHit);
+        CHECK(loaded.verts.size() == built.verts.size());
+        CHECK(loaded.vertIndices == built.vertIndices);
+        CHECK(loaded.edges.size() == built.edges.size());
+        REQUIRE(loaded.lods.size() == built.lods.size());
+        for (int i = 0; i < (int)built.lods.size(); ++i)
+        {
+            CHECK(loaded.lods[i].vertIndices == built.lods[i].vertIndices);
+            CHECK(loaded.lods[i].uvIndices == built.lods[i].uvIndices);
+            CHECK(loaded.lods[i].nIndices == built.lods[i].nIndices);
+            CHECK(loaded.lods[i].error == built.lods[i].error);
+        }
+        std::remove(cachePath.c_str());
+    }
+}
+
+TEST_CASE("Tri order", "[Golden]")
+{
+    QRenderer renderer;
+    InitRenderer(renderer);
+
+    // The teapot with its tris shuffled, the worst order for the vertex cache and the depth test
+    Model teapot{OBJ::LoadFileData("Assets/teapot.obj")};
+    Model shuffled = teapot;
+    shuffled.clusters.clear();
+    uint32_t seed = 1;
+    for (int t = (int)shuffled.vertIndices.size() / 3 - 1; t > 0; --t)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        int other = (int)((seed >> 8) % (uint32_t)(t + 1));
+        for (int k = 0; k < 3; ++k)
+        {
+            std::swap(shuffled.vertIndices[t * 3 + k], shuffled.vertIndices[other * 3 + k]);
+            std::swap(shuffled.uvIndices[t * 3 + k], shuffled.uvIndices[other * 3 + k]);
+            std::swap(shuffled.nIndices[t * 3 + k], shuffled.nIndices[other * 3 + k]);
+        }
+    }
+    Model optimized = shuffled;
+    optimized.BuildClusters();
+    optimized.ReorderVertices();
+
+    SECTION("Fewer cache misses")
+    {
+        CHECK(Model::ComputeACMR(optimized.vertIndices) < 0.8f);
+        CHECK(Model::ComputeACMR(shuffled.vertIndices) > 1.5f);
+    }
+
+    SECTION("Less overdraw around the model")
+    {
+        // Each draw starts from cleared buffers, the other draw's depth would hide most of its pixels.
+        // The order is per cluster, so it isn't front to back from every side: a view can be a bit
+        // worse, but the views around the model are better overall.
+        renderer.SetPixelCounting(true);
+        auto countShaded = [&renderer](const Model& model)
+        {
+            renderer.ClearBuffers();
+            renderer.ResetStats();
+            renderer.Render(model, GetScenes()[3].modelMat, QRendererMode::kNone);
+            return renderer.GetStats().pixelsShaded;
+        };
+
+        int shuffledTotal = 0, optimizedTotal = 0, lowerCnt = 0;
+        for (int k = 0; k < 4; ++k)
+        {
+            const float angle = k * kPi / 2.0f;
+            renderer.SetViewMatrix(GetViewMat(Vec3f{2.5f * std::sin(angle), 1.0f, 2.5f * std::cos(angle)}));
+            const int shuffledShaded = countShaded(shuffled);
+            const int optimizedShaded = countShaded(optimized);
+            INFO(k << ": " << optimizedShaded << " shaded in order, " << shuffledShaded << " shuffled");
+            CHECK(optimizedShaded > 0);
+            shuffledTotal += shuffledShaded;
+            optimizedTotal += optimizedShaded;
+            lowerCnt += (optimizedShaded < shuffledShaded) ? 1 : 0;
+        }
+        CHECK(lowerCnt > 0);
+        CHECK(optimizedTotal < shuffledTotal);
+    }
+
+    SECTION("Reordering the verts doesn't change the pixels")
+    {
+        renderer.Render(shuffled, GetScenes()[3].modelMat, QRendererMode::kGouraud);
+        std::vector<uint32_t> reference = renderer.GetPixels();
+
+        Model reordered = shuffled;
+        reordered.ReorderVertices();
+        CHECK(reordered.vertIndices != shuffled.vertIndices);
+        renderer.ClearBuffers();
+        renderer.Render(reordered, GetScenes()[3].modelMat, QRendererMode::kGouraud);
+        CHECK(renderer.GetPixels() == reference);
+    }
+}
+
+TEST_CASE("Multisampling", "[Golden]")
+{
+    SECTION("Edge pixels cover the fraction of their samples inside the tri")
+    {
+        // Identity matrices keep the verts in clip space with w = 1, so the tri is drawn where it
+        // is and kZBuffer draws it white (1/w = 1)
+        constexpr int w = 64, h = 48;
+        Model tri;
+        tri.verts = {Vec3f{-0.8f, -0.7f, 0.5f}, Vec3f{0.1f, 0.85f, 0.5f}, Vec3f{0.9f, -0.5f, 0.5f}};
+        tri.vertIndices = {0, 1, 2};
+        Vec2f raster[3];
+        for (int k = 0; k < 3; ++k)
+            raster[k] = Vec2f{(tri.verts[k].x + 1.0f) * w / 2.0f, (tri.verts[k].y + 1.0f) * h / 2.0f};
+        const float area = 0.5f * std::abs((raster[2].x - raster[0].x) * (raster[1].y - raster[0].y) - (raster[2].y - raster[0].y) * (raster[1].x - raster[0].x));
+
+        for (int samples : {2, 4, 8})
+        {
+            INFO(samples << " samples");
+            MultisampleBuffer buffer;
+            buffer.Init(samples, w, h);
+            Rasterizer rasterizer;
+            rasterizer.SetMultisampleBuffer(&buffer);
+            std::vector<uint32_t> pixels(w * h, 0);
+            std::vector<float> zBuffer(w * h, 0.0f);
+            rasterizer.Rasterize(pixels.data(), zBuffer.data(), w, h, tri, Mat44f{}, Mat44f{}, QRendererMode::kZBuffer);
+            buffer.Resolve(pixels.data());
+
+            float covered = 0.0f;
+            int partial = 0;
+            for (uint32_t pixel : pixels)
+            {
+                const int c = (int)(pixel & 0xff);
+                covered += c / 255.0f;
+                if (c == 0 || c == 255)
+                    continue;
+
+                // k of the samples, averaged with rounding
+                ++partial;
+                bool isLevel = false;
+                for (int k = 1; k < samples; ++k)
+                    isLevel |= (c == (k * 255 + samples / 2) / samples);
+                CHECK(isLevel);
+            }
+            CHECK(std::abs(covered - area) < area * 0.03f);
+            CHECK(partial > 0);
+            CHECK(partial == buffer.CountEdgePixels());
+            // Only the pixels along the 3 edges, about 150 pixels long
+            CHECK(partial < 300);
+        }
+    }
+
+    SECTION("Only the edges differ from single sampled draws")
+    {
+        QRenderer renderer;
+        InitRenderer(renderer);
+        // Multisampled draws walk blocks rather than spans, so the interpolation is the same
+        renderer.SetRasterTraversal(RasterTraversal::kBlocks);
+        std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+
+        for (const Scene& scene : GetScenes())
+        {
+            // Most pixels of the dense meshes are on an edge at this size
+            if (scene.name != "cube" && scene.name != "plane")
+                continue;
+
+            for (QRendererMode mode : {QRendererMode::kNone, QRendererMode::kPhong})
+            {
+                Model model{OBJ::LoadFileData(scene.filePath)};
+                renderer.SetMultisampling(1);
+                renderer.ClearBuffers();
+                renderer.Render(model, scene.modelMat, checkerboard, mode);
+                std::vector<uint32_t> reference = renderer.GetPixels();
+
+                renderer.SetMultisampling(4);
+                renderer.ClearBuffers();
+                renderer.Render(model, scene.modelMat, checkerboard, mode);
+                renderer.Resolve();
+                const std::vector<uint32_t>& pixels = renderer.GetPixels();
+                int drawn = 0, differ = 0;
+                for (size_t i = 0; i < pixels.size(); ++i)
+                {
+                    drawn += (reference[i] != 0 || pixels[i] != 0);
+                    differ += (reference[i] != pixels[i]);
+                }
+                INFO(scene.name << ": " << differ << " of " << drawn << " pixels differ");
+                CHECK(differ > 0);
+                CHECK(differ * 4 < drawn);
+            }
+        }
+        renderer.SetMultisampling(1);
+    }
+}
+
+TEST_CASE("Transparency", "[Golden]")
+{
+    SECTION("A layer blends by its opacity, and hidden layers and the depth are left alone")
+    {
+        // The same tri at several depths in camera space, kZBuffer draws it with gray 255 / depth
+        constexpr int w = 64, h = 48;
+        const Mat44f projMat = GetProjMat(w, h);
+        auto makeTri = [](float scale, float depth)
+        {
+            Model tri;
+            const Vec2f shape[3] = {Vec2f{-0.8f, -0.7f}, Vec2f{0.1f, 0.85f}, Vec2f{0.9f, -0.5f}};
+            for (const Vec2f& v : shape)
+                tri.verts.push_back(Vec3f{v.x * scale * depth, v.y * scale * depth, -depth});
+            tri.vertIndices = {0, 1, 2};
+            return tri;
+        };
+        const Model background = makeTri(1.0f, 4.0f);
+        const Model hidden = makeTri(0.7f, 6.0f);
+        const Model front = makeTri(0.5f, 2.0f);
+
+        Rasterizer rasterizer;
+        std::vector<uint32_t> frontOnly(w * h, 0);
+        std::vector<float> zBuffer(w * h, 0.0f);
+        rasterizer.Rasterize(frontOnly.data(), zBuffer.data(), w, h, front, Mat44f{}, projMat, QRendererMode::kZBuffer);
+
+        std::vector<uint32_t> pixels(w * h, 0);
+        std::fill(zBuffer.begin(), zBuffer.end(), 0.0f);
+        rasterizer.Rasterize(pixels.data(), zBuffer.data(), w, h, background, Mat44f{}, projMat, QRendererMode::kZBuffer);
+        const std::vector<uint32_t> opaque = pixels;
+        const std::vector<float> opaqueDepth = zBuffer;
+
+        TransparencyBuffer buffer;
+        buffer.Init(w, h);
+        rasterizer.SetTransparency(&buffer, 0.5f);
+        rasterizer.Rasterize(pixels.data(), zBuffer.data(), w, h, hidden, Mat44f{}, projMat, QRendererMode::kZBuffer);
+        rasterizer.SetTransparency(&buffer, 0.25f);
+        rasterizer.Rasterize(pixels.data(), zBuffer.data(), w, h, front, Mat44f{}, projMat, QRendererMode::kZBuffer);
+        rasterizer.SetTransparency(nullptr);
+        CHECK(pixels == opaque);
+        CHECK(zBuffer == opaqueDepth);
+
+        buffer.Resolve(pixels.data());
+        int blended = 0;
+        for (int i = 0; i < w * h; ++i)
+        {
+            if (frontOnly[i] == 0)
+            {
+                CHECK(pixels[i] == opaque[i]);
+                continue;
+            }
+            // About 64 behind and 128 in front, so about 80
+            ++blended;
+            const float expected = (float)(opaque[i] & 0xff) * 0.75f + (float)(frontOnly[i] & 0xff) * 0.25f;
+            CHECK(std::abs((float)(pixels[i] & 0xff) - expected) <= 1.0f);
+            CHECK((pixels[i] >> 24) == 0xffu);
+        }
+        CHECK(blended > 100);
+
+        // Resolving clears what was accumulated
+        std::vector<uint32_t> resolved = pixels;
+        buffer.Resolve(pixels.data());
+        CHECK(pixels == resolved);
+    }
+
+    SECTION("The order of the transparent draws doesn't matter")
+    {
+        QRenderer renderer;
+        InitRenderer(renderer);
+        std::vector<Model> models;
+        for (const Scene& scene : GetScenes())
+            models.push_back(OBJ::LoadFileData(scene.filePath));
+        std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+
+        // The plane is opaque, suzanne and the teapot overlap in front of it
+        std::vector<uint32_t> results[2];
+        for (int order = 0; order < 2; ++order)
+        {
+            CommandBuffer commands;
+            commands.Draw(models[1], GetScenes()[1].modelMat, checkerboard, QRendererMode::kPhong);
+            if (order == 0)
+            {
+                commands.DrawTransparent(models[2], GetScenes()[2].modelMat, 0.4f, QRendererMode::kPhong);
+                commands.DrawTransparent(models[3], GetScenes()[3].modelMat, checkerboard, 0.7f, QRendererMode::kGouraud);
+            }
+            else
+            {
+                commands.DrawTransparent(models[3], GetScenes()[3].modelMat, checkerboard, 0.7f, QRendererMode::kGouraud);
+                commands.DrawTransparent(models[2], GetScenes()[2].modelMat, 0.4f, QRendererMode::kPhong);
+            }
+            renderer.ClearBuffers();
+            renderer.Execute(commands);
+            renderer.Resolve();
+            results[order] = renderer.GetPixels();
+        }
+        CHECK(results[0] == results[1]);
+
+        // The transparent draws did show up, and the opaque plane alone is behind them
+        renderer.ClearBuffers();
+        renderer.Render(models[1], GetScenes()[1].modelMat, checkerboard, QRendererMode::kPhong);
+        renderer.Resolve();
+        CHECK(renderer.GetPixels() != results[0]);
+    }
+
+    SECTION("A fully opaque layer matches an opaque draw")
+    {
+        QRenderer renderer;
+        InitRenderer(renderer);
+        std::shared_ptr<QTexture> checkerboard = MakeCheckerboard();
+
+        // The cube is convex, so each pixel is a single layer once the back faces are culled
+        const Scene scene = GetScenes()[0];
+        Model model{OBJ::LoadFileData(scene.filePath)};
+        for (const ModeInfo& mode : GetModes())
+        {
+            if (mode.mode == QRendererMode::kWireframe)
+                continue;
+            for (bool isTextured : {false, true})
+            {
+                INFO(mode.name << (isTextured ? " textured" : ""));
+                renderer.ClearBuffers();
+                if (isTextured)
+                    renderer.Render(model, scene.modelMat, checkerboard, mode.mode);
+                else
+                    renderer.Render(model, scene.modelMat, mode.mode);
+                std::vector<uint32_t> reference = renderer.GetPixels();
+
+                renderer.ClearBuffers();
+                if (isTextured)
+                    renderer.RenderTransparent(model, scene.modelMat, checkerboard, 1.0f, mode.mode);
+                else
+                    renderer.RenderTransparent(model, scene.modelMat, 1.0f, mode.mode);
+                CHECK(std::count(renderer.GetPixels().begin(), renderer.GetPixels().end(), 0u) == kW * kH);
+                renderer.Resolve();
+
+                // Alpha is opaque once composited, the colors only differ by rounding
+                const std::vector<uint32_t>& pixels = renderer.GetPixels();
+                int maxDiff = 0;
+                for (int i = 0; i < kW * kH; ++i)
+                {
+                    for (int shift = 0; shift < 24; shift += 8)
+                        maxDiff = std::max(maxDiff, std::abs((int)((pixels[i] >> shift) & 0xff) - (int)((reference[i] >> shift) & 0xff)));
+                }
+                CHECK(maxDiff <= 1);
+            }
+        }
+    }
+}
+
+TEST_CASE("Shadows", "[Golden]")
+{
+    const Vec3f eye{0.0f, 2.0f, 3.0f};
+    const Mat44f projMat = GetProjMat();
+    const Mat44f viewMat = GetViewMat(eye);
+    const Vec3f lightDir{0.3f, -1.0f, -0.2f};
+
+    // A small cube floating over the plane
+    const Model cube{OBJ::LoadFileData(GetScenes()[0].filePath)};
+    const Model plane{OBJ::LoadFileData(GetScenes()[1].filePath)};
+    const Mat44f cubeMat = Math::InitScale(0.6f, 0.6f, 0.6f) * Math::InitTranslation(0.0f, 0.4f, 0.0f);
+    const Mat44f planeMat = GetScenes()[1].modelMat;
+
+    SECTION("Depth-only draws match the depth of kZBuffer draws")
+    {
+        Rasterizer rasterizer;
+        for (const Scene& scene : GetScenes())
+        {
+            INFO(scene.name);
+            Model model{OBJ::LoadFileData(scene.filePath)};
+            std::vector<uint32_t> pixels(kW * kH, 0);
+            std::vector<float> zBuffer(kW * kH, 0.0f);
+            rasterizer.Rasterize(pixels.data(), zBuffer.data(), kW, kH, model, scene.modelMat * viewMat, projMat, QRendererMode::kZBuffer);
+
+            std::vector<float> depth(kW * kH, 0.0f);
+            rasterizer.RasterizeDepth(depth.data(), kW, kH, model, scene.modelMat * viewMat, projMat);
+            CHECK(depth == zBuffer);
+        }
+    }
+
+    SECTION("Hard shadows are on or off, filtered ones have a penumbra")
+    {
+        Rasterizer rasterizer;
+        for (ShadowFilter filter : {ShadowFilter::kHard, ShadowFilter::kPCF})
+        {
+            ShadowSettings settings;
+            settings.resolution = 256;
+            settings.filter = filter;
+            ShadowMap shadowMap;
+            shadowMap.Init(settings);
+            REQUIRE(shadowMap.Fit(lightDir, viewMat, projMat) == (1 << settings.cascadeCount) - 1);
+            CHECK(shadowMap.Fit(lightDir, viewMat, projMat) == 0);
+            shadowMap.Clear((1 << settings.cascadeCount) - 1);
+            for (int c = 0; c < settings.cascadeCount; ++c)
+                rasterizer.RasterizeDepth(shadowMap.GetDepth(c), settings.resolution, settings.resolution, cube, cubeMat * shadowMap.GetLightView(c), shadowMap.GetLightProj(c));
+
+            // Sweep the plane through the shadow of the cube, it falls about 0.3 to +x and 0.2 to -z
+            const Vec4f up = Math::MultiplyVecMat(Vec4f{0.0f, 1.0f, 0.0f, 0.0f}, viewMat);
+            const Vec3f normal{up.x, up.y, up.z};
+            int shadowedCnt = 0, penumbraCnt = 0;
+            for (float x = -1.5f; x <= 1.5f; x += 0.005f)
+            {
+                const Vec3f viewPos = Math::MultiplyVecMat(Vec3f{x, -0.5f, -0.2f}, viewMat);
+                const float light = shadowMap.Lookup(viewPos, normal);
+                REQUIRE(light >= 0.0f);
+                REQUIRE(light <= 1.0f);
+                shadowedCnt += (light == 0.0f);
+                penumbraCnt += (light > 0.0f && light < 1.0f);
+            }
+            CHECK(shadowedCnt > 50);
+            if (filter == ShadowFilter::kHard)
+                CHECK(penumbraCnt == 0);
+            else
+                CHECK(penumbraCnt > 0);
+
+            // Far from the cube, and past the last cascade
+            CHECK(shadowMap.Lookup(Math::MultiplyVecMat(Vec3f{1.4f, -0.5f, 1.4f}, viewMat), normal) == 1.0f);
+            CHECK(shadowMap.Lookup(Vec3f{0.0f, 0.0f, -settings.maxDistance - 1.0f}, normal) == 1.0f);
+        }
+    }
+
+    QRenderer renderer;
+    InitRenderer(renderer, eye);
+    Light sun;
+    sun.vec = lightDir;
+    sun.castsShadows = true;
+    renderer.SetLights({sun});
+    auto draw = [&](const Mat44f& casterMat)
+    {
+        renderer.ClearBuffers();
+        renderer.RenderShadowCaster(plane, planeMat);
+        renderer.RenderShadowCaster(cube, casterMat);
+        renderer.Render(plane, planeMat, QRendererMode::kPhong);
+        return renderer.GetPixels();
+    };
+
+    SECTION("Shadows only darken, and a plane doesn't shadow itself")
+    {
+        renderer.ClearBuffers();
+        renderer.Render(plane, planeMat, QRendererMode::kPhong);
+        const std::vector<uint32_t> unshadowed = renderer.GetPixels();
+
+        renderer.SetShadows(true);
+        renderer.ClearBuffers();
+        renderer.RenderShadowCaster(plane, planeMat);
+        renderer.Render(plane, planeMat, QRendererMode::kPhong);
+        CHECK(renderer.GetPixels() == unshadowed);
+
+        const std::vector<uint32_t> shadowed = draw(cubeMat);
+        int darkerCnt = 0;
+        for (int i = 0; i < kW * kH; ++i)
+        {
+            bool isDarker = false;
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                const uint32_t channel = (shadowed[i] >> shift) & 0xff;
+                const uint32_t reference = (unshadowed[i] >> shift) & 0xff;
+                REQUIRE(channel <= reference);
+                isDarker |= channel < reference;
+            }
+            darkerCnt += isDarker;
+        }
+        CHECK(darkerCnt > 50);
+
+        // Without a shadow casting light
+        sun.castsShadows = false;
+        renderer.SetLights({sun});
+        CHECK(draw(cubeMat) == unshadowed);
+    }
+
+    SECTION("Cached casters are only drawn again once invalidated")
+    {
+        const Mat44f movedMat = cubeMat * Math::InitTranslation(0.6f, 0.0f, 0.0f);
+        ShadowSettings settings;
+        settings.isCached = true;
+        renderer.SetShadows(true, settings);
+        const std::vector<uint32_t> before = draw(cubeMat);
+        CHECK(draw(movedMat) == before);
+
+        renderer.InvalidateShadows();
+        const std::vector<uint32_t> after = draw(movedMat);
+        CHECK(after != before);
+        CHECK(draw(cubeMat) == after);
+
+        renderer.SetShadows(true);
+        CHECK(draw(cubeMat) == before);
+    }
+}
+
+TEST_CASE("Wireframe", "[Golden]")
+{
+    const Mat44f projMat = GetProjMat();
+    const Mat44f viewMat = GetViewMat();
+    auto countDrawn = [](const std::vector<uint32_t>& pixels)
+    {
+        return std::count_if(pixels.begin(), pixels.end(), [](uint32_t c) { return c != 0; });
+    };
+
+    SECTION("Each edge is listed once, and drawn at most once")
+    {
+        Rasterizer rasterizer;
+        for (const Scene& scene : GetScenes())
+        {
+            INFO(scene.name);
+            const Model model{OBJ::LoadFileData(scene.filePath)};
+            const size_t triCnt = model.vertIndices.size() / 3;
+            size_t borderCnt = 0;
+            for (const Edge& edge : model.edges)
+            {
+                REQUIRE(edge.tri0 >= 0);
+                REQUIRE((size_t)edge.tri0 < triCnt);
+                REQUIRE(edge.tri1 < (int)triCnt);
+                borderCnt += (edge.tri1 < 0);
+            }
+            // Every tri has 3 edges, the ones between 2 tris are shared
+            CHECK(2 * model.edges.size() - borderCnt == 3 * triCnt);
+            for (const Lod& lod : model.lods)
+                CHECK(2 * lod.edges.size() >= lod.vertIndices.size());
+
+            std::vector<uint32_t> pixels(kW * kH, 0);
+            rasterizer.ResetStats();
+            rasterizer.Rasterize(pixels.data(), nullptr, kW, kH, model, scene.modelMat * viewMat, projMat, QRendererMode::kWireframe);
+            const RasterStats& stats = rasterizer.GetStats();
+            CHECK(stats.linesDrawn > 0);
+            CHECK((size_t)stats.linesDrawn <= model.edges.size());
+            CHECK(countDrawn(pixels) > 0);
+        }
+    }
+
+    SECTION("Lines end at their endpoints, and are clipped to the viewport")
+    {
+        Rasterizer rasterizer;
+        std::vector<uint32_t> pixels(kW * kH, 0);
+        rasterizer.DrawLine(pixels.data(), nullptr, 0xffffffffu, kW, kH, Vec4f{2.0f, 3.0f, 0.0f, 1.0f}, Vec4f{50.0f, 20.0f, 0.0f, 1.0f});
+        CHECK(pixels[2 + 3 * kW] != 0);
+        CHECK(pixels[50 + 20 * kW] != 0);
+        CHECK(countDrawn(pixels) == 49);
+
+        std::fill(pixels.begin(), pixels.end(), 0);
+        rasterizer.DrawLine(pixels.data(), nullptr, 0xffffffffu, kW, kH, Vec4f{5.0f, 30.0f, 0.0f, 1.0f}, Vec4f{5.0f, -10.0f, 0.0f, 1.0f});
+        CHECK(pixels[5 + 30 * kW] != 0);
+        CHECK(pixels[5] != 0);
+        CHECK(countDrawn(pixels) == 31);
+
+        // Guard rows around the viewport catch writes out of it
+        const int guard = 2 * kW;
+        std::vector<uint32_t> guarded(kW * kH + 2 * guard, 0);
+        uint32_t *viewport = guarded.data() + guard;
+        const Vec4f ends[] = {
+            {0.0f, 0.0f, 0.0f, 1.0f}, {kW - 1.0f, kH - 1.0f, 0.0f, 1.0f}, {(float)kW, (float)kH, 0.0f, 1.0f}, {kW - 0.5f, -0.5f, 0.0f, 1.0f},
+            {-1e6f, 40.0f, 0.0f, 1.0f}, {80.0f, 1e6f, 0.0f, 1.0f}, {1e6f, -1e6f, 0.0f, 1.0f}, {kW * 0.5f, kH * 0.5f, 0.0f, 1.0f},
+        };
+        for (const Vec4f& p0 : ends)
+        {
+            for (const Vec4f& p1 : ends)
+                rasterizer.DrawLine(viewport, nullptr, 0xffffffffu, kW, kH, p0, p1);
+        }
+        CHECK(std::all_of(guarded.begin(), guarded.begin() + guard, [](uint32_t c) { return c == 0; }));
+        CHECK(std::all_of(guarded.end() - guard, guarded.end(), [](uint32_t c) { return c == 0; }));
+        CHECK(viewport[0] != 0);
+        CHECK(viewport[kW - 1 + (kH - 1) * kW] != 0);
+    }
+
+    SECTION("With the depth test, lines are hidden behind earlier draws but not by their own tris")
+    {
+        Rasterizer rasterizer;
+        for (const Scene& scene : GetScenes())
+        {
+            INFO(scene.name);
+            const Model model{OBJ::LoadFileData(scene.filePath)};
+            const Mat44f modelViewMat = scene.modelMat * viewMat;
+            std::vector<uint32_t> reference(kW * kH, 0);
+            rasterizer.SetLineDepthTest(false);
+            rasterizer.Rasterize(reference.data(), nullptr, kW, kH, model, modelViewMat, projMat, QRendererMode::kWireframe);
+
+            // Nothing drawn yet, the depth test passes everywhere
+            rasterizer.SetLineDepthTest(true);
+            std::vector<uint32_t> pixels(kW * kH, 0);
+            std::vector<float> zBuffer(kW * kH, 0.0f);
+            rasterizer.Rasterize(pixels.data(), zBuffer.data(), kW, kH, model, modelViewMat, projMat, QRendererMode::kWireframe);
+            CHECK(pixels == reference);
+            CHECK(std::all_of(zBuffer.begin(), zBuffer.end(), [](float z) { return z == 0.0f; }));
+
+            // Over the depth of the model itself, only the hidden edges of its facing tris go
+            std::vector<uint32_t> unused(kW * kH, 0);
+            rasterizer.Rasterize(unused.data(), zBuffer.data(), kW, kH, model, modelViewMat, projMat, QRendererMode::kZBuffer);
+            std::fill(pixels.begin(), pixels.end(), 0);
+            rasterizer.Rasterize(pixels.data(), zBuffer.data(), kW, kH, model, modelViewMat, projMat, QRendererMode::kWireframe);
+            CHECK(countDrawn(pixels) > 0);
+            if (scene.name == "cube" || scene.name == "plane")
+                CHECK(countDrawn(pixels) * 100 >= countDrawn(reference) * 95);
+
+            // Behind a wall at the near plane
+            std::fill(zBuffer.begin(), zBuffer.end(), 2.0f);
+            std::fill(pixels.begin(), pixels.end(), 0);
+            rasterizer.Rasterize(pixels.data(), zBuffer.data(), kW, kH, model, modelViewMat, projMat, QRendererMode::kWireframe);
+            CHECK(countDrawn(pixels) == 0);
+        }
+    }
+
+    SECTION("Edges crossing the near plane are clipped")
+    {
+        Rasterizer rasterizer;
+        const Model plane{OBJ::LoadFileData(GetScenes()[1].filePath)};
+        const Mat44f lowViewMat = Math::InitLookAt(Vec3f{0.0f, 0.1f, 0.0f}, Vec3f{0.0f, 0.0f, -1.0f}, Vec3f{0.0f, 1.0f, 0.0f});
+        std::vector<uint32_t> pixels(kW * kH, 0);
+        rasterizer.Rasterize(pixels.data(), nullptr, kW, kH, plane, GetScenes()[1].modelMat * Math::InitTranslation(0.0f, 0.5f, 0.0f) * lowViewMat, projMat, QRendererMode::kWireframe);
+        const RasterStats& stats = rasterizer.GetStats();
+        CHECK(stats.clipped > 0);
+        CHECK(stats.linesDrawn > 0);
+        CHECK(countDrawn(pixels) > 0);
+    }
+}
@@ -4,6 +4,8 @@
 #include "Utils/Helper.h"
 #include "Math/Vector.h"
 #include "Math/Matrix.h"
+#include "Math/Batch.h"
+#include "Renderer/Light.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // Helper function testing
@@ -212,6 +214,15 @@ TEST_CASE("Inverse", "[Math::Matrix]")
             0.00000f, 0.00000f, 0.00000f, 1.00000f,};
         REQUIRE(expected == Inverse(m2));
     }
+
+    SECTION("Inverse with negative pivots")
+    {
+        constexpr float pi = 3.14159265358979f;
+        Mat44f m3 = Math::InitRotation(0.0f, pi / 6.0f, pi / 4.0f) * Math::InitScale(1.5f, 1.5f, 1.5f) *
+            Math::InitTranslation(0.0f, 0.0f, -2.5f);
+        REQUIRE(m3(0, 2) < 0.0f);
+        REQUIRE(Mat44f{} == m3 * Math::Inverse(m3));
+    }
 }
 
 TEST_CASE("Vector-matrix multiplication", "[Math::Matrix]")
@@ -296,3 +307,141 @@ TEST_CASE("Useful matrices", "[Math::Matrix]")
 
 }
 
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SIMD and batched kernels testing
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("4-component vector", "[Math::Vector]")
+{
+    STATIC_REQUIRE(alignof(Vec4f) == 16);
+    constexpr Vec4f v{1.0f, 2.0f, 3.0f, 4.0f};
+    STATIC_REQUIRE(v[3] == 4.0f);
+
+    REQUIRE(Vec4f{2.0f, 4.0f, 6.0f, 8.0f} == v + v);
+    REQUIRE(Vec4f{0.0f, 1.0f, 2.0f, 3.0f} == v - Vec4f(1.0f));
+    REQUIRE(Vec4f{-0.5f, -1.0f, -1.5f, -2.0f} == -v * 0.5f);
+    REQUIRE(Helper::IsEqual(30.0f, Math::Dot(v, v)));
+}
+
+TEST_CASE("4x4 matrix SIMD operations match the generic ones", "[Math::Matrix]")
+{
+    STATIC_REQUIRE(alignof(Mat44f) == 16);
+    constexpr float pi = 3.14159265358979f;
+    Mat44f m = Math::InitRotation(pi / 3.0f, pi / 4.0f, pi / 6.0f);
+    m(3, 0) = 1.0f;
+    m(3, 1) = -2.0f;
+    m(3, 2) = 3.0f;
+
+    SECTION("Vector-matrix multiplication")
+    {
+        Vec4f v{2.0f, 4.0f, 6.0f, 1.0f};
+        Vec3f v3 = Math::MultiplyVecMat(Vec3f{2.0f, 4.0f, 6.0f}, m);
+        Vec4f result = Math::MultiplyVecMat(v, m);
+        REQUIRE(Vec3f{result.x, result.y, result.z} == v3);
+        REQUIRE(Helper::IsEqual(result.w, 1.0f));
+    }
+
+    SECTION("Matrix-matrix multiplication")
+    {
+        Mat44f expected{};
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                expected(i, j) = 0.0f;
+                for (int k = 0; k < 4; ++k)
+                    expected(i, j) += m(i, k) * m(k, j);
+            }
+        }
+        REQUIRE(expected == m * m);
+        REQUIRE(Mat44f{} == m * Math::Inverse(m));
+    }
+}
+
+TEST_CASE("Batched transform kernels", "[Math::Batch]")
+{
+    constexpr float pi = 3.14159265358979f;
+    Mat44f m = Math::InitRotation(0.0f, pi / 6.0f, pi / 4.0f) * Math::InitTranslation(0.0f, 0.0f, -3.0f) *
+        Math::InitPersp(pi / 2.0f, 4.0f / 3.0f, 0.5f, 100.0f);
+
+    // 13 verts so that the 8-wide, 4-wide and scalar paths are all exercised
+    std::vector<Vec3f> verts;
+    for (int i = 0; i < 13; ++i)
+        verts.push_back(Vec3f{(float)i * 0.1f - 0.6f, (float)(i % 5) * 0.2f, (float)(i % 3) * -0.3f});
+
+    Math::SoAPositions soa;
+    Math::ToSoA(verts, soa);
+    Math::SoAPositions clip;
+    Math::TransformPositions(soa, m, clip);
+    REQUIRE(clip.Size() == verts.size());
+    for (size_t i = 0; i < verts.size(); ++i)
+        REQUIRE(Math::MultiplyVecMat(Vec4f{verts[i].x, verts[i].y, verts[i].z, 1.0f}, m) == clip.Get(i));
+
+    Math::SoAPositions raster = clip;
+    Math::PerspectiveDivide(raster);
+    Math::ViewportTransform(raster, 800, 600);
+    for (size_t i = 0; i < verts.size(); ++i)
+    {
+        Vec4f c = clip.Get(i);
+        REQUIRE(Helper::IsEqual((c.x / c.w + 1.0f) * 400.0f, raster.x[i]));
+        REQUIRE(Helper::IsEqual((c.y / c.w + 1.0f) * 300.0f, raster.y[i]));
+        REQUIRE(Helper::IsEqual(c.z / c.w, raster.z[i]));
+        REQUIRE(Helper::IsEqual(1.0f / c.w, raster.w[i]));
+    }
+
+    Math::SoAPositions dirs;
+    Math::TransformDirections(soa, m, dirs);
+    for (size_t i = 0; i < verts.size(); ++i)
+    {
+        // Only x, y, z are transformed, w is 0
+        Vec4f expected = Math::MultiplyVecMat(Vec4f{verts[i].x, verts[i].y, verts[i].z, 0.0f}, m);
+        expected.w = 0.0f;
+        REQUIRE(expected == dirs.Get(i));
+    }
+}
+
+TEST_CASE("Batched lighting matches single point lighting", "[Renderer::Light]")
+{
+    Light sun;
+    Light bulb;
+    bulb.type = LightType::kPoint;
+    bulb.vec = Vec3f{1.0f, 2.0f, 0.0f};
+    bulb.color = Vec3f{1.0f, 0.5f, 0.25f};
+    bulb.range = 4.0f;
+
+    LightBuffer lights;
+    lights.Upload({sun, bulb}, Math::InitTranslation(0.0f, 0.0f, -3.0f));
+
+    SECTION("A normal facing a directional light gets its full color")
+    {
+        LightBuffer sunOnly;
+        sunOnly.Upload({sun}, Mat44f{});
+        REQUIRE(Vec3f{1.0f, 1.0f, 1.0f} == sunOnly.Shade(Vec3f{0.0f}, -sun.vec));
+        REQUIRE(Vec3f{0.0f, 0.0f, 0.0f} == sunOnly.Shade(Vec3f{0.0f}, sun.vec));
+    }
+
+    SECTION("8-wide, 4-wide and scalar paths")
+    {
+        // A full batch runs the 8-wide path with AVX, 7 points run the 4-wide one and the scalar
+        // tail, so every path is exercised whichever SIMD paths exist
+        ShadeBatch batch;
+        for (int cnt : {ShadeBatch::kSize, 7})
+        {
+            for (int i = 0; i < cnt; ++i)
+            {
+                batch.px[i] = (float)i * 0.3f - 1.0f;
+                batch.py[i] = (float)(i % 3) * 0.5f;
+                batch.pz[i] = -3.0f;
+                batch.nx[i] = (float)(i % 2) - 0.5f;
+                batch.ny[i] = 1.0f;
+                batch.nz[i] = (float)i * 0.1f;
+            }
+            lights.Shade(batch, cnt);
+            for (int i = 0; i < cnt; ++i)
+            {
+                Vec3f single = lights.Shade(Vec3f{batch.px[i], batch.py[i], batch.pz[i]}, Vec3f{batch.nx[i], batch.ny[i], batch.nz[i]});
+                REQUIRE(single == Vec3f{batch.r[i], batch.g[i], batch.b[i]});
+            }
+        }
+    }
+}
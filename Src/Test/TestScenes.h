@@ -0,0 +1,73 @@
+#pragma once
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Math/Vector.h"
+#include "Math/Matrix.h"
+#include "Renderer/QRenderer.h"
+#include "Renderer/Texture.h"
+
+// @brief Scenes, textures and the camera shared by the tests that draw through QRenderer. The meshes
+// are loaded from the Assets folder, relative to the working directory.
+namespace TestScenes
+{
+    constexpr int kW = 160;
+    constexpr int kH = 120;
+    constexpr float kPi = 3.14159265358979f;
+
+    // @brief The projection every scene is drawn with, w and h only change the aspect ratio
+    inline Mat44f GetProjMat(int w = kW, int h = kH) { return Math::InitPersp(kPi / 2.0f, (float)w / h, 0.5f, 100.0f); }
+
+    // @brief A camera looking at the origin, where the scenes are
+    inline Mat44f GetViewMat(const Vec3f& eye = Vec3f{0.0f, 1.0f, 2.5f})
+    {
+        return Math::InitLookAt(eye, Vec3f{0.0f, 0.0f, 0.0f}, Vec3f{0.0f, 1.0f, 0.0f});
+    }
+
+    // @brief Init to kW x kH, with GetProjMat() and GetViewMat(eye)
+    inline void InitRenderer(QRenderer& renderer, const Vec3f& eye = Vec3f{0.0f, 1.0f, 2.5f})
+    {
+        REQUIRE(renderer.Init(kW, kH));
+        renderer.SetProjectionMatrix(GetProjMat());
+        renderer.SetViewMatrix(GetViewMat(eye));
+    }
+
+    // @brief 8x8 checkerboard, generated so that the tests don't depend on the JPG decoder
+    inline std::shared_ptr<QTexture> MakeCheckerboard()
+    {
+        constexpr int size = 64;
+        std::vector<uint32_t> texels(size * size);
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                bool isWhite = ((x / 8) + (y / 8)) % 2 == 0;
+                texels[x + y * size] = isWhite ? 0xffe0e0e0 : 0xff2040a0;
+            }
+        }
+        auto texture = std::make_shared<QTexture>();
+        texture->Init(size, size, std::move(texels));
+        return texture;
+    }
+
+    struct Scene
+    {
+        std::string name;
+        std::string filePath;
+        Mat44f modelMat;
+    };
+
+    inline std::vector<Scene> GetScenes()
+    {
+        return {
+            {"cube", "Assets/Cube.obj", Math::InitRotation(0.0f, kPi / 6.0f, kPi / 4.0f) * Math::InitScale(1.5f, 1.5f, 1.5f)},
+            {"plane", "Assets/plane.obj", Math::InitScale(0.3f, 0.3f, 0.3f) * Math::InitTranslation(0.0f, -0.5f, 0.0f)},
+            {"suzanne", "Assets/suzanne.obj", Math::InitRotation(0.0f, 0.0f, kPi / 8.0f)},
+            {"teapot", "Assets/teapot.obj", Math::InitScale(0.5f, 0.5f, 0.5f) * Math::InitRotation(0.0f, kPi / 8.0f, kPi / 3.0f)},
+        };
+    }
+}
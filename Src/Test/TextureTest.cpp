@@ -0,0 +1,387 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Math/Vector.h"
+#include "Math/Matrix.h"
+#include "Renderer/BlockCompression.h"
+#include "Renderer/Model.h"
+#include "Renderer/OBJLoader.h"
+#include "Renderer/QRenderer.h"
+#include "Renderer/Rasterizer.h"
+#include "Renderer/Texture.h"
+#include "Renderer/TextureCache.h"
+#include "TestScenes.h"
+
+using namespace TestScenes;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Texture testing
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("Bilinear filtering", "[Renderer::Texture]")
+{
+    Rasterizer rasterizer;
+    constexpr int texW = 8, texH = 4;
+    std::vector<uint32_t> texels(texW * texH);
+    for (int i = 0; i < texW * texH; ++i)
+        texels[i] = (uint32_t)i * 2654435761u;
+
+    SECTION("Texel centers match the nearest texel")
+    {
+        for (int y = 0; y < texH; ++y)
+        {
+            for (int x = 0; x < texW; x += 4)
+            {
+                Vec2f uvs[4];
+                for (int lane = 0; lane < 4; ++lane)
+                    uvs[lane] = Vec2f{(float)(x + lane) / texW, (float)y / texH};
+                uint32_t out[4];
+                rasterizer.SampleBilinear4(texels.data(), texW, texH, uvs, out);
+                for (int lane = 0; lane < 4; ++lane)
+                    CHECK(out[lane] == rasterizer.SampleNearest(texels.data(), texW, texH, uvs[lane]));
+            }
+        }
+    }
+
+    SECTION("Halfway is the rounded average, the edges and NaNs are clamped")
+    {
+        Vec2f uvs[4] = {Vec2f{0.5f / texW, 0.0f}, Vec2f{-1.0f, -1.0f}, Vec2f{2.0f, 2.0f}, Vec2f{std::nanf(""), 0.0f}};
+        uint32_t out[4];
+        rasterizer.SampleBilinear4(texels.data(), texW, texH, uvs, out);
+        uint32_t average = 0;
+        for (int k = 0; k < 32; k += 8)
+            average |= ((((texels[0] >> k) & 0xff) + ((texels[1] >> k) & 0xff) + 1) / 2) << k;
+        CHECK(out[0] == average);
+        CHECK(out[1] == texels[0]);
+        CHECK(out[2] == texels[texW * texH - 1]);
+        CHECK(out[3] == texels[0]);
+    }
+}
+
+TEST_CASE("Compressed textures", "[Renderer::Texture]")
+{
+    SECTION("4 to 8 times smaller")
+    {
+        std::shared_ptr<QTexture> bc1 = MakeCheckerboard();
+        std::shared_ptr<QTexture> bc3 = MakeCheckerboard();
+        const size_t rawSize = bc1->GetByteSize();
+        bc1->Compress(TextureFormat::kBC1);
+        bc3->Compress(TextureFormat::kBC3);
+        // Not quite 8 and 4, the smallest mips are padded to whole blocks
+        CHECK(bc1->GetByteSize() * 7 < rawSize);
+        CHECK(bc3->GetByteSize() * 7 < rawSize * 2);
+        CHECK(bc1->GetTexels() == nullptr);
+    }
+
+    SECTION("Blocks keep their colors and alpha")
+    {
+        // A gradient along one axis, the alpha along the other one. Errors are within half a step
+        // of the palettes.
+        uint32_t texels[16];
+        for (int i = 0; i < 16; ++i)
+            texels[i] = ((uint32_t)(i % 4 * 80) << 24) | ((uint32_t)(i / 4 * 60 + 20) * 0x010101u);
+        for (TextureFormat format : {TextureFormat::kBC1, TextureFormat::kBC3})
+        {
+            uint8_t block[16];
+            uint32_t decoded[16];
+            BlockCompression::EncodeBlock(format, texels, block);
+            BlockCompression::DecodeBlock(format, block, decoded);
+            for (int i = 0; i < 16; ++i)
+            {
+                INFO((format == TextureFormat::kBC1 ? "BC1 " : "BC3 ") << i);
+                for (int shift = 0; shift < 24; shift += 8)
+                    CHECK(std::abs((int)((decoded[i] >> shift) & 0xff) - (int)((texels[i] >> shift) & 0xff)) <= 8);
+                const int alpha = (int)(decoded[i] >> 24);
+                if (format == TextureFormat::kBC1)
+                    CHECK(alpha == 255);
+                else
+                    CHECK(std::abs(alpha - (int)(texels[i] >> 24)) <= 240 / 14 + 1);
+            }
+        }
+    }
+
+    SECTION("Draws look the same, and blocks are decoded once in a while")
+    {
+        QRenderer renderer;
+        InitRenderer(renderer);
+        renderer.SetPixelCounting(true);
+        std::shared_ptr<QTexture> raw = MakeCheckerboard();
+        std::shared_ptr<QTexture> compressed = MakeCheckerboard();
+        compressed->Compress(TextureFormat::kBC1);
+
+        for (const Scene& scene : GetScenes())
+        {
+            Model model{OBJ::LoadFileData(scene.filePath)};
+            renderer.ClearBuffers();
+            renderer.Render(model, scene.modelMat, raw, QRendererMode::kNone);
+            std::vector<uint32_t> reference = renderer.GetPixels();
+
+            renderer.ClearBuffers();
+            renderer.ResetStats();
+            renderer.Render(model, scene.modelMat, compressed, QRendererMode::kNone);
+            const std::vector<uint32_t>& pixels = renderer.GetPixels();
+            int maxError = 0;
+            for (size_t i = 0; i < pixels.size(); ++i)
+            {
+                for (int shift = 0; shift < 32; shift += 8)
+                    maxError = std::max(maxError, std::abs((int)((pixels[i] >> shift) & 0xff) - (int)((reference[i] >> shift) & 0xff)));
+            }
+            INFO(scene.name << ": " << renderer.GetStats().blocksDecoded << " blocks for " << renderer.GetStats().pixelsShaded << " pixels");
+            CHECK(maxError <= 8);
+            CHECK(renderer.GetStats().blocksDecoded > 0);
+            // Bilinear reads 4 texels a pixel, most of them come from the cache
+            CHECK(renderer.GetStats().blocksDecoded * 2 < renderer.GetStats().pixelsShaded);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Texture cache and manager testing
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_CASE("Texture disk cache", "[Renderer::TextureCache]")
+{
+    const std::string cachePath = "TextureTest.qtex";
+
+    SECTION("The cache round trips every level, and is rebuilt for other sources and formats")
+    {
+        for (TextureFormat format : {TextureFormat::kRGBA32, TextureFormat::kBC3})
+        {
+            std::shared_ptr<QTexture> texture = MakeCheckerboard();
+            if (format != TextureFormat::kRGBA32)
+                texture->Compress(format);
+            REQUIRE(TextureCache::Save(cachePath, *texture, "Assets/checkerboard.jpg"));
+
+            QTexture cached;
+            REQUIRE(TextureCache::Load(cachePath, "Assets/checkerboard.jpg", format, cached));
+            CHECK(cached.GetFormat() == format);
+            CHECK(cached.GetW() == texture->GetW());
+            CHECK(cached.GetMipCount() == texture->GetMipCount());
+            CHECK(cached.GetByteSize() == texture->GetByteSize());
+            texture->LockTexture();
+            cached.LockTexture();
+            for (int level = 0; level < texture->GetMipCount(); ++level)
+            {
+                INFO("Level " << level);
+                const QTexture::MipLevel expected = texture->GetMip(level);
+                const QTexture::MipLevel mip = cached.GetMip(level);
+                REQUIRE(mip.w == expected.w);
+                REQUIRE(mip.h == expected.h);
+                const size_t size = BlockCompression::GetImageSize(format, mip.w, mip.h);
+                if (format == TextureFormat::kRGBA32)
+                    CHECK(memcmp(mip.texels, expected.texels, size) == 0);
+                else
+                    CHECK(memcmp(mip.blocks, expected.blocks, size) == 0);
+            }
+            cached.UnlockTexture();
+            texture->UnlockTexture();
+
+            const TextureFormat other = format == TextureFormat::kRGBA32 ? TextureFormat::kBC1 : TextureFormat::kRGBA32;
+            CHECK_FALSE(TextureCache::Load(cachePath, "Assets/checkerboard.jpg", other, cached));
+            CHECK_FALSE(TextureCache::Load(cachePath, "Assets/bricks.jpg", format, cached));
+            CHECK(cached.GetFormat() == format);
+        }
+        std::remove(cachePath.c_str());
+    }
+
+    SECTION("Truncated files are a miss, writes to a mapped texture stay in memory")
+    {
+        std::shared_ptr<QTexture> texture = MakeCheckerboard();
+        REQUIRE(TextureCache::Save(cachePath, *texture, "Assets/checkerboard.jpg"));
+        std::vector<char> bytes;
+        {
+            std::ifstream ifs{cachePath, std::ios::binary};
+            bytes.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        }
+
+        QTexture cached;
+        REQUIRE(TextureCache::Load(cachePath, "Assets/checkerboard.jpg", TextureFormat::kRGBA32, cached));
+        cached.LockTexture();
+        uint32_t *texels = const_cast<uint32_t *>(cached.GetTexels());
+        const uint32_t first = texels[0];
+        texels[0] = ~first;
+        cached.UnlockTexture();
+        QTexture reloaded;
+        REQUIRE(TextureCache::Load(cachePath, "Assets/checkerboard.jpg", TextureFormat::kRGBA32, reloaded));
+        reloaded.LockTexture();
+        CHECK(reloaded.GetTexels()[0] == first);
+        reloaded.UnlockTexture();
+
+        {
+            std::ofstream ofs{cachePath, std::ios::binary | std::ios::trunc};
+            ofs.write(bytes.data(), bytes.size() - 1);
+        }
+        CHECK_FALSE(TextureCache::Load(cachePath, "Assets/checkerboard.jpg", TextureFormat::kRGBA32, reloaded));
+        std::remove(cachePath.c_str());
+    }
+
+    SECTION("Mapped textures draw the same")
+    {
+        QRenderer renderer;
+        InitRenderer(renderer);
+        for (TextureFormat format : {TextureFormat::kRGBA32, TextureFormat::kBC1})
+        {
+            std::shared_ptr<QTexture> texture = MakeCheckerboard();
+            if (format != TextureFormat::kRGBA32)
+                texture->Compress(format);
+            REQUIRE(TextureCache::Save(cachePath, *texture, "Assets/checkerboard.jpg"));
+            auto cached = std::make_shared<QTexture>();
+            REQUIRE(TextureCache::Load(cachePath, "Assets/checkerboard.jpg", format, *cached));
+
+            for (const Scene& scene : GetScenes())
+            {
+                Model model{OBJ::LoadFileData(scene.filePath)};
+                renderer.ClearBuffers();
+                renderer.Render(model, scene.modelMat, texture, QRendererMode::kNone);
+                std::vector<uint32_t> reference = renderer.GetPixels();
+                renderer.ClearBuffers();
+                renderer.Render(model, scene.modelMat, cached, QRendererMode::kNone);
+                INFO(scene.name);
+                CHECK(renderer.GetPixels() == reference);
+            }
+
+            // Dropping a mip copies the levels out of the mapping
+            REQUIRE(cached->DropTopMip());
+            CHECK(cached->GetW() == texture->GetW() / 2);
+        }
+        std::remove(cachePath.c_str());
+    }
+}
+
+TEST_CASE("Async texture loads", "[Renderer::TextureManager]")
+{
+    TextureManager& manager = TextureManager::Instance();
+    manager.UnloadAll();
+
+    SECTION("Loads of the same path share one texture")
+    {
+        TextureHandle first = manager.LoadAsync("Assets/checkerboard.jpg");
+        TextureHandle second = manager.LoadAsync("Assets/checkerboard.jpg");
+        CHECK((first.IsReady() || first.Get() == manager.GetPlaceholder()));
+        first.Wait();
+        second.Wait();
+        REQUIRE(first.IsReady());
+        CHECK(first.Get() != manager.GetPlaceholder());
+        CHECK(first.Get() == second.Get());
+        CHECK(first.Get()->GetW() > 0);
+
+        // Once loaded, the synchronous path and later handles get the same texture
+        CHECK(manager.Load("Assets/checkerboard.jpg", nullptr) == first.Get());
+        CHECK(manager.LoadAsync("Assets/checkerboard.jpg").Get() == first.Get());
+    }
+
+    SECTION("Failed loads keep the placeholder")
+    {
+        TextureHandle missing = manager.LoadAsync("Assets/missing.jpg");
+        missing.Wait();
+        CHECK(missing.IsReady());
+        CHECK(missing.Get() == manager.GetPlaceholder());
+        CHECK(manager.GetPlaceholder()->GetW() == 1);
+        CHECK(!TextureHandle{}.IsValid());
+        CHECK(TextureHandle{}.Get() == nullptr);
+    }
+
+    SECTION("Many loads at once")
+    {
+        const char *paths[] = {"Assets/bricks.jpg", "Assets/bricks2.jpg", "Assets/checkerboard.jpg", "Assets/texture-test.jpg"};
+        std::vector<TextureHandle> handles;
+        for (int k = 0; k < 16; ++k)
+            handles.push_back(manager.LoadAsync(paths[k % 4], (k & 4) ? TextureFormat::kBC1 : TextureFormat::kRGBA32));
+        for (int k = 0; k < 16; ++k)
+        {
+            handles[k].Wait();
+            CHECK(handles[k].Get() == handles[k % 4].Get());
+            CHECK(handles[k].Get() != manager.GetPlaceholder());
+        }
+    }
+    manager.UnloadAll();
+}
+
+TEST_CASE("Texture memory budget", "[Renderer::TextureManager]")
+{
+    TextureManager& manager = TextureManager::Instance();
+    manager.UnloadAll();
+    const char *paths[] = {"Assets/bricks.jpg", "Assets/bricks2.jpg", "Assets/checkerboard.jpg"};
+
+    SECTION("Dropping mips keeps the smaller levels")
+    {
+        for (TextureFormat format : {TextureFormat::kRGBA32, TextureFormat::kBC1})
+        {
+            std::shared_ptr<QTexture> texture = MakeCheckerboard();
+            if (format != TextureFormat::kRGBA32)
+                texture->Compress(format);
+            const size_t before = texture->GetByteSize();
+            const QTexture::MipLevel level2 = texture->GetMip(2);
+            std::vector<uint8_t> level2Blocks(level2.blocks, level2.blocks + (level2.blocks ? BlockCompression::GetImageSize(format, level2.w, level2.h) : 0));
+            std::vector<uint32_t> level2Texels(level2.texels, level2.texels + (level2.texels ? level2.w * level2.h : 0));
+
+            REQUIRE(texture->DropTopMip());
+            CHECK(texture->GetW() == 32);
+            CHECK(texture->GetMipCount() == 6);
+            CHECK(texture->GetByteSize() * 4 < before * 2);
+            const QTexture::MipLevel level1 = texture->GetMip(1);
+            if (format == TextureFormat::kRGBA32)
+                CHECK(std::vector<uint32_t>(level1.texels, level1.texels + level1.w * level1.h) == level2Texels);
+            else
+                CHECK(std::vector<uint8_t>(level1.blocks, level1.blocks + level2Blocks.size()) == level2Blocks);
+
+            while (texture->DropTopMip()) {}
+            CHECK(texture->GetW() == 1);
+            CHECK(texture->GetMipCount() == 1);
+        }
+    }
+
+    SECTION("Least recently used textures are evicted first")
+    {
+        std::vector<TextureHandle> handles;
+        for (const char *path : paths)
+            handles.push_back(manager.LoadAsync(path));
+        manager.WaitForLoads();
+        const size_t total = manager.GetResidentBytes();
+        CHECK(total > 0);
+
+        // The loads may finish in any order, use them in a known one. A hit counts as a use too.
+        handles[1].Get()->Touch();
+        handles[2].Get()->Touch();
+        manager.LoadAsync(paths[0]);
+        handles.clear();
+        manager.SetMemoryBudget(total - 1);
+        std::vector<TextureManager::TextureUsage> usage = manager.GetUsage();
+        CHECK(usage.size() == 2);
+        for (const TextureManager::TextureUsage& texture : usage)
+        {
+            CHECK(texture.filePath != paths[1]);
+            CHECK(texture.refCount == 0);
+        }
+        CHECK(manager.GetResidentBytes() <= total - 1);
+    }
+
+    SECTION("Textures in use only lose mips, and only in Trim()")
+    {
+        TextureHandle handle = manager.LoadAsync(paths[2]);
+        manager.WaitForLoads();
+        std::shared_ptr<QTexture> texture = handle.Get();
+        const int w = texture->GetW();
+        manager.SetMemoryBudget(1);
+        CHECK(manager.GetUsage().size() == 1);
+        CHECK(texture->GetW() == w);
+
+        manager.Trim();
+        CHECK(texture->GetW() == w);
+        manager.SetMipEviction(true);
+        manager.Trim();
+        CHECK(texture->GetW() == 1);
+        CHECK(manager.GetResidentBytes() == sizeof(uint32_t));
+    }
+    manager.SetMemoryBudget(0);
+    manager.SetMipEviction(false);
+    manager.UnloadAll();
+}